@@ -0,0 +1,114 @@
+/*
+* CameraSelectionBenchmark measures CameraVisibilityHelper::updateInputsToUse() on synthetic rigs:
+* a planar grid of perspective, fisheye or 180 degree equirectangular cameras that look ahead with a random tilt,
+* and a cloud of 360 degree equirectangular cameras, each with 16 to 1024 cameras.
+* The OutputCamera moves to a random pose in front of the rig for every update.
+*
+* Usage: CameraSelectionBenchmark [maxNrInputsUsed] [nrPoses] [coverageSamplesPerSide]
+*   with coverageSamplesPerSide > 0, useCoverage() is measured instead of the default selection.
+* Reports the time of init() and the average and worst time per update.
+*/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <math.h>
+#include <chrono>
+#include <random>
+#include <vector>
+#include "CameraVisibilityHelper.h"
+
+
+static InputCamera makeCamera(const glm::vec3& position, float pitch, float yaw, Projection projection) {
+	InputCamera camera;
+	camera.projection = projection;
+	camera.res_x = 1920;
+	camera.res_y = 1080;
+	camera.focal_x = 1400;
+	camera.focal_y = 1400;
+	camera.principal_point_x = 960;
+	camera.principal_point_y = 540;
+	camera.z_near = 0.3f;
+	camera.z_far = 10.0f;
+	camera.hor_range = glm::vec2(-1.57f, 1.57f);
+	camera.ver_range = glm::vec2(-1.57f, 1.57f);
+	camera.fov = glm::radians(180.0f);
+	camera.pos = position;
+	camera.rot = glm::vec3(pitch, yaw, 0.0f);
+	camera.model = glm::translate(glm::mat4(1.0f), position)
+		* glm::rotate(glm::mat4(1.0f), yaw, glm::vec3(0, 1, 0))
+		* glm::rotate(glm::mat4(1.0f), pitch, glm::vec3(1, 0, 0));
+	camera.view = glm::inverse(camera.model);
+	return camera;
+}
+
+static double microseconds(std::chrono::steady_clock::time_point start) {
+	return std::chrono::duration<double, std::micro>(std::chrono::steady_clock::now() - start).count();
+}
+
+static void run(const char* name, const std::vector<InputCamera>& inputCameras, float extent, int maxNrInputsUsed, int nrPoses, int coverageSamplesPerSide) {
+	std::mt19937 random(7);
+	std::uniform_real_distribution<float> uniform(-1.0f, 1.0f);
+	OutputCamera outputCamera;
+	outputCamera.FOV_x = glm::radians(90.0f);
+	outputCamera.FOV_y = glm::radians(70.0f);
+	outputCamera.model = glm::mat4(1.0f);
+
+	CameraVisibilityHelper helper;
+	auto start = std::chrono::steady_clock::now();
+	helper.init(inputCameras, &outputCamera, maxNrInputsUsed);
+	if (coverageSamplesPerSide > 0) {
+		helper.useCoverage(coverageSamplesPerSide, 2.0f);
+	}
+	double initTime = microseconds(start);
+
+	double total = 0.0;
+	double worst = 0.0;
+	for (int p = 0; p < nrPoses; p++) {
+		outputCamera.model = glm::translate(glm::mat4(1.0f), glm::vec3(uniform(random) * extent, uniform(random) * extent, uniform(random) * 0.5f))
+			* glm::rotate(glm::mat4(1.0f), uniform(random) * 0.6f, glm::vec3(0, 1, 0))
+			* glm::rotate(glm::mat4(1.0f), uniform(random) * 0.4f, glm::vec3(1, 0, 0));
+		start = std::chrono::steady_clock::now();
+		helper.updateInputsToUse();
+		double time = microseconds(start);
+		total += time;
+		worst = (std::max)(worst, time);
+	}
+	printf("%-12s %6d cameras: init %10.1f us, update %8.2f us (worst %8.1f us)\n",
+		name, (int)inputCameras.size(), initTime, total / nrPoses, worst);
+}
+
+int main(int argc, char* argv[]) {
+	int maxNrInputsUsed = argc > 1 ? atoi(argv[1]) : 8;
+	int nrPoses = argc > 2 ? atoi(argv[2]) : 2000;
+	int coverageSamplesPerSide = argc > 3 ? atoi(argv[3]) : 0;
+	printf("maxNrInputsUsed %d, %d poses%s\n", maxNrInputsUsed, nrPoses, coverageSamplesPerSide > 0 ? ", with coverage" : "");
+
+	const Projection projections[] = { Projection::Perspective, Projection::Fisheye_equidistant, Projection::Equirectangular };
+	const char* names[] = { "perspective", "fisheye", "erp180" };
+	const int sizes[] = { 16, 64, 256, 1024 };
+	std::mt19937 random(1);
+	std::uniform_real_distribution<float> uniform(-1.0f, 1.0f);
+
+	for (int j = 0; j < 3; j++) {
+		for (int n : sizes) {
+			// 10 cm apart, tilted up to 0.2 radians
+			int side = (int)ceil(sqrt((double)n));
+			std::vector<InputCamera> inputCameras;
+			for (int i = 0; i < n; i++) {
+				glm::vec3 position((i % side) * 0.1f - side * 0.05f, (i / side) * 0.1f - side * 0.05f, uniform(random) * 0.05f);
+				inputCameras.push_back(makeCamera(position, uniform(random) * 0.2f, uniform(random) * 0.2f, projections[j]));
+			}
+			run(names[j], inputCameras, side * 0.06f, maxNrInputsUsed, nrPoses, coverageSamplesPerSide);
+		}
+	}
+	for (int n : sizes) {
+		std::vector<InputCamera> inputCameras;
+		for (int i = 0; i < n; i++) {
+			InputCamera camera = makeCamera(glm::vec3(uniform(random), uniform(random), uniform(random)), 0.0f, 0.0f, Projection::Equirectangular);
+			camera.hor_range = glm::vec2(-3.1416f, 3.1416f);
+			inputCameras.push_back(camera);
+		}
+		run("erp360", inputCameras, 1.0f, maxNrInputsUsed, nrPoses, 0);
+	}
+	return 0;
+}
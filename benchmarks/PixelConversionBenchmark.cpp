@@ -0,0 +1,105 @@
+/*
+* PixelConversionBenchmark converts random RGBA frames to every OutputPixelFormat with every set of row kernels
+* the CPU supports, checks that the output is identical to that of the scalar kernels, and reports the time per frame.
+*
+* Usage: PixelConversionBenchmark [width] [height] [nrFrames]
+* Besides the given size (default 1920x1080), a few small sizes that end in the scalar tail of every kernel are checked.
+* Returns 1 if any kernel differs from the scalar one.
+*/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <chrono>
+#include <random>
+#include <vector>
+#include "PixelConversion.h"
+
+
+static std::vector<PixelKernels> availableKernels() {
+	std::vector<PixelKernels> kernels;
+	kernels.push_back({ "scalar", rowToPlanar8_scalar, rowToPlanar16_scalar, rowsTo420_scalar });
+#ifdef PIXEL_CONVERSION_SSE2
+	kernels.push_back({ "SSE2", rowToPlanar8_sse2, rowToPlanar16_sse2, rowsTo420_sse2 });
+#endif
+#ifdef PIXEL_CONVERSION_AVX2
+	if (cpuSupportsAVX2()) {
+		kernels.push_back({ "AVX2", rowToPlanar8_avx2, rowToPlanar16_avx2, rowsTo420_avx2 });
+	}
+#endif
+#ifdef PIXEL_CONVERSION_NEON
+	kernels.push_back({ "NEON", rowToPlanar8_neon, rowToPlanar16_neon, rowsTo420_neon });
+#endif
+	return kernels;
+}
+
+static std::vector<uint8_t> randomFrame(int width, int height) {
+	std::mt19937 random(width * 7919 + height);
+	std::vector<uint8_t> rgba((size_t)width * height * 4);
+	for (uint8_t& v : rgba) {
+		v = (uint8_t)random();
+	}
+	return rgba;
+}
+
+// returns false if a kernel gives another output than the scalar one
+static bool check(const std::vector<PixelKernels>& kernels, OutputPixelFormat format, int width, int height) {
+	std::vector<uint8_t> rgba = randomFrame(width, height);
+	std::vector<uint8_t> expected(outputFrameSize(format, width, height));
+	convertRGBAToPlanar(kernels[0], format, rgba.data(), width, height, expected.data());
+	bool ok = true;
+	for (size_t k = 1; k < kernels.size(); k++) {
+		std::vector<uint8_t> out(expected.size(), 0xAB);
+		convertRGBAToPlanar(kernels[k], format, rgba.data(), width, height, out.data());
+		if (out != expected) {
+			printf("MISMATCH: %s %s %dx%d differs from scalar\n", kernels[k].name, outputPixelFormatName(format), width, height);
+			ok = false;
+		}
+	}
+	return ok;
+}
+
+int main(int argc, char* argv[]) {
+	int width = argc > 1 ? atoi(argv[1]) : 1920;
+	int height = argc > 2 ? atoi(argv[2]) : 1080;
+	int nrFrames = argc > 3 ? atoi(argv[3]) : 50;
+	const OutputPixelFormat formats[] = { OutputPixelFormat::YUV444P, OutputPixelFormat::YUV420P, OutputPixelFormat::YUV444P10LE, OutputPixelFormat::YUV444P16LE };
+	std::vector<PixelKernels> kernels = availableKernels();
+
+	bool ok = true;
+	const int sizes[][2] = { { 2, 2 }, { 30, 4 }, { 46, 6 }, { 62, 2 }, { 98, 10 }, { width, height } };
+	for (const OutputPixelFormat format : formats) {
+		for (const int* size : sizes) {
+			if (isOutputSizeSupported(format, size[0], size[1])) {
+				ok = check(kernels, format, size[0], size[1]) && ok;
+			}
+		}
+	}
+	printf("%s: all kernels give the same output as the scalar kernels\n", ok ? "OK" : "FAILED");
+
+	std::vector<uint8_t> rgba = randomFrame(width, height);
+	printf("%dx%d, ms per frame (average of %d frames), the application uses %s\n", width, height, nrFrames, getPixelKernels().name);
+	printf("%-12s", "format");
+	for (const PixelKernels& k : kernels) {
+		printf("%10s", k.name);
+	}
+	printf("\n");
+	for (const OutputPixelFormat format : formats) {
+		if (!isOutputSizeSupported(format, width, height)) {
+			continue;
+		}
+		std::vector<uint8_t> out(outputFrameSize(format, width, height));
+		printf("%-12s", outputPixelFormatName(format));
+		for (const PixelKernels& k : kernels) {
+			convertRGBAToPlanar(k, format, rgba.data(), width, height, out.data()); // warm up
+			std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+			for (int f = 0; f < nrFrames; f++) {
+				convertRGBAToPlanar(k, format, rgba.data(), width, height, out.data());
+			}
+			double ms = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count() / nrFrames;
+			printf("%10.3f", ms);
+		}
+		printf("\n");
+	}
+	return ok ? 0 : 1;
+}
@@ -0,0 +1,124 @@
+/*
+* PoolBenchmark measures how many video frames per second the Pool gets through with 2 to 32 threads,
+* with fake demuxers and decoders that take a fixed time per packet, so only the scheduling of the Pool is measured.
+*
+* The render loop does what Application does for every video frame: schedule the frame decodeAhead frames ahead
+* for every input, then wait for and "copy" the current frame of every active input.
+*
+* Usage: PoolBenchmark [nrInputs] [nrActiveInputs] [decodeMicroseconds] [nrFrames] [spin]
+*   by default the decoders sleep, like NvDecoder waiting for the GPU, add "spin" to keep a CPU core busy instead.
+*   Stream 0 is 4x slower than the others, to show that its home thread does not hold up its other streams.
+*/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <chrono>
+#include <thread>
+#include "Decoder.h"
+#include "Pool.h"
+
+
+static bool spin = false;
+
+static void work(int microseconds) {
+	if (!spin) {
+		std::this_thread::sleep_for(std::chrono::microseconds(microseconds));
+		return;
+	}
+	std::chrono::steady_clock::time_point end = std::chrono::steady_clock::now() + std::chrono::microseconds(microseconds);
+	while (std::chrono::steady_clock::now() < end) {
+	}
+}
+
+class FakeDemuxer : public Demuxer {
+public:
+	bool Demux(uint8_t** ppVideo, int* pnVideoBytes) {
+		*ppVideo = packet;
+		*pnVideoBytes = sizeof(packet);
+		packetNr++;
+		return true;
+	}
+	bool IsKeyFrame() { return true; }
+	bool IsIntraOnly() { return true; }
+	int GetNextPacketNr() { return packetNr; }
+	int GetNrFrames() { return 0; }
+	int SeekToKeyframeBefore(int frameNr) { return 0; }
+
+private:
+	uint8_t packet[16] = {};
+	int packetNr = 0;
+};
+
+class FakeDecoder : public Decoder {
+public:
+	FakeDecoder(bool isColor, int microseconds) : Decoder(isColor), microseconds(microseconds) {}
+
+	bool Decode(const uint8_t* pData, int nSize, int nFlags = 0, int64_t nTimestamp = 0) {
+		work(microseconds);
+		picture_index = (picture_index + 1) % 8;
+		return true;
+	}
+	int HandlePictureDisplay(int decoded_picture_index) { return 1; }
+	void SetTexture(GLuint texture) {}
+
+private:
+	int microseconds = 0;
+};
+
+// returns the video frames per second
+static double run(int nrThreads, int nrInputs, int nrActiveInputs, int decodeMicroseconds, int nrFrames, int decodeAhead) {
+	std::vector<Demuxer*> demuxers;
+	std::vector<Decoder*> decoders;
+	for (int s = 0; s < 2 * nrInputs; s++) {
+		demuxers.push_back(new FakeDemuxer());
+		decoders.push_back(new FakeDecoder(s % 2 == 0, s == 0 ? 4 * decodeMicroseconds : decodeMicroseconds));
+	}
+	std::unordered_set<int> active;
+	for (int i = 0; i < nrActiveInputs; i++) {
+		active.insert(i);
+	}
+
+	Pool pool;
+	pool.init(nrInputs, demuxers, decoders, nrThreads, decodeAhead);
+	pool.startThreadPool();
+	std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+	pool.startDemuxingFirstFrames(active);
+	for (int frameNr = 0; frameNr < nrFrames; frameNr++) {
+		for (int i = 0; i < nrInputs; i++) {
+			pool.startDemuxingNextFrame(i, frameNr + decodeAhead, i < nrActiveInputs ? Residency::Active : Residency::Warm);
+		}
+		for (int i = 0; i < nrActiveInputs; i++) {
+			std::tuple<int, int, int, int> tuple = pool.waitUntilInputFrameIsDecoded(i, frameNr);
+			pool.copyFromGPUToOpenGLTexture(std::get<0>(tuple), std::get<1>(tuple), std::get<2>(tuple), std::get<3>(tuple));
+		}
+	}
+	double seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+	pool.cleanup();
+	for (int s = 0; s < 2 * nrInputs; s++) {
+		delete demuxers[s];
+		delete decoders[s];
+	}
+	return nrFrames / seconds;
+}
+
+int main(int argc, char* argv[]) {
+	int nrInputs = argc > 1 ? atoi(argv[1]) : 16;
+	int nrActiveInputs = argc > 2 ? atoi(argv[2]) : nrInputs;
+	int decodeMicroseconds = argc > 3 ? atoi(argv[3]) : 500;
+	int nrFrames = argc > 4 ? atoi(argv[4]) : 200;
+	spin = argc > 5 && strcmp(argv[5], "spin") == 0;
+	const int decodeAhead = 2;
+
+	printf("%d inputs (%d active), %d us per %s decode, %d frames, decode-ahead %d\n", nrInputs, nrActiveInputs, decodeMicroseconds, spin ? "spinning" : "sleeping", nrFrames, decodeAhead);
+	printf("threads  frames/s  speedup\n");
+	double base = 0.0;
+	for (int nrThreads = 2; nrThreads <= 32; nrThreads *= 2) {
+		double fps = run(nrThreads, nrInputs, nrActiveInputs, decodeMicroseconds, nrFrames, decodeAhead);
+		if (nrThreads == 2) {
+			base = fps;
+		}
+		printf("%7d  %8.1f  %6.2fx\n", nrThreads, fps, fps / base);
+	}
+	return 0;
+}
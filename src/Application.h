@@ -22,8 +22,10 @@
 #include <algorithm>
 #include <thread>
 #include <deque>
+#ifdef HAVE_NVDEC
 #include <cuda.h>
 #include <cudaGL.h> // CUDA OpenGL interop needed for cuGraphicsGLRegisterImage
+#endif
 
 
 #if defined(POSIX)
@@ -42,12 +44,20 @@
 #define STB_IMAGE_IMPLEMENTATION
 #include "stb_image.h"
 #include "FFmpegDemuxer.h"
+#include "AvDecoder.h"
+#include "RawYuvDemuxer.h"
+#include "RawYuvDecoder.h"
 #include "shader.h"
 #include "ioHelper.h"
 #include "glHelper.h"
 #include "Pool.h"
 #include "CameraVisibilityHelper.h"
+#include "MotionPredictor.h"
+#include "TexturePool.h"
 #include "MeasureFPS.h"
+#include "HeadlessContext.h"
+#include "FrameWriter.h"
+#include "ImageLoader.h"
 
 
 class Application
@@ -56,6 +66,7 @@ public:
 	Application(Options options, FpsMonitor* fpsMonitor, std::vector<InputCamera> inputCameras, std::vector<OutputCamera> outputCameras);
 
 	virtual bool BInit();
+	bool BInitHeadless();
 	virtual bool BInitGL();
 
 	virtual void Shutdown();
@@ -69,8 +80,16 @@ public:
 	virtual void SetupCompanionWindow();
 	void SetupYUV420Textures(int texture_height, int luma_height);
 	bool SetupRGBTextures();
+#ifdef HAVE_NVDEC
 	void SetupCUgraphicsResources();
+#endif
+	bool SetupAvDecoders();
+	bool SetupRawYUVReaders();
 	bool SetupDecodingPool();
+	bool DecodeUntilStartingFrame(int i);
+	void SetupFrameCache(const std::vector<int>& nrFramesPerStream);
+	void UpdateResidency(int frameNr);
+	void BindTextures(int i, int frameNr);
 
 	bool RenderTarget(bool nextVideoFrame);
 	virtual void RenderCompanionWindow();
@@ -84,6 +103,7 @@ protected:
 // SDL bookkeeping
 	SDL_Window* m_pCompanionWindow;
 	SDL_GLContext m_pContext;
+	HeadlessContext headlessContext; // instead of the window and m_pContext if options.headless
 
 // OpenGL bookkeeping
 
@@ -118,20 +138,27 @@ protected:
 	CameraVisibilityWindow cameraVisibilityWindow;
 	Pool pool;
 	FpsMonitor* fpsMonitor;
+	FramePacer framePacer;
+	FrameWriter frameWriter; // only if options.saveOutputImages
 
-	GLuint* textures_color = NULL;
-	GLuint* textures_depth = NULL;
+	TexturePool texturePool;
 
 	// video decoding
-	std::vector<CUgraphicsResource*> glGraphicsResources;
-	std::vector<FFmpegDemuxer*> demuxers;
-	std::vector<NvDecoder*> decoders;
+	std::vector<Demuxer*> demuxers;
+	std::vector<Decoder*> decoders;
+#ifdef HAVE_NVDEC
 	CUcontext* cuContext = NULL;
+#endif
 
 	// for rendering
 	std::unordered_set<int> current_inputsToUse;
 	std::unordered_set<int> next_inputsToUse;
+	std::deque<std::unordered_set<int>> scheduled_inputsToUse; // the inputs that are decoded for rendering, for video frames currentVideoFrame until currentVideoFrame + decodeAhead
 	int currentVideoFrame = 0;
+	std::vector<Residency> residency;      // per input, for the video frame that is scheduled last
+	std::vector<int> lastUsedVideoFrame;   // per input, the last video frame that was scheduled for rendering with it
+	MotionPredictor motionPredictor;
+	std::unordered_set<int> prefetch_inputsToUse; // the inputs needed for the predicted poses of the viewer, kept warm
 	float cameraSpeed = 0.01f;
 	bool controlCameraVisibilityWindow = false;
 
@@ -151,11 +178,17 @@ Application::Application(Options options, FpsMonitor* fpsMonitor, std::vector<In
 	, inputCameras(inputCameras)
 	, outputCameras(outputCameras)
 	, cameraSpeed(options.cameraSpeed){
+#ifdef HAVE_NVDEC
 	cuContext = new CUcontext();
+#endif
 };
 
 bool Application::BInit()
 {
+	if (options.headless) {
+		return BInitHeadless();
+	}
+
 	if (SDL_Init(SDL_INIT_VIDEO | SDL_INIT_TIMER) < 0)
 	{
 		printf("%s - SDL could not initialize! SDL Error: %s\n", __FUNCTION__, SDL_GetError());
@@ -214,6 +247,44 @@ bool Application::BInit()
 	return true;
 }
 
+bool Application::BInitHeadless()
+{
+	// SDL is still used for its timer
+	if (SDL_Init(SDL_INIT_TIMER) < 0)
+	{
+		printf("%s - SDL could not initialize! SDL Error: %s\n", __FUNCTION__, SDL_GetError());
+		return false;
+	}
+
+	if (!headlessContext.create())
+	{
+		printf("%s - Headless OpenGL context could not be created!\n", __FUNCTION__);
+		return false;
+	}
+
+	glewExperimental = GL_TRUE;
+	GLenum nGlewError = glewInit();
+#ifdef GLEW_ERROR_NO_GLX_DISPLAY
+	// GLEW >= 2.0 loads the GLX extensions as well, which fails without an X display, after loading the OpenGL functions
+	if (nGlewError == GLEW_ERROR_NO_GLX_DISPLAY) {
+		nGlewError = GLEW_OK;
+	}
+#endif
+	if (nGlewError != GLEW_OK)
+	{
+		printf("%s - Error initializing GLEW! %s\n", __FUNCTION__, glewGetErrorString(nGlewError));
+		return false;
+	}
+	glGetError(); // to clear the error caused deep in GLEW
+
+	if (!BInitGL())
+	{
+		printf("%s - Unable to initialize OpenGL!\n", __FUNCTION__);
+		return false;
+	}
+	return true;
+}
+
 bool Application::BInitGL()
 {
 	// the chroma data is stored "chroma_offset" rows below the luma data
@@ -234,9 +305,28 @@ bool Application::BInitGL()
 	else {
 		SetupYUV420Textures(texture_height, luma_height);
 	}
-	SetupCompanionWindow();
+	if (!options.headless) {
+		SetupCompanionWindow();
+	}
+	if (options.saveOutputImages) {
+		frameWriter.init(options.SCR_WIDTH, options.SCR_HEIGHT, options.outputPixelFormat, options.outputCodec, options.outputCrf, options.outputContainer, options.outputFps);
+	}
 	if (!options.usePNGs) {
-		SetupCUgraphicsResources();
+		if (options.useRawYUV) {
+			if (!SetupRawYUVReaders()) {
+				return false;
+			}
+		}
+		else if (options.cpuDecodeThreads > 0) {
+			if (!SetupAvDecoders()) {
+				return false;
+			}
+		}
+#ifdef HAVE_NVDEC
+		else {
+			SetupCUgraphicsResources();
+		}
+#endif
 		if (!SetupDecodingPool()) {
 			return false;
 		}
@@ -256,18 +346,27 @@ void Application::Shutdown()
 		}
 	}
 
+	frameWriter.close();
+
 	if (!options.isStatic) {
 		pool.cleanup();
+		if (pool.stats.isEnabled()) {
+			// next to the --fps_csv file, e.g. fps.csv -> fps_pool.csv
+			std::string path = options.fpsCsvPath;
+			size_t extension = path.rfind(".csv");
+			if (extension != std::string::npos && extension == path.size() - 4) {
+				path = path.substr(0, extension);
+			}
+			pool.stats.WriteToCSVFile(path + "_pool.csv");
+		}
 	}
 
 	framebuffers.cleanup();
 
 	if (!options.usePNGs) {
-		for (auto& glGraphicsResource : glGraphicsResources) {
-			ck(cuGraphicsUnregisterResource(*glGraphicsResource));
-			delete glGraphicsResource;
-		}
-		glGraphicsResources.clear();
+#ifdef HAVE_NVDEC
+		texturePool.unregisterFromCuda();
+#endif
 		for (auto& demuxer : demuxers) {
 			delete demuxer;
 		}
@@ -277,21 +376,18 @@ void Application::Shutdown()
 		}
 		decoders.clear();
 
+#ifdef HAVE_NVDEC
 		// do this after decoders are cleared
 		if (cuContext) {
-			ck(cuCtxDestroy(*cuContext));
+			if (options.cpuDecodeThreads == 0 && !options.useRawYUV) {
+				ck(cuCtxDestroy(*cuContext));
+			}
 			delete cuContext;
 		}
+#endif
 	}
 
-	if (textures_color != NULL) {
-		glDeleteTextures((GLsizei)inputCameras.size(), textures_color);
-		delete[] textures_color;
-	}
-	if (textures_depth != NULL) {
-		glDeleteTextures((GLsizei)inputCameras.size(), textures_depth);
-		delete[] textures_depth;
-	}
+	texturePool.cleanup();
 
 
 	if (m_pCompanionWindow)
@@ -299,6 +395,7 @@ void Application::Shutdown()
 		SDL_DestroyWindow(m_pCompanionWindow);
 		m_pCompanionWindow = NULL;
 	}
+	headlessContext.destroy();
 
 	SDL_Quit();
 }
@@ -327,9 +424,9 @@ void Application::RunMainLoop()
 
 			// update the video frame (goal = 30Hz)
 			RenderFrame(true);
-			bQuit = bQuit | HandleUserInput();
+			bQuit = bQuit | HandleUserInput() | pool.hasFailed();
 
-			SpinUntilTargetTime(startTime, ms_per_frame);
+			framePacer.WaitUntilTargetTime(startTime, ms_per_frame);
 			Uint64 endTime = SDL_GetPerformanceCounter();
 			float passedTimeMs = (endTime - startTime) / (float)SDL_GetPerformanceFrequency() * 1000.0f;
 			fpsMonitor->AddTime(passedTimeMs, frame);
@@ -339,8 +436,8 @@ void Application::RunMainLoop()
 			for (int i = 0; i < options.targetFps / 30 - 1; i++) {
 				Uint64 currentTime = SDL_GetPerformanceCounter();
 				RenderFrame(false);
-				bQuit = bQuit | HandleUserInput();
-				SpinUntilTargetTime(currentTime, ms_per_frame);
+				bQuit = bQuit | HandleUserInput() | pool.hasFailed();
+				framePacer.WaitUntilTargetTime(currentTime, ms_per_frame);
 
 				endTime = SDL_GetPerformanceCounter();
 				passedTimeMs = (endTime - startTime) / (float)SDL_GetPerformanceFrequency() * 1000.0f;
@@ -349,13 +446,17 @@ void Application::RunMainLoop()
 			}
 			frame++;
 		}
+		framePacer.PrintSummary();
 	}
 	else if (options.saveOutputImages) {
-		for (int frame = 0; frame < options.outputNrFrames; frame++) {
+		for (int frame = 0; frame < options.outputNrFrames && !pool.hasFailed(); frame++) {
 			for (int i = 0; i < outputCameras.size(); i++) {
 				pcOutputCamera = outputCameras[i];
 
 				cameraVisibilityHelper.init(inputCameras, &pcOutputCamera, options.maxNrInputsUsed);
+				if (options.coverageSamples > 0) {
+					cameraVisibilityHelper.useCoverage(options.coverageSamples, options.coverageBudgetMs);
+				}
 				current_inputsToUse = cameraVisibilityHelper.updateInputsToUse();
 				for (auto& c : current_inputsToUse) {
 					next_inputsToUse.insert(c); // deep copy
@@ -370,7 +471,7 @@ void Application::RunMainLoop()
 		Uint64 startTime = SDL_GetPerformanceCounter();
 		while (!bQuit) {
 			RenderFrame(true);
-			bQuit = bQuit | HandleUserInput();
+			bQuit = bQuit | HandleUserInput() | pool.hasFailed();
 
 			Uint64 endTime = SDL_GetPerformanceCounter();
 			float passedTimeMs = (endTime - startTime) / (float)SDL_GetPerformanceFrequency() * 1000.0f;
@@ -385,10 +486,15 @@ void Application::RunMainLoop()
 
 bool Application::RenderFrame(bool nextVideoFrame, std::string outputCameraName, int frameNr)
 {
+	TraceSpan span("RenderFrame");
 	RenderTarget(nextVideoFrame);
 	if (outputCameraName != "") {
 		SaveCompanionWindowToYUV(frameNr, outputCameraName);
 	}
+	if (options.headless) {
+		// nothing to show, the output was read back from the framebuffer
+		return true;
+	}
 	
 	RenderCompanionWindow();
 
@@ -418,6 +524,13 @@ void Application::SetupCameras()
 	pcOutputCamera = options.viewport;
 
 	cameraVisibilityHelper.init(inputCameras, &pcOutputCamera, options.maxNrInputsUsed);
+	if (options.coverageSamples > 0) {
+		cameraVisibilityHelper.useCoverage(options.coverageSamples, options.coverageBudgetMs);
+	}
+	if (options.selectionGridResolution > 0) {
+		cameraVisibilityHelper.useSelectionGrid(options.inputJsonPath, options.selectionGridResolution);
+	}
+	cameraVisibilityHelper.setTemporalCoherence(options.selectionHysteresis, options.maxInputSwitches, options.minInputDwell);
 	current_inputsToUse = cameraVisibilityHelper.updateInputsToUse();
 	for (auto& c : current_inputsToUse) {
 		next_inputsToUse.insert(c); // deep copy
@@ -479,14 +592,20 @@ void Application::SetupCompanionWindow()
 }
 
 void Application::SetupYUV420Textures(int texture_height, int luma_height) {
-	textures_color = new GLuint[inputCameras.size()];
-	textures_depth = new GLuint[inputCameras.size()];
-	glGenTextures((GLsizei)inputCameras.size(), textures_color);
-	glGenTextures((GLsizei)inputCameras.size(), textures_depth);
-	for (int i = 0; i < inputCameras.size(); i++) {
-		// technically only need #threads * 2 textures
-		// but for now, use 2 textures per input
-		glBindTexture(GL_TEXTURE_2D, textures_color[i]);
+	// all slots need the same texture formats, since each can hold the frame of any input
+	bool sameBitDepths = true;
+	for (int i = 1; i < inputCameras.size(); i++) {
+		sameBitDepths = sameBitDepths && inputCameras[i].bitdepth_color == inputCameras[0].bitdepth_color && inputCameras[i].bitdepth_depth == inputCameras[0].bitdepth_depth;
+	}
+	// --max_nr_inputs defaults to -1, meaning every input can be used at the same time
+	int maxNrInputsUsed = options.maxNrInputsUsed < 1 ? (int)inputCameras.size() : options.maxNrInputsUsed;
+	bool pooled = !options.isStatic && sameBitDepths && maxNrInputsUsed < (int)inputCameras.size();
+	int nrSlots = pooled ? maxNrInputsUsed : (int)inputCameras.size();
+	texturePool.init((int)inputCameras.size());
+	for (int i = 0; i < nrSlots; i++) {
+		GLuint textures[2];
+		glGenTextures(2, textures);
+		glBindTexture(GL_TEXTURE_2D, textures[0]);
 		glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
 		glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
 		glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_NEAREST);
@@ -498,7 +617,7 @@ void Application::SetupYUV420Textures(int texture_height, int luma_height) {
 			glTexImage2D(GL_TEXTURE_2D, 0, GL_R8, inputCameras[0].res_x, texture_height, 0, GL_RED, GL_UNSIGNED_BYTE, 0);
 		}
 
-		glBindTexture(GL_TEXTURE_2D, textures_depth[i]);
+		glBindTexture(GL_TEXTURE_2D, textures[1]);
 		glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
 		glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
 		glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_NEAREST);
@@ -509,70 +628,52 @@ void Application::SetupYUV420Textures(int texture_height, int luma_height) {
 		else {
 			glTexImage2D(GL_TEXTURE_2D, 0, GL_R8, inputCameras[0].res_x, luma_height, 0, GL_RED, GL_UNSIGNED_BYTE, 0);
 		}
+		texturePool.addSlot(textures[0], textures[1]);
+		if (!pooled) {
+			texturePool.bind(i, i);
+		}
+	}
+	if (pooled) {
+		std::cout << "Using " << nrSlots << " pairs of textures for " << inputCameras.size() << " inputs" << std::endl;
 	}
 }
 
 bool Application::SetupRGBTextures() {
-	textures_color = new GLuint[inputCameras.size()];
-	textures_depth = new GLuint[inputCameras.size()];
-	glGenTextures((GLsizei)inputCameras.size(), textures_color);
-	glGenTextures((GLsizei)inputCameras.size(), textures_depth);
+	texturePool.init((int)inputCameras.size());
 
-	int width, height, nrChannels;
+	// the PNGs are decoded in parallel and uploaded in the order in which they finish
+	ImageLoader loader;
+	std::vector<GLuint> textures(2 * inputCameras.size());
+	glGenTextures((GLsizei)textures.size(), textures.data());
 	for (int i = 0; i < inputCameras.size(); i++) {
-		// technically only need #threads * 2 textures
-		// but for now, use 2 textures per input
-		glBindTexture(GL_TEXTURE_2D, textures_color[i]);
-		glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
-		glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
-		glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_NEAREST);
-		glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_NEAREST);
-		if (inputCameras[i].bitdepth_color > 8) {
-			unsigned short* data = stbi_load_16(inputCameras[i].pathColor.c_str(), &width, &height, &nrChannels, STBI_rgb);
-			if (!data) {
-				std::cout << "Error: failed to load texture " << inputCameras[i].pathColor << std::endl;
-				return false;
-			}
-			glTexImage2D(GL_TEXTURE_2D, 0, GL_RGB16, inputCameras[0].res_x, inputCameras[0].res_y, 0, GL_RGB, GL_UNSIGNED_SHORT, data);
-			stbi_image_free(data);
-		}
-		else {
-			unsigned char* data = stbi_load(inputCameras[i].pathColor.c_str(), &width, &height, &nrChannels, STBI_rgb);
-			if (!data) {
-				std::cout << "Error: failed to load texture " << inputCameras[i].pathColor << std::endl;
-				return false;
-			}
-			glTexImage2D(GL_TEXTURE_2D, 0, GL_RGB8, inputCameras[0].res_x, inputCameras[0].res_y, 0, GL_RGB, GL_UNSIGNED_BYTE, data);
-			stbi_image_free(data);
-		}
+		texturePool.bind(i, texturePool.addSlot(textures[2 * i], textures[2 * i + 1]));
+		loader.add(inputCameras[i].pathColor, STBI_rgb, inputCameras[i].bitdepth_color > 8);  // image 2 * i
+		loader.add(inputCameras[i].pathDepth, STBI_grey, inputCameras[i].bitdepth_depth > 8); // image 2 * i + 1
+	}
+	loader.start(options.nrStartupThreads);
 
-		glBindTexture(GL_TEXTURE_2D, textures_depth[i]);
+	for (int index = loader.next(); index >= 0; index = loader.next()) {
+		const ImageLoader::Image& image = loader.get(index);
+		if (!image.data) {
+			std::cout << "Error: failed to load texture " << image.path << std::endl;
+			return false;
+		}
+		glBindTexture(GL_TEXTURE_2D, textures[index]);
 		glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
 		glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
 		glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_NEAREST);
 		glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_NEAREST);
-		if (inputCameras[i].bitdepth_depth > 8) {
-			unsigned short* data = stbi_load_16(inputCameras[i].pathDepth.c_str(), &width, &height, &nrChannels, STBI_grey);
-			if (!data) {
-				std::cout << "Failed to load texture " << inputCameras[i].pathDepth << std::endl;
-				return false;
-			}
-			glTexImage2D(GL_TEXTURE_2D, 0, GL_R16, inputCameras[0].res_x, inputCameras[0].res_y, 0, GL_RED, GL_UNSIGNED_SHORT, data);
-			stbi_image_free(data);
-		}
-		else {
-			unsigned char* data = stbi_load(inputCameras[i].pathDepth.c_str(), &width, &height, &nrChannels, STBI_grey);
-			if (!data) {
-				std::cout << "Error: failed to load texture " << inputCameras[i].pathDepth << std::endl;
-				return false;
-			}
-			glTexImage2D(GL_TEXTURE_2D, 0, GL_R8, inputCameras[0].res_x, inputCameras[0].res_y, 0, GL_RED, GL_UNSIGNED_BYTE, data);
-			stbi_image_free(data);
-		}
+		bool isColor = index % 2 == 0;
+		GLint internalFormat = isColor ? (image.is16Bit ? GL_RGB16 : GL_RGB8) : (image.is16Bit ? GL_R16 : GL_R8);
+		glTexImage2D(GL_TEXTURE_2D, 0, internalFormat, inputCameras[0].res_x, inputCameras[0].res_y, 0, isColor ? GL_RGB : GL_RED,
+			image.is16Bit ? GL_UNSIGNED_SHORT : GL_UNSIGNED_BYTE, image.data);
+		loader.release(index);
 	}
+	loader.printTimings();
 	return true;
 }
 
+#ifdef HAVE_NVDEC
 void Application::SetupCUgraphicsResources() {
 	ck(cuInit(0));
 
@@ -584,71 +685,230 @@ void Application::SetupCUgraphicsResources() {
 	ck(cuCtxCreate(cuContext, 0, cuDevice));
 
 	ck(cuCtxSetCurrent(*cuContext));
+	// register OpenGL textures for Cuda interop
+	texturePool.registerWithCuda();
 	for (int i = 0; i < inputCameras.size(); i++) {
-		// register OpenGL textures for Cuda interop
-		CUgraphicsResource* glGraphicsResource_color = new CUgraphicsResource();
-		CUgraphicsResource* glGraphicsResource_depth = new CUgraphicsResource();
-		ck(cuGraphicsGLRegisterImage(glGraphicsResource_color, textures_color[i], GL_TEXTURE_2D, CU_GRAPHICS_REGISTER_FLAGS_WRITE_DISCARD));
-		ck(cuGraphicsGLRegisterImage(glGraphicsResource_depth, textures_depth[i], GL_TEXTURE_2D, CU_GRAPHICS_REGISTER_FLAGS_WRITE_DISCARD));
-		ck(cuGraphicsResourceSetMapFlags(*glGraphicsResource_color, CU_GRAPHICS_MAP_RESOURCE_FLAGS_WRITE_DISCARD));
-		ck(cuGraphicsResourceSetMapFlags(*glGraphicsResource_depth, CU_GRAPHICS_MAP_RESOURCE_FLAGS_WRITE_DISCARD));
-		glGraphicsResources.push_back(glGraphicsResource_color);
-		glGraphicsResources.push_back(glGraphicsResource_depth);
+		// if the textures are pooled, the decoders get their textures right before copying a frame
+		const TexturePool::Slot* slot = texturePool.find(i);
 
 		// initialize the LibAV demuxers
-		FFmpegDemuxer* demuxer_color = new FFmpegDemuxer(inputCameras[i].pathColor.c_str(), i == 0);
-		FFmpegDemuxer* demuxer_depth = new FFmpegDemuxer(inputCameras[i].pathDepth.c_str());
+		FFmpegDemuxer* demuxer_color = new FFmpegDemuxer(inputCameras[i].pathColor.c_str(), i == 0, options.useSidecarIndex);
+		FFmpegDemuxer* demuxer_depth = new FFmpegDemuxer(inputCameras[i].pathDepth.c_str(), false, options.useSidecarIndex);
 		demuxers.push_back(demuxer_color);
 		demuxers.push_back(demuxer_depth);
 
 		// initalize the Cuda Decoders
-		NvDecoder* decoder_color = new NvDecoder(cuContext, glGraphicsResource_color, true, FFmpeg2NvCodecId(demuxer_color->GetVideoCodec()), i == 0);
-		NvDecoder* decoder_depth = new NvDecoder(cuContext, glGraphicsResource_depth, false, FFmpeg2NvCodecId(demuxer_depth->GetVideoCodec()));
+		NvDecoder* decoder_color = new NvDecoder(cuContext, slot ? slot->colorResource : NULL, true, FFmpeg2NvCodecId(demuxer_color->GetVideoCodec()), options.decodeAhead, i == 0);
+		NvDecoder* decoder_depth = new NvDecoder(cuContext, slot ? slot->depthResource : NULL, false, FFmpeg2NvCodecId(demuxer_depth->GetVideoCodec()), options.decodeAhead);
 		decoders.push_back(decoder_color);
 		decoders.push_back(decoder_depth);
 	}
 	ck(cuCtxPopCurrent(NULL));
 }
+#endif
+
+bool Application::SetupAvDecoders() {
+	std::cout << "Decoding the videos on the CPU with libavcodec" << std::endl;
+	int luma_height = inputCameras[0].res_y;
+	for (int i = 0; i < inputCameras.size(); i++) {
+		// initialize the LibAV demuxers
+		FFmpegDemuxer* demuxer_color = new FFmpegDemuxer(inputCameras[i].pathColor.c_str(), i == 0, options.useSidecarIndex);
+		FFmpegDemuxer* demuxer_depth = new FFmpegDemuxer(inputCameras[i].pathDepth.c_str(), false, options.useSidecarIndex);
+		demuxers.push_back(demuxer_color);
+		demuxers.push_back(demuxer_depth);
+
+		const TexturePool::Slot* slot = texturePool.find(i);
+		// initalize the LibAV decoders, which write to the OpenGL textures directly
+		AvDecoder* decoder_color = new AvDecoder(slot ? slot->color : 0, inputCameras[0].res_x, luma_height, inputCameras[i].bitdepth_color, true, demuxer_color->GetVideoCodec(), options.cpuDecodeThreads, options.decodeAhead, i == 0);
+		AvDecoder* decoder_depth = new AvDecoder(slot ? slot->depth : 0, inputCameras[0].res_x, luma_height, inputCameras[i].bitdepth_depth, false, demuxer_depth->GetVideoCodec(), options.cpuDecodeThreads, options.decodeAhead);
+		decoders.push_back(decoder_color);
+		decoders.push_back(decoder_depth);
+		if (!decoder_color->IsOpen() || !decoder_depth->IsOpen()) {
+			return false;
+		}
+	}
+	return true;
+}
+
+bool Application::SetupRawYUVReaders() {
+	std::cout << "Reading raw YUV files, without decoding" << std::endl;
+	int luma_height = inputCameras[0].res_y;
+	for (int i = 0; i < inputCameras.size(); i++) {
+		// the files are memory-mapped, the demuxers return pointers to the frames in the mapping
+		RawYuvDemuxer* demuxer_color = new RawYuvDemuxer(inputCameras[i].pathColor.c_str(), inputCameras[0].res_x, luma_height, inputCameras[i].bitdepth_color, options.decodeAhead + 1, i == 0);
+		RawYuvDemuxer* demuxer_depth = new RawYuvDemuxer(inputCameras[i].pathDepth.c_str(), inputCameras[0].res_x, luma_height, inputCameras[i].bitdepth_depth, options.decodeAhead + 1);
+		demuxers.push_back(demuxer_color);
+		demuxers.push_back(demuxer_depth);
+		if (!demuxer_color->IsOpen() || !demuxer_depth->IsOpen()) {
+			return false;
+		}
+
+		const TexturePool::Slot* slot = texturePool.find(i);
+		RawYuvDecoder* decoder_color = new RawYuvDecoder(slot ? slot->color : 0, inputCameras[0].res_x, luma_height, inputCameras[i].bitdepth_color, true, options.decodeAhead);
+		RawYuvDecoder* decoder_depth = new RawYuvDecoder(slot ? slot->depth : 0, inputCameras[0].res_x, luma_height, inputCameras[i].bitdepth_depth, false, options.decodeAhead);
+		decoders.push_back(decoder_color);
+		decoders.push_back(decoder_depth);
+	}
+	return true;
+}
 
 bool Application::SetupDecodingPool() {
 
 	if (options.StartingFrameNr > 0) {
-		std::cout << "Decoding all frames up until frame " << options.StartingFrameNr << "..." << std::endl;
-	}
-	// decode until frame 'StartingFrameNr' of all input videos here
-	for (int i = 0; i < demuxers.size(); i++) {
-		for (int j = 0; j < options.StartingFrameNr + 2; j++) { // dev note: for some reason, demuxing and decoding needs to happen twice to get the first frame
-			int nVideoBytes = 0;
-			uint8_t* pVideo = NULL;
-			if (!demuxers[i]->Demux(&pVideo, &nVideoBytes)) {
-				std::cout << "Error: demuxing failed for input " << i / 2 << (i % 2 == 0 ? " color" : " depth") << std::endl;
-				return false;
+		std::cout << "Decoding from the keyframes before frame " << options.StartingFrameNr << " up until frame " << options.StartingFrameNr << "..." << std::endl;
+	}
+	// decode until frame 'StartingFrameNr' of all input videos here, in parallel over the videos
+	std::atomic<int> nextStream(0);
+	std::atomic<bool> warmUpOK(true);
+	std::vector<int> nrFramesPerStream(demuxers.size(), 0);
+	int nrWarmUpThreads = (std::min)(options.nrStartupThreads, (int)demuxers.size());
+	std::vector<std::thread> warmUpThreads;
+	for (int t = 0; t < nrWarmUpThreads; t++) {
+		warmUpThreads.push_back(std::thread([this, &nextStream, &warmUpOK, &nrFramesPerStream]() {
+			for (int i = nextStream++; i < demuxers.size() && warmUpOK; i = nextStream++) {
+				if (options.frameCacheMB > 0 && !options.isStatic) {
+					// before demuxing, since this may need to scan the whole video
+					nrFramesPerStream[i] = demuxers[i]->GetNrFrames();
+				}
+				if (!DecodeUntilStartingFrame(i)) {
+					warmUpOK = false;
+				}
 			}
-			decoders[i]->Decode(pVideo, nVideoBytes);
+		}));
+	}
+	for (std::thread& thread : warmUpThreads) {
+		thread.join();
+	}
+	if (!warmUpOK) {
+		return false;
+	}
+	for (int i = 0; i < inputCameras.size(); i++) {
+		// memcopy decoded image to CUGragpicsResources, on this thread since it owns the OpenGL context
+		// with pooled textures, only the inputs that are rendered first get textures
+		if (texturePool.find(i) || current_inputsToUse.find(i) != current_inputsToUse.end()) {
+			BindTextures(i, -1);
+			decoders[2 * i]->HandlePictureDisplay(decoders[2 * i]->picture_index);
+			decoders[2 * i + 1]->HandlePictureDisplay(decoders[2 * i + 1]->picture_index);
 		}
-		// memcopy decoded image to CUGragpicsResources
-		decoders[i]->HandlePictureDisplay(decoders[i]->picture_index);
 	}
 
 	if (!options.isStatic) {
 		// setup thread pool to parallelize the decoding work
-		pool.init((int)inputCameras.size(), demuxers, decoders, options.nrThreads);
+		pool.init((int)inputCameras.size(), demuxers, decoders, options.nrThreads, options.decodeAhead);
+		if (options.useFpsMonitor) {
+			pool.enableStats();
+		}
+		if (options.frameCacheMB > 0) {
+			SetupFrameCache(nrFramesPerStream);
+		}
 		pool.startThreadPool();
+		scheduled_inputsToUse = std::deque<std::unordered_set<int>>(options.decodeAhead, current_inputsToUse);
+		residency = std::vector<Residency>(inputCameras.size(), Residency::Warm);
+		lastUsedVideoFrame = std::vector<int>(inputCameras.size(), 0);
 		pool.startDemuxingFirstFrames(current_inputsToUse);
 	}
 		
 	return true;
 }
 
+void Application::SetupFrameCache(const std::vector<int>& nrFramesPerStream) {
+	// cache the color and depth video of the inputs with the shortest videos first, as long as they fit in the budget
+	std::vector<int> inputs;
+	for (int i = 0; i < inputCameras.size(); i++) {
+		if (nrFramesPerStream[2 * i] > 0 && nrFramesPerStream[2 * i + 1] > 0) {
+			inputs.push_back(i);
+		}
+	}
+	std::sort(inputs.begin(), inputs.end(), [&nrFramesPerStream](int a, int b) {
+		return nrFramesPerStream[2 * a] + nrFramesPerStream[2 * a + 1] < nrFramesPerStream[2 * b] + nrFramesPerStream[2 * b + 1];
+	});
+	size_t budget = (size_t)options.frameCacheMB * 1024 * 1024;
+	int nrCachedInputs = 0;
+	for (int i : inputs) {
+		size_t size = 0;
+		for (int s = 2 * i; s <= 2 * i + 1; s++) {
+			size += nrFramesPerStream[s] * decoders[s]->GetCachedFrameSize();
+		}
+		if (size > budget) {
+			break;
+		}
+		int nrCachedStreams = 0;
+		for (int s = 2 * i; s <= 2 * i + 1; s++) {
+			if (decoders[s]->GetCachedFrameSize() > 0 && decoders[s]->EnableFrameCache(nrFramesPerStream[s])) {
+				pool.enableFrameCache(s, nrFramesPerStream[s]);
+				budget -= nrFramesPerStream[s] * decoders[s]->GetCachedFrameSize();
+				nrCachedStreams++;
+			}
+		}
+		if (nrCachedStreams == 0) {
+			// out of memory
+			break;
+		}
+		nrCachedInputs++;
+	}
+	std::cout << "Frame cache: caching the decoded frames of " << nrCachedInputs << " of " << inputCameras.size() << " inputs" << std::endl;
+}
+
+void Application::UpdateResidency(int frameNr) {
+	// the inputs used for frameNr are active, of the others the predicted ones and the most recently used ones stay warm (up to options.warmInputs)
+	std::vector<int> unusedInputs;
+	for (int i = 0; i < inputCameras.size(); i++) {
+		if (next_inputsToUse.find(i) != next_inputsToUse.end()) {
+			residency[i] = Residency::Active;
+			lastUsedVideoFrame[i] = frameNr;
+		}
+		else {
+			unusedInputs.push_back(i);
+		}
+	}
+	std::sort(unusedInputs.begin(), unusedInputs.end(), [this](int a, int b) {
+		return lastUsedVideoFrame[a] > lastUsedVideoFrame[b];
+	});
+	for (int k = 0; k < unusedInputs.size(); k++) {
+		int i = unusedInputs[k];
+		// an input that was used less than decodeAhead frames ago may still have frames waiting to be copied, keep it warm
+		bool usedRecently = frameNr - lastUsedVideoFrame[i] <= options.decodeAhead;
+		bool predicted = prefetch_inputsToUse.find(i) != prefetch_inputsToUse.end();
+		residency[i] = options.warmInputs < 0 || k < options.warmInputs || usedRecently || predicted ? Residency::Warm : Residency::Cold;
+	}
+}
+
+bool Application::DecodeUntilStartingFrame(int i) {
+	// start at the keyframe before 'StartingFrameNr', so only the rest of its GOP needs to be decoded
+	int nrFramesAfterKeyframe = options.StartingFrameNr > 0 ? demuxers[i]->SeekToKeyframeBefore(options.StartingFrameNr) : 0;
+	if (nrFramesAfterKeyframe < 0) {
+		std::cout << "Error: seeking failed for input " << i / 2 << (i % 2 == 0 ? " color" : " depth") << std::endl;
+		return false;
+	}
+	// the decoder holds back OutputDelay() packets, which is only known once its first picture came out
+	for (int j = 0; j <= nrFramesAfterKeyframe + decoders[i]->OutputDelay(); j++) {
+		int nVideoBytes = 0;
+		uint8_t* pVideo = NULL;
+		if (!demuxers[i]->Demux(&pVideo, &nVideoBytes)) {
+			std::cout << "Error: demuxing failed for input " << i / 2 << (i % 2 == 0 ? " color" : " depth") << std::endl;
+			return false;
+		}
+		if (!decoders[i]->Decode(pVideo, nVideoBytes, 0, demuxers[i]->GetNextPacketNr() - 1)) {
+			std::cout << "Error: decoding failed for input " << i / 2 << (i % 2 == 0 ? " color" : " depth") << std::endl;
+			return false;
+		}
+	}
+	return true;
+}
+
 bool Application::RenderTarget(bool nextVideoFrame)
 {
+	TraceSpan span("RenderTarget");
 	glEnable(GL_DEPTH_TEST);
 	glViewport(0, 0, m_nRenderWidth, m_nRenderHeight);
 
 	bool shouldUpdateUsedInputs = false;
 	if (nextVideoFrame) {
 		// recalculate which inputCameras need to be used for rendering the outputCamera
-		next_inputsToUse = cameraVisibilityHelper.updateInputsToUse();
+		{
+			TraceSpan span("updateInputsToUse");
+			next_inputsToUse = cameraVisibilityHelper.updateInputsToUse();
+		}
 		for (auto& a : next_inputsToUse) {
 			if (current_inputsToUse.find(a) == current_inputsToUse.end()) {
 				shouldUpdateUsedInputs = true;
@@ -657,26 +917,46 @@ bool Application::RenderTarget(bool nextVideoFrame)
 		}
 	}
 
+	bool decodeNextVideoFrame = (!options.isStatic) && nextVideoFrame;
+	if (decodeNextVideoFrame) {
+		// the inputs chosen now are decoded decodeAhead video frames ahead
+		scheduled_inputsToUse.push_back(next_inputsToUse);
+		if (options.prefetchFrames > 0) {
+			// the inputs of the poses halfway and at the end of the prediction horizon
+			motionPredictor.addPose(pcOutputCamera.model);
+			prefetch_inputsToUse = cameraVisibilityHelper.inputsToUseFor(motionPredictor.predict(options.prefetchFrames));
+			if (options.prefetchFrames > 1) {
+				for (int i : cameraVisibilityHelper.inputsToUseFor(motionPredictor.predict((options.prefetchFrames + 1) / 2))) {
+					prefetch_inputsToUse.insert(i);
+				}
+			}
+		}
+		UpdateResidency(currentVideoFrame + options.decodeAhead);
+	}
+
 	bool isFirstInput = true;
 	shaders.updateOutputParams(pcOutputCamera);
 	shaders.shader.setFloat("isFirstInput", 1.0f);
 	for (int i = 0; i < inputCameras.size(); i++) {
 
-		if ((!options.isStatic) && nextVideoFrame) {
-			bool useForRenderingNextFrame = next_inputsToUse.find(i) != next_inputsToUse.end();
-			pool.startDemuxingNextFrame(i, currentVideoFrame + 1, useForRenderingNextFrame);
+		if (decodeNextVideoFrame) {
+			pool.startDemuxingNextFrame(i, currentVideoFrame + options.decodeAhead, residency[i]);
+
+			// copy all frames that were decoded for the current video frame, so the decoders can continue
+			bool isDecodedForCurrentFrame = scheduled_inputsToUse.front().find(i) != scheduled_inputsToUse.front().end();
+			if (isDecodedForCurrentFrame) {
+				std::tuple<int, int, int, int> tuple = pool.waitUntilInputFrameIsDecoded(i, currentVideoFrame);
+				BindTextures(i, currentVideoFrame);
+				pool.copyFromGPUToOpenGLTexture(std::get<0>(tuple), std::get<1>(tuple), std::get<2>(tuple), std::get<3>(tuple));
+			}
 		}
-		bool useForRenderingCurrentFrame = current_inputsToUse.find(i) != current_inputsToUse.end();
+		// inputs without textures (pooled, and not decoded since) cannot be rendered
+		bool useForRenderingCurrentFrame = current_inputsToUse.find(i) != current_inputsToUse.end() && texturePool.find(i);
 
 		if (useForRenderingCurrentFrame) {
 
 			shaders.updateInputParams(inputCameras[i]);
 
-			if ((!options.isStatic) && nextVideoFrame) {
-				std::tuple<int, int, int, int> tuple = pool.waitUntilInputFrameIsDecoded(i);
-				pool.copyFromGPUToOpenGLTexture(std::get<0>(tuple), std::get<1>(tuple), std::get<2>(tuple), std::get<3>(tuple));
-			}
-
 			RenderScene(i, isFirstInput);
 
 			// prepare next iteration
@@ -691,7 +971,12 @@ bool Application::RenderTarget(bool nextVideoFrame)
 		currentVideoFrame++; // important for Pool
 	}
 
-	if (shouldUpdateUsedInputs) {
+	if (decodeNextVideoFrame) {
+		// render the next video frame with the inputs that were decoded for it
+		scheduled_inputsToUse.pop_front();
+		current_inputsToUse = scheduled_inputsToUse.front();
+	}
+	else if (shouldUpdateUsedInputs) {
 		current_inputsToUse.clear();
 		for (auto& c : next_inputsToUse) {
 			current_inputsToUse.insert(c); // deep copy
@@ -701,11 +986,27 @@ bool Application::RenderTarget(bool nextVideoFrame)
 	return true;
 }
 
+void Application::BindTextures(int i, int frameNr) {
+	TexturePool::Slot& slot = texturePool.acquire(i, frameNr);
+#ifdef HAVE_NVDEC
+	if (slot.colorResource) {
+		// the textures are registered with CUDA, so the decoders are NvDecoders
+		static_cast<NvDecoder*>(decoders[2 * i])->SetGraphicsResource(slot.colorResource);
+		static_cast<NvDecoder*>(decoders[2 * i + 1])->SetGraphicsResource(slot.depthResource);
+		return;
+	}
+#endif
+	decoders[2 * i]->SetTexture(slot.color);
+	decoders[2 * i + 1]->SetTexture(slot.depth);
+}
+
 void Application::RenderScene(int i, bool isFirstInput)
 {
+	TraceSpan span("RenderScene", "input", i);
+	const TexturePool::Slot* slot = texturePool.find(i);
 	if (isFirstInput) {
 		// simple 3D warping
-		framebuffers.renderTheFirstInputImage(0, textures_color[i], textures_depth[i]);
+		framebuffers.renderTheFirstInputImage(0, slot->color, slot->depth);
 	}
 	else {
 		// copying between FBOs is necessary to prepare the blending
@@ -714,7 +1015,7 @@ void Application::RenderScene(int i, bool isFirstInput)
 
 		// simple 3D warping + blending with the previous output image
 		shaders.shader.use();
-		framebuffers.renderNonFirstInputImage(0, textures_color[i], textures_depth[i]);
+		framebuffers.renderNonFirstInputImage(0, slot->color, slot->depth);
 	}
 
 }
@@ -758,16 +1059,17 @@ void Application::RenderCompanionWindow()
 }
 
 void Application::SaveCompanionWindowToYUV(int frameNr, std::string outputCameraName, bool saveAsPNG) {
-	unsigned char* image = new unsigned char[options.SCR_WIDTH * options.SCR_HEIGHT * 4];
+	TraceSpan span("SaveCompanionWindowToYUV");
+	// the conversion and writing to disk happen on the threads of the FrameWriter, while the next frame is rendered
+	unsigned char* image = frameWriter.acquireBuffer();
 	framebuffers.bindCurrentBuffer();
 	glReadPixels(0, 0, options.SCR_WIDTH, options.SCR_HEIGHT, GL_RGBA, GL_UNSIGNED_BYTE, image);
 	if (saveAsPNG || options.usePNGs) {
-		saveImage(image, options.SCR_WIDTH, options.SCR_HEIGHT, true, frameNr, options.outputPath + outputCameraName + ".png");
+		frameWriter.submit(image, options.outputPath + outputCameraName + ".png", frameNr, true);
 	}
 	else {
-		saveImage(image, options.SCR_WIDTH, options.SCR_HEIGHT, false, frameNr, options.outputPath + outputCameraName + ".yuv");
+		frameWriter.submit(image, options.outputPath + outputCameraName + frameWriter.videoExtension(), frameNr, false);
 	}
-	delete[] image;
 	return;
 }
 
@@ -0,0 +1,299 @@
+#ifndef AVDECODER_H
+#define AVDECODER_H
+
+
+#include <GL/glew.h>
+#include <string.h>
+#include <vector>
+#include <iostream>
+#include <algorithm>
+#include <new>
+extern "C" {
+#include <libavcodec/avcodec.h>
+}
+#include "Decoder.h"
+
+
+/*
+* AvDecoder decodes a video on the CPU with libavcodec, for machines without NVDEC.
+*
+* Decode() is called by the threads of the Pool. It sends the packet to libavcodec (which uses
+* frame and slice threading internally) and converts the most recently decoded frame to one of the staging pictures,
+* in the same layout that NvDecoder writes to the OpenGL texture:
+*   color: luma rows, followed by the interleaved CbCr rows starting at the luma height rounded up to a multiple of 16
+*   depth: luma rows only
+* with the samples stored in the most significant bits of 16-bit values if the texture is 16-bit.
+* HandlePictureDisplay() uploads a staging picture to the texture and must be called by the OpenGL thread.
+* There are decodeAhead + 1 staging pictures, so a picture is not overwritten while it waits to be uploaded.
+* IsOpen() is false if libavcodec has no decoder for the codec, Decode() returns false if a frame cannot be converted.
+*
+* Frame threading and B-frames delay the output by a few packets. Every packet results in exactly one frame,
+* so OutputDelay() is the number of packets sent minus the number of frames received.
+*/
+class AvDecoder : public Decoder {
+public:
+	AvDecoder(GLuint texture, int width, int height, int bitDepth, bool isColor, AVCodecID codecId, int nrThreads, int decodeAhead = 1, bool printInfo = false)
+		: Decoder(isColor), texture(texture), width(width), height(height), nrPictures(decodeAhead + 1) {
+
+		bytesPerSample = bitDepth > 8 ? 2 : 1;
+		chromaOffset = ((height + 16 - 1) / 16) * 16;
+		pictureHeight = isColor ? chromaOffset + height / 2 : height;
+		for (int i = 0; i < nrPictures; i++) {
+			pictures.push_back(std::vector<uint8_t>((size_t)width * pictureHeight * bytesPerSample, 0));
+		}
+
+		const AVCodec* codec = avcodec_find_decoder(codecId);
+		if (!codec) {
+			std::cout << "Error: no libavcodec decoder found for codec " << avcodec_get_name(codecId) << std::endl;
+			return;
+		}
+		codecContext = avcodec_alloc_context3(codec);
+		codecContext->thread_count = nrThreads;
+		codecContext->thread_type = FF_THREAD_FRAME | FF_THREAD_SLICE;
+		if (avcodec_open2(codecContext, codec, NULL) < 0) {
+			std::cout << "Error: could not open libavcodec decoder " << codec->name << std::endl;
+			return;
+		}
+		if (printInfo) {
+			std::cout << "CPU decoder in use: " << codec->long_name << " with " << nrThreads << " thread(s) per video" << std::endl;
+		}
+		packet = av_packet_alloc();
+		frame = av_frame_alloc();
+		receivedFrame = av_frame_alloc();
+		isOpen = true;
+	}
+
+	~AvDecoder() {
+		av_frame_free(&receivedFrame);
+		av_frame_free(&frame);
+		av_packet_free(&packet);
+		avcodec_free_context(&codecContext);
+	}
+
+	bool IsOpen() {
+		return isOpen;
+	}
+
+	bool Decode(const uint8_t* pData, int nSize, int nFlags = 0, int64_t nTimestamp = 0) {
+		if (!pData || nSize <= 0) {
+			// an empty packet would flush (and thereby end) the decoder, so ignore it
+			return true;
+		}
+		packet->data = (uint8_t*)pData;
+		packet->size = nSize;
+		packet->pts = nTimestamp;
+		if (avcodec_send_packet(codecContext, packet) < 0) {
+			// a corrupt packet, the next keyframe recovers from it
+			std::cout << "Error: libavcodec failed to decode a packet of " << (isColor ? "color" : "depth") << " video" << std::endl;
+			return true;
+		}
+		nrPacketsSent++;
+		// only the most recent frame is of interest
+		bool received = false;
+		while (avcodec_receive_frame(codecContext, receivedFrame) == 0) {
+			av_frame_unref(frame);
+			av_frame_move_ref(frame, receivedFrame);
+			nrFramesReceived++;
+			received = true;
+		}
+		if (!received) {
+			return true;
+		}
+		int index = (picture_index + 1) % nrPictures;
+		if (!storeFrame(index)) {
+			return false;
+		}
+		av_frame_unref(frame);
+		picture_index = index;
+		return true;
+	}
+
+	int HandlePictureDisplay(int decoded_picture_index) {
+		if (decoded_picture_index < 0 || !texture) {
+			return -1;
+		}
+		const uint8_t* picture = IsCachedPicture(decoded_picture_index)
+			? frameCache.data() + (size_t)(decoded_picture_index - cachedPictureOffset) * GetCachedFrameSize()
+			: pictures[decoded_picture_index].data();
+		glBindTexture(GL_TEXTURE_2D, texture);
+		glPixelStorei(GL_UNPACK_ALIGNMENT, bytesPerSample);
+		glTexSubImage2D(GL_TEXTURE_2D, 0, 0, 0, width, pictureHeight, GL_RED, bytesPerSample == 2 ? GL_UNSIGNED_SHORT : GL_UNSIGNED_BYTE, picture);
+		glPixelStorei(GL_UNPACK_ALIGNMENT, 4);
+		glBindTexture(GL_TEXTURE_2D, 0);
+		return 1;
+	}
+
+	void SetTexture(GLuint texture) {
+		this->texture = texture;
+	}
+
+	int OutputDelay() {
+		return (int)(nrFramesReceived > 0 ? nrPacketsSent - nrFramesReceived : nrPacketsSent);
+	}
+
+	size_t GetCachedFrameSize() {
+		return pictures[0].size();
+	}
+
+	bool EnableFrameCache(int nrFrames) {
+		try {
+			frameCache.resize((size_t)nrFrames * GetCachedFrameSize());
+		}
+		catch (const std::bad_alloc&) {
+			return false;
+		}
+		return true;
+	}
+
+	void CacheFrame(int decoded_picture_index, int cacheIndex) {
+		if (decoded_picture_index < 0 || (size_t)(cacheIndex + 1) * GetCachedFrameSize() > frameCache.size()) {
+			return;
+		}
+		memcpy(frameCache.data() + (size_t)cacheIndex * GetCachedFrameSize(), pictures[decoded_picture_index].data(), GetCachedFrameSize());
+	}
+
+	void DisableFrameCache() {
+		std::vector<uint8_t>().swap(frameCache);
+	}
+
+private:
+	// convert the decoded frame to the NV12 (color) or luma-only (depth) layout of the texture
+	bool storeFrame(int index) {
+		int frameBitDepth = 8;
+		bool semiPlanar = false;
+		bool gray = false;
+		switch (frame->format) {
+		case AV_PIX_FMT_YUV420P:
+		case AV_PIX_FMT_YUVJ420P:
+			break;
+		case AV_PIX_FMT_YUV420P10LE:
+			frameBitDepth = 10;
+			break;
+		case AV_PIX_FMT_YUV420P12LE:
+			frameBitDepth = 12;
+			break;
+		case AV_PIX_FMT_YUV420P16LE:
+			frameBitDepth = 16;
+			break;
+		case AV_PIX_FMT_NV12:
+			semiPlanar = true;
+			break;
+		case AV_PIX_FMT_P010LE:
+		case AV_PIX_FMT_P016LE:
+			// the samples are already stored in the most significant bits
+			frameBitDepth = 16;
+			semiPlanar = true;
+			break;
+		case AV_PIX_FMT_GRAY8:
+			gray = true;
+			break;
+		case AV_PIX_FMT_GRAY10LE:
+			frameBitDepth = 10;
+			gray = true;
+			break;
+		case AV_PIX_FMT_GRAY12LE:
+			frameBitDepth = 12;
+			gray = true;
+			break;
+		case AV_PIX_FMT_GRAY16LE:
+			frameBitDepth = 16;
+			gray = true;
+			break;
+		default:
+			std::cout << "Error: pixel format " << frame->format << " of " << (isColor ? "color" : "depth") << " video is not supported by the CPU decoder" << std::endl;
+			return false;
+		}
+
+		uint8_t* dst = pictures[index].data();
+		int w = std::min(width, frame->width);
+		int h = std::min(height, frame->height);
+		for (int y = 0; y < h; y++) {
+			convertRow(frame->data[0] + (size_t)y * frame->linesize[0], 1, dst + (size_t)y * width * bytesPerSample, w, frameBitDepth);
+		}
+		if (!isColor) {
+			return true;
+		}
+
+		uint8_t* dstChroma = dst + (size_t)chromaOffset * width * bytesPerSample;
+		int chromaWidth = w / 2;
+		for (int y = 0; y < h / 2; y++) {
+			uint8_t* dstRow = dstChroma + (size_t)y * width * bytesPerSample;
+			if (gray) {
+				fillNeutralChroma(dstRow, 2 * chromaWidth);
+			}
+			else if (semiPlanar) {
+				convertRow(frame->data[1] + (size_t)y * frame->linesize[1], 1, dstRow, 2 * chromaWidth, frameBitDepth);
+			}
+			else {
+				// interleave the U and V planes
+				convertRow(frame->data[1] + (size_t)y * frame->linesize[1], 2, dstRow, chromaWidth, frameBitDepth);
+				convertRow(frame->data[2] + (size_t)y * frame->linesize[2], 2, dstRow + bytesPerSample, chromaWidth, frameBitDepth);
+			}
+		}
+		return true;
+	}
+
+	// copy n samples from src to every dstStride-th sample of dst, converting from frameBitDepth to the bit depth of the texture
+	void convertRow(const uint8_t* src, int dstStride, uint8_t* dst, int n, int frameBitDepth) {
+		if (frameBitDepth == 8) {
+			if (bytesPerSample == 1) {
+				if (dstStride == 1) {
+					memcpy(dst, src, n);
+					return;
+				}
+				for (int x = 0; x < n; x++) {
+					dst[x * dstStride] = src[x];
+				}
+			}
+			else {
+				uint16_t* dst16 = (uint16_t*)dst;
+				for (int x = 0; x < n; x++) {
+					dst16[x * dstStride] = (uint16_t)(src[x] << 8);
+				}
+			}
+			return;
+		}
+		const uint16_t* src16 = (const uint16_t*)src;
+		if (bytesPerSample == 1) {
+			int shift = frameBitDepth - 8;
+			for (int x = 0; x < n; x++) {
+				dst[x * dstStride] = (uint8_t)(src16[x] >> shift);
+			}
+		}
+		else {
+			int shift = 16 - frameBitDepth;
+			uint16_t* dst16 = (uint16_t*)dst;
+			for (int x = 0; x < n; x++) {
+				dst16[x * dstStride] = (uint16_t)(src16[x] << shift);
+			}
+		}
+	}
+
+	void fillNeutralChroma(uint8_t* dst, int n) {
+		if (bytesPerSample == 1) {
+			memset(dst, 128, n);
+		}
+		else {
+			std::fill((uint16_t*)dst, (uint16_t*)dst + n, (uint16_t)(128 << 8));
+		}
+	}
+
+	GLuint texture = 0;
+	int width = 0;
+	int height = 0;
+	int nrPictures = 2;
+	int bytesPerSample = 1;
+	int chromaOffset = 0;
+	int pictureHeight = 0;
+	std::vector<std::vector<uint8_t>> pictures;
+	std::vector<uint8_t> frameCache;
+	AVCodecContext* codecContext = NULL;
+	AVPacket* packet = NULL;
+	AVFrame* frame = NULL;
+	AVFrame* receivedFrame = NULL;
+	int64_t nrPacketsSent = 0;
+	int64_t nrFramesReceived = 0;
+	bool isOpen = false;
+};
+
+#endif
@@ -0,0 +1,446 @@
+#ifndef CAMERA_INDEX_H
+#define CAMERA_INDEX_H
+
+
+#include <vector>
+#include <queue>
+#include <algorithm>
+#include <cmath>
+#include <tuple>
+#include <functional>
+#include <limits>
+#include "ioHelper.h"
+
+
+/*
+* CameraIndex is a bounding volume hierarchy over the InputCameras, so CameraVisibilityHelper can find
+* the cameras near a point, or the cameras that can see a point, without testing every camera of a large rig.
+*
+* Every camera is reduced to its position, its rotation and a visibility cone: its viewing direction and the largest
+* angle to that direction under which a point can still get a heuristic of at least minHeuristic from
+* CameraVisibilityHelper::inputCameraSeesPoint(). Every node bounds the cameras below it in the same terms:
+* a sphere around the positions, a cone around the visibility cones, and the rotation of one of its cameras
+* together with how far the rotations of the others differ from it.
+*
+* camerasThatMaySee(): the cameras that may give the point a heuristic of at least minHeuristic (which is at least
+*                      the one of build()), the caller still has to test them. A node is skipped if the point lies
+*                      outside its cone as seen from anywhere in its sphere, or if its upper bound on the heuristic is too low.
+* nearest(): the k cameras closest to the point, from close to far.
+* startByAngle(), nextByAngle(): the cameras that may see apex (as above), one by one in order of the angle between direction
+*                                and the vector from apex to the camera (ties by index), up to maxAngle.
+*                                The nodes are visited best-first, so only the cameras that are returned
+*                                and the nodes around them are looked at.
+* highestHeuristics(): the cameras with the highest heuristic for a point, visiting only the nodes whose upper bound
+*                      on the heuristic can still compete.
+*/
+class CameraIndex {
+public:
+	CameraIndex() {}
+
+	void build(const std::vector<InputCamera>& inputCameras, float minHeuristic) {
+		cameras.clear();
+		nodes.clear();
+		for (int i = 0; i < inputCameras.size(); i++) {
+			const InputCamera& input = inputCameras[i];
+			Camera camera;
+			camera.index = i;
+			Bounds& b = camera.bounds;
+			b.center = glm::vec3(input.model[3]);
+			b.axis = glm::normalize(glm::vec3(input.model * glm::vec4(0, 0, -1, 0)));
+			b.cone = Cone(visibilityHalfAngle(input, minHeuristic));
+			b.toCamera = glm::transpose(glm::mat3(input.model));
+			if (input.projection == Projection::Perspective) {
+				imageExtent(input, b.extentX, b.extentY);
+			}
+			else {
+				b.fullHalfAngle = visibilityHalfAngle(input, 1.0f);
+			}
+			cameras.push_back(camera);
+		}
+		if (!cameras.empty()) {
+			nodes.push_back(Node());
+			buildNode(0, 0, (int)cameras.size());
+		}
+	}
+
+	// appends the indices of the InputCameras to result, in no particular order
+	void camerasThatMaySee(const glm::vec3& point, float minHeuristic, std::vector<int>& result) const {
+		if (nodes.empty()) {
+			return;
+		}
+		int stack[64];
+		int stackSize = 0;
+		stack[stackSize++] = 0;
+		while (stackSize > 0) {
+			const Node& node = nodes[stack[--stackSize]];
+			if (!maySee(node.bounds, point, minHeuristic)) {
+				continue;
+			}
+			if (node.left < 0) {
+				for (int i = node.first; i < node.last; i++) {
+					// the caller tests the cameras anyway, which is cheaper than the bound on the heuristic
+					if (isInCone(cameras[i].bounds, point)) {
+						result.push_back(cameras[i].index);
+					}
+				}
+			}
+			else {
+				stack[stackSize++] = node.left;
+				stack[stackSize++] = node.left + 1;
+			}
+		}
+	}
+
+	// fills result with the indices of the k InputCameras closest to point, closest first (ties by index)
+	void nearest(const glm::vec3& point, int k, std::vector<int>& result) const {
+		result.clear();
+		if (nodes.empty() || k <= 0) {
+			return;
+		}
+		// max-heap of the best k so far, and a min-heap of the nodes still to visit
+		std::priority_queue<std::pair<float, int>> best;
+		std::priority_queue<std::pair<float, int>, std::vector<std::pair<float, int>>, std::greater<std::pair<float, int>>> toVisit;
+		toVisit.push(std::make_pair(0.0f, 0));
+		while (!toVisit.empty()) {
+			std::pair<float, int> next = toVisit.top();
+			toVisit.pop();
+			if (best.size() == k && next.first > best.top().first) {
+				break;
+			}
+			const Node& node = nodes[next.second];
+			if (node.left < 0) {
+				for (int i = node.first; i < node.last; i++) {
+					std::pair<float, int> candidate(glm::length(cameras[i].bounds.center - point), cameras[i].index);
+					if (best.size() < k) {
+						best.push(candidate);
+					}
+					else if (candidate < best.top()) {
+						best.pop();
+						best.push(candidate);
+					}
+				}
+			}
+			else {
+				for (int child = node.left; child <= node.left + 1; child++) {
+					const Bounds& b = nodes[child].bounds;
+					toVisit.push(std::make_pair((std::max)(0.0f, glm::length(b.center - point) - b.radius), child));
+				}
+			}
+		}
+		result.resize(best.size());
+		for (int i = (int)best.size() - 1; i >= 0; i--) {
+			result[i] = best.top().second;
+			best.pop();
+		}
+	}
+
+	void startByAngle(const glm::vec3& apex, float minHeuristic, const glm::vec3& direction, float maxAngle) {
+		byAngle = ByAngleQuery();
+		byAngle.apex = apex;
+		byAngle.minHeuristic = minHeuristic;
+		byAngle.direction = direction;
+		byAngle.maxAngle = maxAngle;
+		if (!nodes.empty()) {
+			byAngle.heap.push(ByAngleQuery::Entry(0.0f, false, 0));
+		}
+	}
+
+	// returns false once all cameras within maxAngle were returned
+	bool nextByAngle(/*out*/ int& index, /*out*/ float& angle) {
+		while (!byAngle.heap.empty()) {
+			ByAngleQuery::Entry entry = byAngle.heap.top();
+			byAngle.heap.pop();
+			if (std::get<0>(entry) >= byAngle.maxAngle) {
+				break;
+			}
+			if (std::get<1>(entry)) {
+				index = std::get<2>(entry);
+				angle = std::get<0>(entry);
+				return true;
+			}
+			const Node& node = nodes[std::get<2>(entry)];
+			if (!maySee(node.bounds, byAngle.apex, byAngle.minHeuristic)) {
+				continue;
+			}
+			if (node.left < 0) {
+				for (int i = node.first; i < node.last; i++) {
+					if (isInCone(cameras[i].bounds, byAngle.apex)) {
+						glm::vec3 d = glm::normalize(cameras[i].bounds.center - byAngle.apex);
+						float a = std::acos((std::min)(glm::dot(byAngle.direction, d), 1.0f));
+						// ties are broken by the index in the InputCameras
+						byAngle.heap.push(ByAngleQuery::Entry(a, true, cameras[i].index));
+					}
+				}
+			}
+			else {
+				for (int child = node.left; child <= node.left + 1; child++) {
+					byAngle.heap.push(ByAngleQuery::Entry(lowerBoundAngle(nodes[child].bounds), false, child));
+				}
+			}
+		}
+		byAngle.heap = std::priority_queue<ByAngleQuery::Entry, std::vector<ByAngleQuery::Entry>, std::greater<ByAngleQuery::Entry>>();
+		return false;
+	}
+
+	// Appends (heuristic, index) to result for the cameras whose heuristic for point (as computed by heuristic(index))
+	// is above minHeuristic and at most tolerance below the highest one, in no particular order.
+	template <typename Heuristic>
+	void highestHeuristics(const glm::vec3& point, float minHeuristic, float tolerance, Heuristic heuristic, std::vector<std::pair<float, int>>& result) const {
+		if (nodes.empty()) {
+			return;
+		}
+		// best-first on the upper bound, a max-heap of (upper bound, node)
+		std::priority_queue<std::pair<float, int>> toVisit;
+		toVisit.push(std::make_pair(1.0f, 0));
+		float best = minHeuristic;
+		size_t first = result.size();
+		while (!toVisit.empty() && toVisit.top().first >= best - tolerance) {
+			const Node& node = nodes[toVisit.top().second];
+			toVisit.pop();
+			if (node.left < 0) {
+				for (int i = node.first; i < node.last; i++) {
+					float h = heuristic(cameras[i].index);
+					if (h > minHeuristic && h >= best - tolerance) {
+						result.push_back(std::make_pair(h, cameras[i].index));
+						best = (std::max)(best, h);
+					}
+				}
+			}
+			else {
+				for (int child = node.left; child <= node.left + 1; child++) {
+					float bound = maxHeuristic(nodes[child].bounds, point);
+					if (bound >= best - tolerance) {
+						toVisit.push(std::make_pair(bound, child));
+					}
+				}
+			}
+		}
+		// drop the ones that were added before the best one was found
+		result.erase(std::remove_if(result.begin() + first, result.end(), [best, tolerance](const std::pair<float, int>& h) {
+			return h.first < best - tolerance;
+		}), result.end());
+	}
+
+private:
+	// the half angle of a cone, with its cosine and sine to avoid trigonometry in the queries
+	struct Cone {
+		float halfAngle;
+		float cos;
+		float sin;
+
+		Cone(float halfAngle = 0.0f) : halfAngle(halfAngle), cos(std::cos(halfAngle)), sin(std::sin(halfAngle)) {}
+	};
+
+	// what is known about one camera, or about all cameras below a node
+	struct Bounds {
+		glm::vec3 center;             // of the sphere around the positions
+		float radius = 0.0f;
+		glm::vec3 axis;               // the (mean) viewing direction
+		float axisSpread = 0.0f;      // the largest angle between axis and a viewing direction
+		Cone cone;                    // around axis, contains the visibility cones
+		glm::mat3 toCamera;           // the rotation from world to camera coordinates of one of the cameras
+		float rotationSpread = 0.0f;  // the largest angle of the rotation between toCamera and that of a camera
+		float extentX = -1.0f;        // the largest extent of the images of the perspective cameras (see imageExtent()),
+		float extentY = -1.0f;        // -1 if there are none
+		float fullHalfAngle = -1.0f;  // the largest cone in which the heuristic of the other cameras is 1, -1 if there are none
+	};
+
+	struct Camera {
+		int index;                    // in the InputCameras
+		Bounds bounds;
+	};
+
+	struct Node {
+		Bounds bounds;
+		int left = -1;                // the children are left and left + 1, -1 for a leaf
+		int first = 0;                // the cameras of a leaf are cameras[first, last)
+		int last = 0;
+	};
+
+	// the state of startByAngle() and nextByAngle()
+	struct ByAngleQuery {
+		typedef std::tuple<float, bool, int> Entry; // (angle or lower bound, is a camera, index in the InputCameras or in nodes)
+		glm::vec3 apex = glm::vec3(0.0f);
+		float minHeuristic = 0.0f;
+		glm::vec3 direction = glm::vec3(0.0f, 0.0f, -1.0f);
+		float maxAngle = 0.0f;
+		std::priority_queue<Entry, std::vector<Entry>, std::greater<Entry>> heap;
+	};
+
+	static const int leafSize = 16;
+	std::vector<Camera> cameras;  // ordered so that every node holds a contiguous range
+	std::vector<Node> nodes;
+	ByAngleQuery byAngle;
+
+	// how far the image of a perspective camera extends from the principal point, at distance 1
+	static void imageExtent(const InputCamera& input, /*out*/ float& x, /*out*/ float& y) {
+		x = y = 1e6f; // unknown, so the image could be anywhere
+		if (input.focal_x != 0.0f && input.focal_y != 0.0f) {
+			x = (std::max)(input.principal_point_x, input.res_x - input.principal_point_x) / std::fabs(input.focal_x);
+			y = (std::max)(input.principal_point_y, input.res_y - input.principal_point_y) / std::fabs(input.focal_y);
+		}
+	}
+
+	// the largest angle between the viewing direction of the input and a direction in which
+	// a point can still get at least minHeuristic from inputCameraSeesPoint()
+	static float visibilityHalfAngle(const InputCamera& input, float minHeuristic) {
+		const float pi = glm::pi<float>();
+		if (input.projection == Projection::Perspective) {
+			// (heuristicx + heuristicy) / 2 >= minHeuristic means both are at least 2 * minHeuristic - 1
+			float slack = 2.0f * minHeuristic - 1.0f;
+			if (slack <= 0.0f || input.focal_x == 0.0f || input.focal_y == 0.0f) {
+				return pi;
+			}
+			float x, y;
+			imageExtent(input, x, y);
+			return std::atan(std::sqrt(x * x + y * y) / slack);
+		}
+		else if (input.projection == Projection::Equirectangular) {
+			return std::acos(glm::clamp(minHeuristic - 1.0f, -1.0f, 1.0f));
+		}
+		return std::acos(glm::clamp(std::cos(input.fov) + minHeuristic - 1.0f, -1.0f, 1.0f));
+	}
+
+	// whether a camera in b may give point a heuristic of at least minHeuristic
+	static bool maySee(const Bounds& b, const glm::vec3& point, float minHeuristic) {
+		if (!isInCone(b, point)) {
+			return false;
+		}
+		// the cone is round, the images of perspective cameras are not
+		return b.extentX < 0.0f || maxHeuristic(b, point) >= minHeuristic - 1e-4f;
+	}
+
+	// whether a camera anywhere in the sphere, looking in a direction within the cone around axis, can have point within its cone
+	static bool isInCone(const Bounds& b, const glm::vec3& point) {
+		if (b.cone.halfAngle >= glm::pi<float>()) {
+			return true;
+		}
+		glm::vec3 d = point - b.center;
+		float distance = glm::length(d);
+		if (distance <= b.radius) {
+			return true;
+		}
+		// the sphere widens the cone by the angle under which it is seen from point
+		float sinSpread = b.radius / distance;
+		float cosSpread = std::sqrt(1.0f - sinSpread * sinSpread);
+		if (b.cone.cos < 0.0f && cosSpread <= -b.cone.cos) {
+			return true; // the widened cone covers every direction
+		}
+		// the angle between axis and d is at most halfAngle + spread
+		return glm::dot(b.axis, d) / distance >= b.cone.cos * cosSpread - b.cone.sin * sinSpread - 1e-4f;
+	}
+
+	// an upper bound on the heuristic of inputCameraSeesPoint() for point, for the cameras in b
+	static float maxHeuristic(const Bounds& b, const glm::vec3& point) {
+		glm::vec3 d = point - b.center;
+		float distance = glm::length(d);
+		if (distance <= b.radius) {
+			return 1.0f;
+		}
+		// the direction to point, seen from anywhere in the sphere, differs at most spread from d
+		float spread = std::asin(b.radius / distance) + 1e-4f;
+		// the smallest angle between the viewing direction of a camera and the direction to point
+		float angle = std::acos(glm::clamp(glm::dot(b.axis, d / distance), -1.0f, 1.0f));
+		angle = (std::max)(0.0f, angle - spread - b.axisSpread);
+
+		float bound = 0.0f;
+		if (b.extentX >= 0.0f && angle < glm::half_pi<float>()) {
+			// In camera coordinates, the direction to point lies within spread + rotationSpread of v,
+			// which bounds how close its projection can get to the principal point in x and in y
+			glm::vec3 v = b.toCamera * (d / distance);
+			float sinDeviation = std::sin((std::min)(spread + b.rotationSpread, glm::half_pi<float>()));
+			float hx = (std::min)(1.0f, b.extentX / minSlope(v.x, v.z, v.y, sinDeviation));
+			float hy = (std::min)(1.0f, b.extentY / minSlope(v.y, v.z, v.x, sinDeviation));
+			bound = (hx + hy) / 2.0f;
+		}
+		if (b.fullHalfAngle >= 0.0f) {
+			bound = (std::max)(bound, angle <= b.fullHalfAngle ? 1.0f : 1.0f + std::cos(angle) - std::cos(b.fullHalfAngle));
+		}
+		return bound;
+	}
+
+	// The smallest |a / -z| over the unit vectors within the angle asin(sinDeviation) of v = (a, z, other),
+	// i.e. the distance of their projection from the principal point along one axis.
+	// The angle between v and the plane through the other axis at azimuth t is asin(|sin(azimuth of v - t)| * rho).
+	static float minSlope(float a, float z, float other, float sinDeviation) {
+		float rho = std::sqrt(a * a + z * z);
+		if (rho <= sinDeviation) {
+			return 0.0f;
+		}
+		float azimuth = std::fabs(std::atan2(a, -z)) - std::asin(sinDeviation / rho);
+		if (azimuth <= 0.0f) {
+			return 0.0f;
+		}
+		if (azimuth >= glm::half_pi<float>()) {
+			return std::numeric_limits<float>::infinity();
+		}
+		return std::tan(azimuth);
+	}
+
+	// the smallest angle between byAngle.direction and the vector from byAngle.apex to a camera in b
+	float lowerBoundAngle(const Bounds& b) const {
+		glm::vec3 d = b.center - byAngle.apex;
+		float distance = glm::length(d);
+		if (distance <= b.radius) {
+			return 0.0f;
+		}
+		float angle = std::acos(glm::clamp(glm::dot(byAngle.direction, d / distance), -1.0f, 1.0f));
+		// the margin keeps the bound below the angles of the cameras despite rounding
+		return (std::max)(0.0f, angle - std::asin(b.radius / distance) - 1e-4f);
+	}
+
+	// fills nodes[index], which the caller already added
+	void buildNode(int index, int first, int last) {
+		Node node;
+		node.first = first;
+		node.last = last;
+		Bounds& b = node.bounds;
+
+		// bounding box of the positions, and the mean viewing direction
+		glm::vec3 lower = cameras[first].bounds.center;
+		glm::vec3 upper = cameras[first].bounds.center;
+		glm::vec3 axis = glm::vec3(0);
+		for (int i = first; i < last; i++) {
+			lower = glm::min(lower, cameras[i].bounds.center);
+			upper = glm::max(upper, cameras[i].bounds.center);
+			axis += cameras[i].bounds.axis;
+		}
+		b.center = (lower + upper) * 0.5f;
+		b.axis = glm::length(axis) > 1e-6f ? glm::normalize(axis) : glm::vec3(0, 0, -1);
+		b.toCamera = cameras[first].bounds.toCamera;
+		float halfAngle = 0.0f;
+		for (int i = first; i < last; i++) {
+			const Bounds& c = cameras[i].bounds;
+			b.radius = (std::max)(b.radius, glm::length(c.center - b.center));
+			float angle = std::acos(glm::clamp(glm::dot(b.axis, c.axis), -1.0f, 1.0f));
+			b.axisSpread = (std::max)(b.axisSpread, angle);
+			halfAngle = (std::max)(halfAngle, angle + c.cone.halfAngle);
+			// the angle of the rotation from c.toCamera to b.toCamera
+			float trace = glm::dot(b.toCamera[0], c.toCamera[0]) + glm::dot(b.toCamera[1], c.toCamera[1]) + glm::dot(b.toCamera[2], c.toCamera[2]);
+			b.rotationSpread = (std::max)(b.rotationSpread, std::acos(glm::clamp((trace - 1.0f) / 2.0f, -1.0f, 1.0f)));
+			b.extentX = (std::max)(b.extentX, c.extentX);
+			b.extentY = (std::max)(b.extentY, c.extentY);
+			b.fullHalfAngle = (std::max)(b.fullHalfAngle, c.fullHalfAngle);
+		}
+		b.cone = Cone((std::min)(halfAngle, glm::pi<float>()));
+
+		if (last - first > leafSize) {
+			// split at the median along the longest side of the bounding box
+			glm::vec3 extent = upper - lower;
+			int dim = extent.x >= extent.y && extent.x >= extent.z ? 0 : (extent.y >= extent.z ? 1 : 2);
+			int middle = (first + last) / 2;
+			std::nth_element(cameras.begin() + first, cameras.begin() + middle, cameras.begin() + last, [dim](const Camera& a, const Camera& b) {
+				return a.bounds.center[dim] < b.bounds.center[dim];
+			});
+			// the children are stored next to each other
+			node.left = (int)nodes.size();
+			nodes.push_back(Node());
+			nodes.push_back(Node());
+			buildNode(node.left, first, middle);
+			buildNode(node.left + 1, middle, last);
+		}
+		nodes[index] = node;
+	}
+};
+
+#endif
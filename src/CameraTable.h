@@ -0,0 +1,382 @@
+#ifndef CAMERA_TABLE_H
+#define CAMERA_TABLE_H
+
+
+#include <vector>
+#include <cmath>
+#include "ioHelper.h"
+
+#if defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+#define CAMERA_TABLE_SSE2
+#include <emmintrin.h>
+#elif defined(__aarch64__) || defined(_M_ARM64)
+#define CAMERA_TABLE_NEON
+#include <arm_neon.h>
+#endif
+
+
+/*
+* CameraTable holds what CameraVisibilityHelper needs of the InputCameras to compute how well they see a point
+* (the heuristic of CameraVisibilityHelper::inputCameraSeesPoint()), as a structure of arrays:
+* the positions, the first 3 rows of the view matrices, the borders of the images of the perspective cameras
+* at distance 1, and the cosine of the field of view of the fisheye cameras.
+*
+* score() gives the heuristic of one camera for one point, scoreAll() that of every camera for a few points,
+* and cosinesTo() the cosine of the angle between a direction and the vector from a point to every camera.
+* The cameras are grouped per projection, and scoreAll() has a kernel per projection that loads every camera
+* once for all points and scores 4 cameras at a time with SSE2 or NEON (one at a time on other CPUs).
+* Every operation is done in the same order as the glm code it replaces, so both give exactly the same heuristics.
+*/
+class CameraTable {
+public:
+	CameraTable() {}
+
+	void build(const std::vector<InputCamera>& inputCameras) {
+		int n = (int)inputCameras.size();
+		index.clear();
+		slotOf.assign(n, 0);
+		for (int r = 0; r < 3; r++) {
+			for (int c = 0; c < 4; c++) {
+				view[r][c].clear();
+			}
+		}
+		posX.clear();
+		posY.clear();
+		posZ.clear();
+		left.clear();
+		right.clear();
+		bottom.clear();
+		top.clear();
+		cosFov.clear();
+		for (int g = 0; g < nrGroups; g++) {
+			groupBegin[g] = (int)index.size();
+			for (int i = 0; i < n; i++) {
+				const InputCamera& input = inputCameras[i];
+				if (group(input.projection) != g) {
+					continue;
+				}
+				slotOf[i] = (int)index.size();
+				index.push_back(i);
+				posX.push_back(input.pos.x);
+				posY.push_back(input.pos.y);
+				posZ.push_back(input.pos.z);
+				for (int r = 0; r < 3; r++) {
+					for (int c = 0; c < 4; c++) {
+						view[r][c].push_back(input.view[c][r]);
+					}
+				}
+				left.push_back(-input.principal_point_x / input.focal_x);
+				right.push_back((input.res_x - input.principal_point_x) / input.focal_x);
+				bottom.push_back(-(input.res_y - input.principal_point_y) / input.focal_y);
+				top.push_back(input.principal_point_y / input.focal_y);
+				cosFov.push_back(cos(input.fov));
+			}
+			groupEnd[g] = (int)index.size();
+		}
+	}
+
+	int size() const {
+		return (int)index.size();
+	}
+
+	// the heuristic of InputCamera i for point
+	float score(int i, const glm::vec3& point) const {
+		int s = slotOf[i];
+		float x, y, z;
+		toCamera(s, point.x, point.y, point.z, x, y, z);
+		if (s < groupEnd[perspectiveGroup]) {
+			return perspective(x, y, z, left[s], right[s], bottom[s], top[s]);
+		}
+		else if (s < groupEnd[equirectangularGroup]) {
+			return equirectangular(x, y, z);
+		}
+		return fisheye(x, y, z, cosFov[s]);
+	}
+
+	// scores[p * size() + i] = score(i, points[p]) for all InputCameras i
+	void scoreAll(const glm::vec3* points, int nrPoints, float* scores) const {
+		scorePerspective(points, nrPoints, scores);
+		scoreEquirectangular(points, nrPoints, scores);
+		scoreFisheye(points, nrPoints, scores);
+	}
+
+	// cosines[i] = glm::dot(direction, glm::normalize(InputCamera i's pos - point)) for all InputCameras i
+	void cosinesTo(const glm::vec3& point, const glm::vec3& direction, float* cosines) const {
+		int s = 0;
+#if defined(CAMERA_TABLE_SSE2) || defined(CAMERA_TABLE_NEON)
+		const Float4 one = Float4::set(1.0f);
+		float laneCosines[lanes];
+		for (; s + lanes <= size(); s += lanes) {
+			Float4 x = Float4::load(&posX[s]) - Float4::set(point.x);
+			Float4 y = Float4::load(&posY[s]) - Float4::set(point.y);
+			Float4 z = Float4::load(&posZ[s]) - Float4::set(point.z);
+			Float4 inverseLength = one / Float4::sqrt((x * x + y * y) + z * z);
+			Float4 cosine = (Float4::set(direction.x) * (x * inverseLength) + Float4::set(direction.y) * (y * inverseLength))
+				+ Float4::set(direction.z) * (z * inverseLength);
+			cosine.store(laneCosines);
+			for (int k = 0; k < lanes; k++) {
+				cosines[index[s + k]] = laneCosines[k];
+			}
+		}
+#endif
+		for (; s < size(); s++) {
+			float x = posX[s] - point.x;
+			float y = posY[s] - point.y;
+			float z = posZ[s] - point.z;
+			float inverseLength = 1.0f / std::sqrt((x * x + y * y) + z * z);
+			cosines[index[s]] = (direction.x * (x * inverseLength) + direction.y * (y * inverseLength)) + direction.z * (z * inverseLength);
+		}
+	}
+
+private:
+	enum { perspectiveGroup, equirectangularGroup, fisheyeGroup, nrGroups };
+
+	std::vector<int> index;          // the InputCamera in every slot, the slots are ordered by group
+	std::vector<int> slotOf;         // the slot of every InputCamera
+	int groupBegin[nrGroups] = {};
+	int groupEnd[nrGroups] = {};
+	std::vector<float> posX;
+	std::vector<float> posY;
+	std::vector<float> posZ;
+	std::vector<float> view[3][4];   // view[r][c][s] is row r, column c of the view matrix of the camera in slot s
+	std::vector<float> left;         // perspective: the borders of the image at distance 1
+	std::vector<float> right;
+	std::vector<float> bottom;
+	std::vector<float> top;
+	std::vector<float> cosFov;       // fisheye: the cosine of the field of view
+
+	static int group(Projection projection) {
+		if (projection == Projection::Perspective) {
+			return perspectiveGroup;
+		}
+		else if (projection == Projection::Equirectangular) {
+			return equirectangularGroup;
+		}
+		return fisheyeGroup;
+	}
+
+	// glm::vec3(view * glm::vec4(point, 1)) of the camera in slot s
+	void toCamera(int s, float px, float py, float pz, /*out*/ float& x, /*out*/ float& y, /*out*/ float& z) const {
+		x = (view[0][0][s] * px + view[0][1][s] * py) + (view[0][2][s] * pz + view[0][3][s]);
+		y = (view[1][0][s] * px + view[1][1][s] * py) + (view[1][2][s] * pz + view[1][3][s]);
+		z = (view[2][0][s] * px + view[2][1][s] * py) + (view[2][2][s] * pz + view[2][3][s]);
+	}
+
+	// the heuristics per projection, for the position (x, y, z) of the point in the axial system of the camera
+
+	static float perspective(float x, float y, float z, float left, float right, float bottom, float top) {
+		// check if P is behind the near plane of the InputCamera
+		if (z > -0.1f) {
+			return 0.0f;
+		}
+		// In essence, we project P onto the image plane of the InputCamera
+		// If the projection is not in [-1,1], P is outside the image.
+		// The heuristics will be 1 if the projection is inside the image or
+		// will go to zero the further the projection is from the edge of the image.
+		x = -x / z;
+		y = -y / z;
+		float heuristicx = 1;
+		float heuristicy = 1;
+		if (y < bottom) {
+			heuristicy = bottom / y;
+		}
+		else if (y > top) {
+			heuristicy = top / y;
+		}
+		if (x < left) {
+			heuristicx = left / x;
+		}
+		else if (x > right) {
+			heuristicx = right / x;
+		}
+		return (heuristicx + heuristicy) / 2.0f;
+	}
+
+	// dot(glm::normalize(IP), glm::vec3(0, 0, -1)), the cosine of the angle to the viewing direction
+	static float cosAngle(float x, float y, float z) {
+		return -(z * (1.0f / std::sqrt((x * x + y * y) + z * z)));
+	}
+
+	static float equirectangular(float x, float y, float z) {
+		float angle = cosAngle(x, y, z);
+		if (angle < 0) {
+			return 1 + angle;
+		}
+		return 1;
+	}
+
+	static float fisheye(float x, float y, float z, float cosFov) {
+		float angle = cosAngle(x, y, z);
+		if (angle < cosFov) {
+			return 1 + angle - cosFov;
+		}
+		return 1;
+	}
+
+	// 4 floats at a time, and the masks of comparisons between them
+#if defined(CAMERA_TABLE_SSE2)
+	struct Float4 {
+		__m128 v;
+		static Float4 load(const float* p) { Float4 r; r.v = _mm_loadu_ps(p); return r; }
+		static Float4 set(float f) { Float4 r; r.v = _mm_set1_ps(f); return r; }
+		void store(float* p) const { _mm_storeu_ps(p, v); }
+		Float4 operator+(Float4 b) const { Float4 r; r.v = _mm_add_ps(v, b.v); return r; }
+		Float4 operator-(Float4 b) const { Float4 r; r.v = _mm_sub_ps(v, b.v); return r; }
+		Float4 operator*(Float4 b) const { Float4 r; r.v = _mm_mul_ps(v, b.v); return r; }
+		Float4 operator/(Float4 b) const { Float4 r; r.v = _mm_div_ps(v, b.v); return r; }
+		Float4 operator-() const { Float4 r; r.v = _mm_xor_ps(v, _mm_set1_ps(-0.0f)); return r; }
+		Float4 operator<(Float4 b) const { Float4 r; r.v = _mm_cmplt_ps(v, b.v); return r; }
+		Float4 operator>(Float4 b) const { Float4 r; r.v = _mm_cmpgt_ps(v, b.v); return r; }
+		static Float4 sqrt(Float4 a) { Float4 r; r.v = _mm_sqrt_ps(a.v); return r; }
+		// mask ? a : b, per lane
+		static Float4 select(Float4 mask, Float4 a, Float4 b) { Float4 r; r.v = _mm_or_ps(_mm_and_ps(mask.v, a.v), _mm_andnot_ps(mask.v, b.v)); return r; }
+	};
+	static const int lanes = 4;
+#elif defined(CAMERA_TABLE_NEON)
+	struct Float4 {
+		float32x4_t v;
+		static Float4 load(const float* p) { Float4 r; r.v = vld1q_f32(p); return r; }
+		static Float4 set(float f) { Float4 r; r.v = vdupq_n_f32(f); return r; }
+		void store(float* p) const { vst1q_f32(p, v); }
+		Float4 operator+(Float4 b) const { Float4 r; r.v = vaddq_f32(v, b.v); return r; }
+		Float4 operator-(Float4 b) const { Float4 r; r.v = vsubq_f32(v, b.v); return r; }
+		Float4 operator*(Float4 b) const { Float4 r; r.v = vmulq_f32(v, b.v); return r; }
+		Float4 operator/(Float4 b) const { Float4 r; r.v = vdivq_f32(v, b.v); return r; }
+		Float4 operator-() const { Float4 r; r.v = vnegq_f32(v); return r; }
+		Float4 operator<(Float4 b) const { Float4 r; r.v = vreinterpretq_f32_u32(vcltq_f32(v, b.v)); return r; }
+		Float4 operator>(Float4 b) const { Float4 r; r.v = vreinterpretq_f32_u32(vcgtq_f32(v, b.v)); return r; }
+		static Float4 sqrt(Float4 a) { Float4 r; r.v = vsqrtq_f32(a.v); return r; }
+		static Float4 select(Float4 mask, Float4 a, Float4 b) { Float4 r; r.v = vbslq_f32(vreinterpretq_u32_f32(mask.v), a.v, b.v); return r; }
+	};
+	static const int lanes = 4;
+#else
+	static const int lanes = 1;
+#endif
+
+	// writes the scores of the cameras in slots [s, s + lanes) for point p
+	void scatter(const float* laneScores, int s, int p, float* scores) const {
+		for (int k = 0; k < lanes; k++) {
+			scores[p * size() + index[s + k]] = laneScores[k];
+		}
+	}
+
+	// the kernels: the first slots of a group lanes at a time, the rest with the scalar code
+
+	void scorePerspective(const glm::vec3* points, int nrPoints, float* scores) const {
+		int s = groupBegin[perspectiveGroup];
+		int end = groupEnd[perspectiveGroup];
+#if defined(CAMERA_TABLE_SSE2) || defined(CAMERA_TABLE_NEON)
+		const Float4 one = Float4::set(1.0f);
+		const Float4 two = Float4::set(2.0f);
+		const Float4 nearPlane = Float4::set(-0.1f);
+		float laneScores[lanes];
+		for (; s + lanes <= end; s += lanes) {
+			Float4 m[3][4];
+			loadView(s, m);
+			Float4 l = Float4::load(&left[s]);
+			Float4 r = Float4::load(&right[s]);
+			Float4 b = Float4::load(&bottom[s]);
+			Float4 t = Float4::load(&top[s]);
+			for (int p = 0; p < nrPoints; p++) {
+				Float4 x, y, z;
+				toCamera(m, points[p], x, y, z);
+				x = -x / z;
+				y = -y / z;
+				Float4 heuristicy = Float4::select(y < b, b / y, Float4::select(y > t, t / y, one));
+				Float4 heuristicx = Float4::select(x < l, l / x, Float4::select(x > r, r / x, one));
+				Float4 heuristic = Float4::select(z > nearPlane, Float4::set(0.0f), (heuristicx + heuristicy) / two);
+				heuristic.store(laneScores);
+				scatter(laneScores, s, p, scores);
+			}
+		}
+#endif
+		for (; s < end; s++) {
+			for (int p = 0; p < nrPoints; p++) {
+				float x, y, z;
+				toCamera(s, points[p].x, points[p].y, points[p].z, x, y, z);
+				scores[p * size() + index[s]] = perspective(x, y, z, left[s], right[s], bottom[s], top[s]);
+			}
+		}
+	}
+
+	void scoreEquirectangular(const glm::vec3* points, int nrPoints, float* scores) const {
+		int s = groupBegin[equirectangularGroup];
+		int end = groupEnd[equirectangularGroup];
+#if defined(CAMERA_TABLE_SSE2) || defined(CAMERA_TABLE_NEON)
+		const Float4 one = Float4::set(1.0f);
+		const Float4 zero = Float4::set(0.0f);
+		float laneScores[lanes];
+		for (; s + lanes <= end; s += lanes) {
+			Float4 m[3][4];
+			loadView(s, m);
+			for (int p = 0; p < nrPoints; p++) {
+				Float4 x, y, z;
+				toCamera(m, points[p], x, y, z);
+				Float4 angle = cosAngle(x, y, z);
+				Float4::select(angle < zero, one + angle, one).store(laneScores);
+				scatter(laneScores, s, p, scores);
+			}
+		}
+#endif
+		for (; s < end; s++) {
+			for (int p = 0; p < nrPoints; p++) {
+				float x, y, z;
+				toCamera(s, points[p].x, points[p].y, points[p].z, x, y, z);
+				scores[p * size() + index[s]] = equirectangular(x, y, z);
+			}
+		}
+	}
+
+	void scoreFisheye(const glm::vec3* points, int nrPoints, float* scores) const {
+		int s = groupBegin[fisheyeGroup];
+		int end = groupEnd[fisheyeGroup];
+#if defined(CAMERA_TABLE_SSE2) || defined(CAMERA_TABLE_NEON)
+		const Float4 one = Float4::set(1.0f);
+		float laneScores[lanes];
+		for (; s + lanes <= end; s += lanes) {
+			Float4 m[3][4];
+			loadView(s, m);
+			Float4 c = Float4::load(&cosFov[s]);
+			for (int p = 0; p < nrPoints; p++) {
+				Float4 x, y, z;
+				toCamera(m, points[p], x, y, z);
+				Float4 angle = cosAngle(x, y, z);
+				Float4::select(angle < c, one + angle - c, one).store(laneScores);
+				scatter(laneScores, s, p, scores);
+			}
+		}
+#endif
+		for (; s < end; s++) {
+			for (int p = 0; p < nrPoints; p++) {
+				float x, y, z;
+				toCamera(s, points[p].x, points[p].y, points[p].z, x, y, z);
+				scores[p * size() + index[s]] = fisheye(x, y, z, cosFov[s]);
+			}
+		}
+	}
+
+#if defined(CAMERA_TABLE_SSE2) || defined(CAMERA_TABLE_NEON)
+	void loadView(int s, /*out*/ Float4 m[3][4]) const {
+		for (int r = 0; r < 3; r++) {
+			for (int c = 0; c < 4; c++) {
+				m[r][c] = Float4::load(&view[r][c][s]);
+			}
+		}
+	}
+
+	static void toCamera(const Float4 m[3][4], const glm::vec3& point, /*out*/ Float4& x, /*out*/ Float4& y, /*out*/ Float4& z) {
+		Float4 px = Float4::set(point.x);
+		Float4 py = Float4::set(point.y);
+		Float4 pz = Float4::set(point.z);
+		x = (m[0][0] * px + m[0][1] * py) + (m[0][2] * pz + m[0][3]);
+		y = (m[1][0] * px + m[1][1] * py) + (m[1][2] * pz + m[1][3]);
+		z = (m[2][0] * px + m[2][1] * py) + (m[2][2] * pz + m[2][3]);
+	}
+
+	static Float4 cosAngle(Float4 x, Float4 y, Float4 z) {
+		return -(z * (Float4::set(1.0f) / Float4::sqrt((x * x + y * y) + z * z)));
+	}
+#endif
+};
+
+#endif
@@ -3,7 +3,13 @@
 
 
 #include "ioHelper.h"
+#include "CameraIndex.h"
+#include "CameraTable.h"
+#include "SelectionGrid.h"
 #include <unordered_set>
+#include <numeric>
+#include <memory>
+#include <chrono>
 
 enum OutputCameraType {
 	PERSPECTIVE, ERP180, ERP360
@@ -58,7 +64,27 @@ public:
 
 // Takes care of which InputCameras need to be used
 // to contruct the output image based on the
-// position and rotation of the OutputCamera
+// position and rotation of the OutputCamera.
+// A CameraTable scores the InputCameras for the points that should be seen:
+// all of them at once for small rigs, and with many InputCameras,
+// only those that a CameraIndex finds near the points.
+// updateInputsToUse() can keep the choice stable while the OutputCamera
+// moves a little, see setTemporalCoherence().
+// With a SelectionGrid (see useSelectionGrid()), only the InputCameras that were
+// selected for the viewpoints around the OutputCamera are scored.
+// Instead of making sure the center and the corners are seen, the selection can
+// also cover as much as possible of a denser grid of points, see useCoverage()
+//
+// selectInputsByViewingAngles() defines the selection for the center and the corners.
+// For a corner that no InputCamera sees, it picks the first InputCamera in rank of those within 0.0001 of the
+// best heuristic. The original scan instead took the last one in rank that beat the best heuristic so far by
+// more than 0.0001, which depends on every InputCamera before it and so cannot be answered by cameraIndex.
+// Both pick an InputCamera within 0.0001 of the best, but near ties they can pick different ones.
+// selectInputsByScores() follows the same rules as selectInputsByViewingAngles(), it only computes the rank in another way.
+// selectInputsFromGrid() gives the same InputCameras when the ones that should be selected are among the
+// candidates of the grid, which holds for poses between the viewpoints of the grid but is not guaranteed.
+// selectInputsByCoverage() has another goal and only uses the same rank to break ties and fill up.
+// selectInputsByDistance() is the selection for 360 degree InputCameras.
 class CameraVisibilityHelper {
 private:
 	std::vector<InputCamera> inputCameras;
@@ -66,6 +92,57 @@ private:
 	int maxNrInputsUsed = 0;
 	std::unordered_set<int> inputsToUse; // indices of InputCameras to be used to render the next output image
 	std::vector<glm::vec4> pointsThatShouldBeSeen;
+	CameraTable cameraTable;
+
+	// the temporal coherence of updateInputsToUse(), see setTemporalCoherence()
+	float hysteresis = 0.0f;
+	int maxSwitchesPerUpdate = -1;
+	int minDwellUpdates = 0;
+	float inUseBonus = 0.0f;                 // hysteresis while updateInputsToUse() selects, 0 otherwise
+	std::vector<int> updatesInUse;           // per InputCamera, for how many updates it has been in inputsToUse
+	std::unordered_set<int> selected;        // what selectInputs() picked for updateInputsToUse()
+	std::vector<int> picked;                 // idem, in order of priority
+	std::vector<int> fill;                   // the InputCameras that may fill up the selection
+	bool isDistanceBased = false;            // if the last selectInputs() ranked by distance instead of angle
+	bool isRankedByScores = false;           // if the last selectInputs() ranked with scores and cosines instead of angleToForwardPoint()
+	glm::vec3 viewerPosition;
+
+	// the state of selectInputsByScores()
+	const float cosOfAngle1 = std::cos(1.0f);
+	std::vector<glm::vec3> points;           // pointsThatShouldBeSeen in world space
+	std::vector<float> scores;               // scores[p * inputCameras.size() + i] of InputCamera i for points[p]
+	std::vector<float> cosines;              // the cosine of the angle between vectors PO and PI of every InputCamera, see isScoredBefore()
+
+	// the state of selectInputsByViewingAngles(), which only looks at the InputCameras it needs
+	CameraIndex cameraIndex;
+	bool useCameraIndex = false;
+	glm::vec3 forwardPoint;
+	glm::vec3 forwardPO;
+	std::vector<float> anglesToForwardPoint; // per InputCamera, valid if isAngleKnown
+	std::vector<bool> isAngleKnown;
+	std::vector<int> knownAngles;            // the InputCameras with isAngleKnown, to reset them
+	std::vector<int> ranked;                 // the first InputCameras in rank with an angle below 1
+	bool isRankedComplete = false;           // if ranked holds all InputCameras with an angle below 1
+	std::vector<int> order;                  // all InputCameras in rank, only if needed
+	std::vector<int> candidates;             // reused by the queries of cameraIndex
+	std::vector<std::pair<float, int>> highestHeuristics;
+
+	// the state of selectInputsByCoverage()
+	bool isCoverageUsed = false;
+	float coverageBudgetMs = 2.0f;
+	int coverageSamplesPerSide = 0;
+	int coverageOverruns = 0;                // the number of updates in a row in which scoring took more than half of coverageBudgetMs
+	float coverageScoringMs = 0.0f;          // the fastest of those
+	std::vector<glm::vec4> coveragePoints;   // the forward point of pointsThatShouldBeSeen, followed by the samples to cover
+	std::vector<float> covered;              // per sample, the highest coverage() by the InputCameras selected so far
+	std::vector<float> coverageValues;       // per InputCamera that covers any sample, coverage() of every sample
+	std::vector<size_t> coverageRows;        // per InputCamera, where its coverage starts in coverageValues
+	std::vector<std::pair<float, int>> coverageGains; // (upper bound on the gain, InputCamera) of the InputCameras that can still add coverage
+
+	// the state of selectInputsFromGrid()
+	std::shared_ptr<SelectionGrid> selectionGrid;
+	std::vector<int> gridCandidates;         // in rank
+	std::vector<float> gridHeuristics;
 
 public:
 	CameraVisibilityHelper() {}
@@ -74,6 +151,10 @@ public:
 		this->inputCameras = inputCameras;
 		this->outputCamera = outputCamera;
 		this->maxNrInputsUsed = maxNrInputsUsed;
+		inputsToUse.clear();
+		updatesInUse.assign(inputCameras.size(), 0);
+		selectionGrid.reset();
+		isCoverageUsed = false;
 
 		if (inputCameras.size() <= maxNrInputsUsed) {
 			// All InputCameras can be used
@@ -85,24 +166,150 @@ public:
 			// Only a subset of all InputCameras can be used.
 			// calculatePointsThatShouldBeSeen() prepares for updateInputsToUsePerspective()
 			calculatePointsThatShouldBeSeen(inputCameras[0].z_near + 3.0f, outputCamera->FOV_x, outputCamera->FOV_y);
+			// the forward point needs a heuristic above 0.99, the corners 1
+			cameraTable.build(inputCameras);
+			points.resize(pointsThatShouldBeSeen.size());
+			scores.resize(pointsThatShouldBeSeen.size() * inputCameras.size());
+			cosines.resize(inputCameras.size());
+			// Scoring all InputCameras in one pass is faster, except for large rigs of fisheye or equirectangular cameras:
+			// their visibility cones in cameraIndex are tight, the cones around the wide images of perspective cameras are not
+			useCameraIndex = inputCameras.size() > 64 && inputCameras[0].projection != Projection::Perspective;
+			// selectInputsByDistance() also needs cameraIndex, useSelectionGrid() builds it if it adds a grid
+			cameraIndex = CameraIndex();
+			if (useCameraIndex || isSelectedByDistance()) {
+				cameraIndex.build(inputCameras, 0.99f);
+			}
+			anglesToForwardPoint.assign(inputCameras.size(), 1.0f);
+			isAngleKnown.assign(inputCameras.size(), false);
 		}
 	}
 
-	std::unordered_set<int> updateInputsToUse() {
-		if (inputCameras.size() <= maxNrInputsUsed) {
-			return inputsToUse;
+	// By default, every update chooses the inputs for the current pose from scratch, so small motions of the OutputCamera
+	// near a decision boundary make inputs flip in and out. To make the choice coherent over time:
+	// - hysteresis: an input that is in use ranks this much better than it is, i.e. hysteresis radians for the
+	//   angle to the forward point, hysteresis for the heuristic of a corner, and hysteresis for the distance to
+	//   360 degree inputs (in the unit of the positions), so another input has to be clearly better to replace it
+	//   (with useCoverage(), an input in use adds hysteresis more of the view)
+	// - maxSwitchesPerUpdate: if >= 0, at most this many inputs in use are replaced per update,
+	//   the inputs with the highest priority first
+	// - minDwellUpdates: an input stays in use for at least this many updates
+	void setTemporalCoherence(float hysteresis, int maxSwitchesPerUpdate, int minDwellUpdates) {
+		this->hysteresis = hysteresis;
+		this->maxSwitchesPerUpdate = maxSwitchesPerUpdate;
+		this->minDwellUpdates = minDwellUpdates;
+	}
+
+	// Selects the InputCameras that together see most of the view (see selectInputsByCoverage()), sampled by a grid of
+	// samplesPerSide x samplesPerSide points over the image of the OutputCamera at 3 depths around the one of
+	// pointsThatShouldBeSeen. If the greedy choice takes more than budgetMs, the rest is filled up in rank.
+	// Scoring every InputCamera for every sample cannot stop halfway, so if it takes more than half of budgetMs
+	// here or in 3 updates in a row, fewer samples are used from then on, and if even 2 x 2 samples take too long,
+	// the InputCameras are selected as without useCoverage().
+	// Not for 360 degree InputCameras, which all see the whole view.
+	void useCoverage(int samplesPerSide, float budgetMs) {
+		if (inputCameras.size() <= maxNrInputsUsed || isSelectedByDistance()) {
+			return;
 		}
-		if (inputCameras[0].projection == Projection::Equirectangular && inputCameras[0].hor_range.y - inputCameras[0].hor_range.x > 3.14f) {
-			// 360 degree cameras see everything, so make a choice based on closest InputCamera
-			updateInputsToUseByDistance();
+		isCoverageUsed = true;
+		coverageBudgetMs = budgetMs;
+		coverageOverruns = 0;
+		placeCoverageSamples(samplesPerSide);
+		auto start = std::chrono::steady_clock::now();
+		scorePoints(outputCamera->model, coveragePoints);
+		coverageScoringMs = std::chrono::duration<float, std::milli>(std::chrono::steady_clock::now() - start).count();
+		if (coverageScoringMs > 0.5f * coverageBudgetMs) {
+			reduceCoverageSamples();
+		}
+	}
+
+	// Opens the SelectionGrid of the rig next to jsonPath, or builds it (with resolution nodes along the longest side,
+	// see SelectionGrid::layout()) and writes it there, so later runs skip the precompute.
+	// Only for rigs where every InputCamera is scored, i.e. not for rigs that are already selected through
+	// cameraIndex (see init()) or by distance (360 degree InputCameras).
+	void useSelectionGrid(const std::string& jsonPath, int resolution) {
+		if (inputCameras.size() <= maxNrInputsUsed || useCameraIndex || isSelectedByDistance()) {
+			std::cout << "Option --selection_grid is ignored, the inputs to use are already selected without scoring all of them" << std::endl;
+			return;
+		}
+		SelectionGrid::Header layout;
+		if (!SelectionGrid::layout(jsonPath, inputCameras, maxNrInputsUsed, outputCamera->FOV_x, outputCamera->FOV_y, resolution, layout)) {
+			std::cout << "Warning: no selection grid can be made for " << jsonPath << std::endl;
+			return;
+		}
+		std::string path = SelectionGrid::sidecarPath(jsonPath);
+		std::shared_ptr<SelectionGrid> grid = std::make_shared<SelectionGrid>();
+		if (grid->open(path, layout)) {
+			std::cout << "Using selection grid " << path << " (" << grid->nrViewpoints() << " viewpoints)" << std::endl;
 		}
 		else {
-			updateInputsToUseByViewingAngles();
+			// every thread selects with its own copy of this CameraVisibilityHelper (without grid)
+			selectionGrid.reset();
+			int nrThreads = std::max(1, (int)std::thread::hardware_concurrency());
+			std::vector<CameraVisibilityHelper> helpers(nrThreads, *this);
+			std::vector<std::function<void(const glm::mat4&, std::vector<int>&)>> selectors;
+			for (int t = 0; t < nrThreads; t++) {
+				CameraVisibilityHelper* helper = &helpers[t];
+				selectors.push_back([helper](const glm::mat4& model, std::vector<int>& selection) {
+					helper->selectInputs(model, helper->selected);
+					selection.assign(helper->picked.begin(), helper->picked.end());
+				});
+			}
+			auto start = std::chrono::steady_clock::now();
+			grid->build(path, layout, selectors);
+			long long ms = std::chrono::duration_cast<std::chrono::milliseconds>(std::chrono::steady_clock::now() - start).count();
+			std::cout << "Built selection grid " << path << " (" << grid->nrViewpoints() << " viewpoints) in " << ms << " ms on " << nrThreads << " threads" << std::endl;
 		}
+		// selectInputs() adds the InputCameras nearest to the OutputCamera to the ones of the grid
+		cameraIndex.build(inputCameras, 0.99f);
+		selectionGrid = grid;
+	}
+
+	std::unordered_set<int> updateInputsToUse() {
+		if (inputCameras.size() <= maxNrInputsUsed) {
+			return inputsToUse;
+		}
+		inUseBonus = hysteresis;
+		selectInputs(outputCamera->model, selected);
+		inUseBonus = 0.0f;
+		updateInputsInUse();
 		return inputsToUse;
 	}
 
+	// the inputs that would be used if the OutputCamera had the given model matrix, e.g. a predicted pose
+	// selected as without useCoverage(), the coverage budget is only spent on the pose that is rendered
+	std::unordered_set<int> inputsToUseFor(const glm::mat4& model) {
+		if (inputCameras.size() <= maxNrInputsUsed) {
+			return inputsToUse;
+		}
+		std::unordered_set<int> result;
+		selectInputs(model, result, false);
+		return result;
+	}
+
 private:
+	// the forward point of pointsThatShouldBeSeen, followed by samplesPerSide x samplesPerSide samples at 3 depths
+	void placeCoverageSamples(int samplesPerSide) {
+		coverageSamplesPerSide = samplesPerSide;
+		float x_right = std::tan(outputCamera->FOV_x / 2.0f);
+		float y_top = std::tan(outputCamera->FOV_y / 2.0f);
+		float depth = inputCameras[0].z_near + 3.0f;
+		coveragePoints.clear();
+		coveragePoints.push_back(pointsThatShouldBeSeen[0]);
+		for (float sampleDepth : { 0.5f * depth, depth, 2.0f * depth }) {
+			for (int v = 0; v < samplesPerSide; v++) {
+				for (int u = 0; u < samplesPerSide; u++) {
+					float x = x_right * (2.0f * u / (samplesPerSide - 1) - 1.0f);
+					float y = y_top * (2.0f * v / (samplesPerSide - 1) - 1.0f);
+					coveragePoints.push_back(glm::vec4(x * sampleDepth, y * sampleDepth, -sampleDepth, 1));
+				}
+			}
+		}
+		covered.resize(coveragePoints.size() - 1);
+		coverageRows.resize(inputCameras.size());
+		points.resize(std::max(pointsThatShouldBeSeen.size(), coveragePoints.size()));
+		scores.resize(points.size() * inputCameras.size());
+	}
+
 	void calculatePointsThatShouldBeSeen(float depth, float FOV_x, float FOV_y) {
 		// Here we define 5 points in the axial system of the output camera,
 		// all at zdepth = depth:
@@ -125,140 +332,573 @@ private:
 		pointsThatShouldBeSeen.push_back(glm::vec4(x_left * depth, y_bottom * depth, -depth, 1));  // bottom left
 	}
 
-	// the closer the returned float is to 1, the closer the input is to seeing the point
-	// returns a value in [0,1]
-	float inputCameraSeesPoint(InputCamera input, glm::vec3 point) {
-		// get the position of P in the axial system of the InputCamera
-		glm::vec3 IP = glm::vec3(input.view * glm::vec4(point, 1));
+	// the closer the returned float is to 1, the closer InputCamera i is to seeing the point
+	// returns a value in [0,1], see CameraTable
+	float inputCameraSeesPoint(int i, const glm::vec3& point) {
+		return cameraTable.score(i, point);
+	}
 
-		// --- PERSPECTIVE ---
-		if (input.projection == Projection::Perspective) {
-			// check if P is behind the near plane of the InputCamera
-			if (IP.z > -0.1f) {
-				//return false;
-				return 0.0f;
-			}
-			// In essence, we will project P onto the image plane of the InputCamera
-			// If the projection is not in [-1,1], P is outside the image.
-			// The heuristics will be 1 if the projection is inside the image or
-			// will go to zero the further the projection is from the edge of the image.
-			IP = -IP / IP.z;
-			float heuristicx = 1;
-			float heuristicy = 1;
+	void selectInputs(const glm::mat4& model, std::unordered_set<int>& result, bool mayUseCoverage = true) {
+		picked.clear();
+		isDistanceBased = isSelectedByDistance();
+		isRankedByScores = false;
+		if (isDistanceBased) {
+			// 360 degree cameras see everything, so make a choice based on closest InputCamera
+			selectInputsByDistance(model, result);
+		}
+		else if (isCoverageUsed && mayUseCoverage) {
+			isRankedByScores = true;
+			selectInputsByCoverage(model, result);
+		}
+		else if (selectionGrid && selectionGrid->lookup(model, gridCandidates)) {
+			// the grid stores the best InputCameras for directions that can be a few degrees off,
+			// the ones closest to the OutputCamera are usually among the best for its own direction
+			cameraIndex.nearest(glm::vec3(model[3]), maxNrInputsUsed, candidates);
+			gridCandidates.insert(gridCandidates.end(), candidates.begin(), candidates.end());
+			std::sort(gridCandidates.begin(), gridCandidates.end());
+			gridCandidates.erase(std::unique(gridCandidates.begin(), gridCandidates.end()), gridCandidates.end());
+			selectInputsFromGrid(model, result);
+		}
+		else if (useCameraIndex) {
+			selectInputsByViewingAngles(model, result);
+		}
+		else {
+			isRankedByScores = true;
+			selectInputsByScores(model, result);
+		}
+	}
 
-			if (IP.y < -(input.res_y - input.principal_point_y) / input.focal_y) {
-				heuristicy = -(input.res_y - input.principal_point_y) / input.focal_y / IP.y;
+	bool isSelectedByDistance() const {
+		return inputCameras[0].projection == Projection::Equirectangular && inputCameras[0].hor_range.y - inputCameras[0].hor_range.x > 3.14f;
+	}
+
+	// The same selection as selectInputsByViewingAngles(), but every InputCamera is scored for every point in one pass of cameraTable
+	void selectInputsByScores(const glm::mat4& model, std::unordered_set<int>& result) {
+		result.clear();
+		int n = (int)inputCameras.size();
+		scorePoints(model, pointsThatShouldBeSeen);
+
+		// for each corner, the first InputCamera in rank that sees it
+		for (int p = 1; p < pointsThatShouldBeSeen.size(); p++) {
+			const float* heuristics = &scores[p * n];
+			int first_index = -1;
+			float best_heuristic = 0.0001f;
+			for (int i = 0; i < n; i++) {
+				if (heuristics[i] == 1 && (first_index == -1 || isScoredBefore(i, first_index))) {
+					first_index = i;
+				}
+				best_heuristic = std::max(best_heuristic, heuristics[i]);
 			}
-			else if (IP.y > input.principal_point_y / input.focal_y) {
-				heuristicy = input.principal_point_y / input.focal_y / IP.y;
+			if (first_index == -1) {
+				// use the InputCamera that is closest to beeing able to see the point,
+				// the first in rank of those within 0.0001 of the best heuristic
+				for (int i = 0; i < n; i++) {
+					if (heuristics[i] > 0.0001f && heuristics[i] >= best_heuristic - 0.0001f && (first_index == -1 || isScoredBefore(i, first_index))) {
+						first_index = i;
+					}
+				}
+			}
+			if (first_index != -1) {
+				pick(preferInUse(first_index, points[p]), result);
+			}
+			if (result.size() == maxNrInputsUsed) {
+				break;
 			}
-			if (IP.x < -input.principal_point_x / input.focal_x) {
-				heuristicx = -input.principal_point_x / input.focal_x / IP.x;
+		}
+
+		fillUpByScores(result);
+	}
+
+	// Scores every InputCamera for the points (in the space of the OutputCamera), the first of which is the forward point,
+	// and prepares the rank of isScoredBefore()
+	void scorePoints(const glm::mat4& model, const std::vector<glm::vec4>& cameraSpacePoints) {
+		int n = (int)inputCameras.size();
+		for (int p = 0; p < cameraSpacePoints.size(); p++) {
+			points[p] = glm::vec3(model * cameraSpacePoints[p]);
+		}
+		cameraTable.scoreAll(points.data(), (int)cameraSpacePoints.size(), scores.data());
+		forwardPoint = points[0];
+		forwardPO = glm::normalize(glm::vec3(model[3]) - forwardPoint);
+		cameraTable.cosinesTo(forwardPoint, forwardPO, cosines.data());
+		for (int i = 0; i < n; i++) {
+			// InputCameras that do not see the forward point get angle 1
+			cosines[i] = scores[i] > 0.99f ? std::min(cosines[i], 1.0f) : cosOfAngle1;
+		}
+	}
+
+	// fill up with the first InputCameras in rank, only the first maxNrInputsUsed need to be sorted
+	void fillUpByScores(std::unordered_set<int>& result) {
+		int n = (int)inputCameras.size();
+		if (result.size() < maxNrInputsUsed) {
+			order.resize(n);
+			std::iota(order.begin(), order.end(), 0);
+			std::partial_sort(order.begin(), order.begin() + maxNrInputsUsed, order.end(), [this](int a, int b) {
+				return isScoredBefore(a, b);
+			});
+			fill.clear();
+			for (int j = 0; j < maxNrInputsUsed; j++) {
+				if (result.find(order[j]) == result.end()) {
+					fill.push_back(order[j]);
+				}
+			}
+			fillUp(result);
+		}
+	}
+
+	// Whether InputCamera a comes before b in rank, i.e. if (angle, index) of a is smaller (see selectInputsByViewingAngles()).
+	// The angle only goes up as its cosine goes down, and differs at least as much, so the angles themselves
+	// are only needed for cosines that are nearly the same.
+	bool isScoredBefore(int a, int b) const {
+		if (cosines[a] > cosines[b] + 1e-5f) {
+			return true;
+		}
+		if (cosines[b] > cosines[a] + 1e-5f) {
+			return false;
+		}
+		return std::tuple<float, int>(scoredAngle(a), a) < std::tuple<float, int>(scoredAngle(b), b);
+	}
+
+	float scoredAngle(int i) const {
+		return scores[i] > 0.99f ? acos(cosines[i]) : 1.0f;
+	}
+
+	// Greedy weighted maximum coverage of coveragePoints: every sample stands for an equal part of the view, and is
+	// covered by an InputCamera as much as coverage() of its heuristic for the sample. Each step picks the InputCamera that adds the
+	// most coverage (the first in rank if several add about as much), until no InputCamera adds any, maxNrInputsUsed
+	// are picked or coverageBudgetMs is spent. The rest is filled up in rank.
+	// Since the gain of an InputCamera only goes down as others are picked, its last gain is an upper bound,
+	// so each step only recomputes the gains that can still beat the best one so far.
+	void selectInputsByCoverage(const glm::mat4& model, std::unordered_set<int>& result) {
+		auto start = std::chrono::steady_clock::now();
+		result.clear();
+		int n = (int)inputCameras.size();
+		int nrSamples = (int)covered.size();
+		float weight = 1.0f / nrSamples;
+		scorePoints(model, coveragePoints);
+		std::fill(covered.begin(), covered.end(), 0.0f);
+
+		// the coverage of the samples by the InputCameras that cover any, one row per InputCamera
+		// (first marked in coverageRows in the order of scores, which is faster than by row)
+		std::fill(coverageRows.begin(), coverageRows.end(), 0);
+		for (int p = 0; p < nrSamples; p++) {
+			const float* heuristics = &scores[(p + 1) * n];
+			for (int i = 0; i < n; i++) {
+				coverageRows[i] |= heuristics[i] > 0.0f;
 			}
-			else if (IP.x > (input.res_x - input.principal_point_x) / input.focal_x) {
-				heuristicx = (input.res_x - input.principal_point_x) / input.focal_x / IP.x;
+		}
+		coverageGains.clear();
+		coverageValues.clear();
+		for (int i = 0; i < n; i++) {
+			if (coverageRows[i] > 0) {
+				coverageRows[i] = coverageValues.size();
+				coverageValues.resize(coverageValues.size() + nrSamples);
+				float gain = 0.0f;
+				for (int p = 0; p < nrSamples; p++) {
+					coverageValues[coverageRows[i] + p] = coverage(scores[(p + 1) * n + i]);
+					gain += coverageValues[coverageRows[i] + p];
+				}
+				coverageGains.push_back(std::make_pair(gain * weight, i));
 			}
-			return (heuristicx + heuristicy) / 2.0f;
 		}
-		// --- EQUIRECTANGULAR ---
-		else if (input.projection == Projection::Equirectangular) {
-			float angle = dot(glm::normalize(IP), glm::vec3(0, 0, -1)); // actually cosine of angle
-			if (angle < 0) {
-				return 1 + angle;
+		float scoringMs = std::chrono::duration<float, std::milli>(std::chrono::steady_clock::now() - start).count();
+
+		while (result.size() < maxNrInputsUsed && !coverageGains.empty()) {
+			std::sort(coverageGains.begin(), coverageGains.end(), [](const std::pair<float, int>& a, const std::pair<float, int>& b) {
+				return a.first > b.first;
+			});
+			int best = -1;
+			float bestGain = 0.0f;
+			for (auto& gain_index_pair : coverageGains) {
+				if (gain_index_pair.first < bestGain - 1e-6f) {
+					break;
+				}
+				int i = gain_index_pair.second;
+				gain_index_pair.first = coverageGain(i, weight);
+				if (gain_index_pair.first > bestGain + 1e-6f
+					|| (gain_index_pair.first >= bestGain - 1e-6f && gain_index_pair.first > 0.0f && (best == -1 || isScoredBefore(i, best)))) {
+					best = i;
+					bestGain = std::max(bestGain, gain_index_pair.first);
+				}
+			}
+			if (best == -1) {
+				break;
 			}
-			return 1;
+			pick(best, result);
+			const float* values = &coverageValues[coverageRows[best]];
+			for (int p = 0; p < nrSamples; p++) {
+				covered[p] = std::max(covered[p], values[p]);
+			}
+			coverageGains.erase(std::remove_if(coverageGains.begin(), coverageGains.end(), [best](const std::pair<float, int>& a) {
+				return a.second == best || a.first <= 0.0f;
+			}), coverageGains.end());
+			if (std::chrono::duration<float, std::milli>(std::chrono::steady_clock::now() - start).count() > coverageBudgetMs) {
+				break;
+			}
+		}
+		fillUpByScores(result);
+
+		if (scoringMs <= 0.5f * coverageBudgetMs) {
+			coverageOverruns = 0;
 		}
-		// --- FISHEYE_EQUIDISTANT ---
 		else {
-			float angle = dot(glm::normalize(IP), glm::vec3(0, 0, -1)); // actually cosine of angle
-			float fov_angle = cos(input.fov);
-			if (angle < fov_angle) {
-				return 1 + angle - fov_angle;
+			coverageScoringMs = coverageOverruns == 0 ? scoringMs : std::min(coverageScoringMs, scoringMs);
+			if (++coverageOverruns == 3) {
+				reduceCoverageSamples();
 			}
-			return 1;
 		}
-		return 1;
 	}
 
-	void updateInputsToUseByViewingAngles() {
+	// Uses as many samples as can be scored in half of coverageBudgetMs, judging by coverageScoringMs,
+	// or stops using coverage if that is less than 2 x 2
+	void reduceCoverageSamples() {
+		float msPerPoint = coverageScoringMs / coveragePoints.size();
+		int fitting = coverageSamplesPerSide - 1;
+		while (fitting >= 2 && (1 + 3 * fitting * fitting) * msPerPoint > 0.5f * coverageBudgetMs) {
+			fitting--;
+		}
+		coverageOverruns = 0;
+		if (fitting < 2) {
+			std::cout << "Warning: scoring the inputs for --coverage_selection takes longer than half of --coverage_budget, "
+				<< "the inputs are chosen as without --coverage_selection from now on" << std::endl;
+			isCoverageUsed = false;
+		}
+		else {
+			std::cout << "Warning: scoring the inputs for --coverage_selection " << coverageSamplesPerSide << " takes longer than half of --coverage_budget, "
+				<< "using --coverage_selection " << fitting << " from now on" << std::endl;
+			placeCoverageSamples(fitting);
+		}
+	}
 
+	// A sample is only covered if it is seen (heuristic 1), being close to seeing it only counts a little,
+	// so that the samples nobody sees still go to the InputCamera that is closest to seeing them
+	static float coverage(float heuristic) {
+		return heuristic == 1 ? 1.0f : 0.1f * heuristic;
+	}
 
-		inputsToUse.clear();
-		// fill anglesToForwardPoint with the (cosine of the) angle between vectors PO and PI
-		// with P = forward point pointsThatShouldBeSeen[0], O = OutputCamera, I = InputCamera
-		std::vector<std::tuple<float, int>> anglesToForwardPoint;
-		glm::vec3 P = outputCamera->model * pointsThatShouldBeSeen[0];
-		glm::vec3 PO = glm::normalize(glm::vec3(outputCamera->model[3]) - P);
-		for (int i = 0; i < inputCameras.size(); i++) {
-			// check if point lies in the field of view of the input camera
-			if (inputCameraSeesPoint(inputCameras[i], P) > 0.99f) {
-				glm::vec3 PI = glm::normalize(inputCameras[i].pos - P);
-				float angle = acos(std::min(dot(PO, PI), 1.0f));
-				anglesToForwardPoint.push_back(std::tuple<float, int>(angle, i));
+	// how much coverage InputCamera i would add, plus inUseBonus if it is in use and adds any
+	float coverageGain(int i, float weight) const {
+		const float* values = &coverageValues[coverageRows[i]];
+		float gain = 0.0f;
+		for (int p = 0; p < covered.size(); p++) {
+			gain += std::max(0.0f, values[p] - covered[p]);
+		}
+		gain *= weight;
+		return gain > 0.0f && isInUse(i) ? gain + inUseBonus : gain;
+	}
+
+	void selectInputsByViewingAngles(const glm::mat4& model, std::unordered_set<int>& result) {
+		result.clear();
+		// The InputCameras are ranked by the angle between vectors PO and PI,
+		// with P = forward point pointsThatShouldBeSeen[0], O = OutputCamera, I = InputCamera.
+		// InputCameras that do not see P get angle 1, and ties keep the order of the indices,
+		// i.e. the rank of InputCamera i is that of (angleToForwardPoint(i), i).
+		// cameraIndex returns the InputCameras that see P from small to large angle,
+		// so only the first ones in rank need to be looked at.
+		startRanking(model);
+		cameraIndex.startByAngle(forwardPoint, 0.99f, forwardPO, 1.0f);
+
+		// for each corner (i.e. the rest of pointsThatShouldBeSeen), try to find an InputCamera that sees it
+		for (int i = 1; i < pointsThatShouldBeSeen.size(); i++) {
+			glm::vec3 P = model * pointsThatShouldBeSeen[i];
+			int first_index = firstInRankThatSees(P);
+			if (first_index == -1) {
+				// use the InputCamera that is closest to beeing able to see the point,
+				// the first in rank of those within 0.0001 of the best heuristic
+				highestHeuristics.clear();
+				cameraIndex.highestHeuristics(P, 0.0001f, 0.0001f, [this, &P](int index) {
+					return inputCameraSeesPoint(index, P);
+				}, highestHeuristics);
+				for (auto& heuristic_index_pair : highestHeuristics) {
+					if (first_index == -1 || isRankedBefore(heuristic_index_pair.second, first_index)) {
+						first_index = heuristic_index_pair.second;
+					}
+				}
 			}
-			else {
-				// default the (cosine of the) angle to 1
-				anglesToForwardPoint.push_back(std::tuple<float, int>(1.0f, i));
+			if (first_index != -1) {
+				pick(preferInUse(first_index, P), result);
 			}
+			if (result.size() == maxNrInputsUsed) {
+				break;
+			}
+		}
 
+		// now, result can have up to 4 indices of InputCameras to use to render the output
+		// so if result.size() < maxNrInputsUsed, we can add some more, in order of rank:
+		// the InputCameras with an angle below 1, then those with angle 1 by index, then the rest
+		int nrToFill = maxNrInputsUsed - (int)result.size();
+		fill.clear();
+		for (int j = 0; fill.size() < nrToFill && rankedWithAngleBelow1(j) != -1; j++) {
+			if (result.find(ranked[j]) == result.end()) {
+				fill.push_back(ranked[j]);
+			}
+		}
+		for (int i = 0; i < inputCameras.size() && fill.size() < nrToFill; i++) {
+			if (angleToForwardPoint(i) == 1.0f && result.find(i) == result.end()) {
+				fill.push_back(i);
+			}
+		}
+		if (fill.size() < nrToFill) {
+			for (int index : rankedInputCameras()) {
+				if (fill.size() < nrToFill && angleToForwardPoint(index) > 1.0f && result.find(index) == result.end()) {
+					fill.push_back(index);
+				}
+			}
 		}
+		fillUp(result);
+	}
+
+	// forgets the angles of the previous pose
+	void startRanking(const glm::mat4& model) {
+		for (int i : knownAngles) {
+			isAngleKnown[i] = false;
+		}
+		knownAngles.clear();
+		ranked.clear();
+		isRankedComplete = false;
+		order.clear();
+		forwardPoint = model * pointsThatShouldBeSeen[0];
+		forwardPO = glm::normalize(glm::vec3(model[3]) - forwardPoint);
+	}
 
-		// sort anglesToForwardPoint from smallest angle to largest
-		std::stable_sort(anglesToForwardPoint.begin(), anglesToForwardPoint.end(), [](std::tuple<float, int> a, std::tuple<float, int> b) {
-			return std::get<0>(a) < std::get<0>(b);
+	// The same selection as selectInputsByViewingAngles(), but only among gridCandidates:
+	// the InputCameras that selectionGrid stores for the viewpoints around the OutputCamera.
+	// If no candidate comes close to seeing a corner, selectInputsByScores() makes the selection instead.
+	void selectInputsFromGrid(const glm::mat4& model, std::unordered_set<int>& result) {
+		result.clear();
+		startRanking(model);
+		std::sort(gridCandidates.begin(), gridCandidates.end(), [this](int a, int b) {
+			return isRankedBefore(a, b);
 		});
 
-		// for each corner (i.e. the rest of pointsThatShouldBeSeen), try to find an InputCamera that sees it
-		for (int i = 1; i < pointsThatShouldBeSeen.size(); i++) {
-			float best_heuristic = 0.0f;
-			int best_index = -1;
-			bool foundInputCameraThatSeesP = false;
-			glm::vec3 P = outputCamera->model * pointsThatShouldBeSeen[i];
-			for (auto& angle_index_tuple : anglesToForwardPoint) {
-				float heuristic = inputCameraSeesPoint(inputCameras[std::get<1>(angle_index_tuple)], P);
-				if (heuristic == 1) {
-					inputsToUse.insert(std::get<1>(angle_index_tuple));
-					foundInputCameraThatSeesP = true;
+		for (int p = 1; p < pointsThatShouldBeSeen.size(); p++) {
+			glm::vec3 P = model * pointsThatShouldBeSeen[p];
+			// gridCandidates are in rank, so use the first one that sees P
+			int first_index = -1;
+			float best_heuristic = 0.0001f;
+			gridHeuristics.clear();
+			for (int index : gridCandidates) {
+				gridHeuristics.push_back(inputCameraSeesPoint(index, P));
+				if (gridHeuristics.back() == 1) {
+					first_index = index;
 					break;
 				}
-				if (heuristic > best_heuristic + 0.0001f) {
-					best_heuristic = heuristic;
-					best_index = std::get<1>(angle_index_tuple);
+				best_heuristic = std::max(best_heuristic, gridHeuristics.back());
+			}
+			// or else the first one within 0.0001 of the best heuristic
+			for (int j = 0; first_index == -1 && j < gridCandidates.size(); j++) {
+				if (gridHeuristics[j] > 0.0001f && gridHeuristics[j] >= best_heuristic - 0.0001f) {
+					first_index = gridCandidates[j];
 				}
 			}
+			if (first_index == -1) {
+				// none of the candidates comes close to seeing P, one of the other InputCameras may, so select without the grid
+				picked.clear();
+				isRankedByScores = true;
+				selectInputsByScores(model, result);
+				return;
+			}
+			pick(preferInUse(first_index, P), result);
+			if (result.size() == maxNrInputsUsed) {
+				break;
+			}
+		}
 
+		fill.clear();
+		for (int index : gridCandidates) {
+			if (result.find(index) == result.end()) {
+				fill.push_back(index);
+			}
+		}
+		fillUp(result);
+	}
 
-			if (!foundInputCameraThatSeesP && best_index != -1) {
-				// use the InputCamera that is closest to beeing able to see the point
-				inputsToUse.insert(best_index);
+	// the first InputCamera in rank that fully sees P, or -1
+	int firstInRankThatSees(const glm::vec3& P) {
+		// usually, one of the first InputCameras in rank sees P
+		const int nrFirst = 16;
+		int j = 0;
+		for (; j < nrFirst && rankedWithAngleBelow1(j) != -1; j++) {
+			if (inputCameraSeesPoint(ranked[j], P) == 1) {
+				return ranked[j];
 			}
-			if (inputsToUse.size() == maxNrInputsUsed) {
-				break;
+		}
+		// otherwise, only the candidates of cameraIndex can see P
+		candidates.clear();
+		cameraIndex.camerasThatMaySee(P, 1.0f, candidates);
+		int first_index = -1;
+		for (int index : candidates) {
+			if ((first_index == -1 || isRankedBefore(index, first_index)) && inputCameraSeesPoint(index, P) == 1) {
+				first_index = index;
 			}
 		}
+		return first_index;
+	}
 
-		// now, inputsToUse can have up to 4 indices of InputCameras to use to render the output
-		// so if inputsToUse.size() < maxNrInputsUsed, we can add some more
-		int i = 0;
-		while (inputsToUse.size() < maxNrInputsUsed) {
-			// unordered_set will not store duplicates
-			inputsToUse.insert(std::get<1>(anglesToForwardPoint[i]));
-			i++;
+	// the angle between vectors PO and PI if InputCamera i sees P (see selectInputsByViewingAngles()), 1 otherwise
+	float angleToForwardPoint(int i) {
+		if (!isAngleKnown[i]) {
+			isAngleKnown[i] = true;
+			knownAngles.push_back(i);
+			anglesToForwardPoint[i] = 1.0f;
+			// check if point lies in the field of view of the input camera
+			if (inputCameraSeesPoint(i, forwardPoint) > 0.99f) {
+				anglesToForwardPoint[i] = viewingAngle(i);
+			}
 		}
+		return anglesToForwardPoint[i];
 	}
 
-	void updateInputsToUseByDistance() {
-		inputsToUse.clear();
-		std::vector<int> indices(inputCameras.size());
-		std::iota(indices.begin(), indices.end(), 0); // init indices = {0, 1, 2, ..., N}
-		// sort indices from smallest to largest distance between InputCamera[index] and OutputCamera
-		std::sort(indices.begin(), indices.end(), [this](int a, int b) {
-			glm::vec3 outputPos = glm::vec3(outputCamera->model[3]);
-			return glm::length(inputCameras[a].pos - outputPos) < glm::length(inputCameras[b].pos - outputPos);
+	// the angle between vectors PO and PI, with P = forwardPoint
+	float viewingAngle(int i) {
+		glm::vec3 PI = glm::normalize(inputCameras[i].pos - forwardPoint);
+		return acos(std::min(dot(forwardPO, PI), 1.0f));
+	}
+
+	// the j-th InputCamera in rank if it has an angle below 1, -1 otherwise
+	int rankedWithAngleBelow1(int j) {
+		while (j >= ranked.size() && !isRankedComplete) {
+			int index;
+			float angle;
+			if (!cameraIndex.nextByAngle(index, angle)) {
+				isRankedComplete = true;
+			}
+			else if (angleToForwardPoint(index) < 1.0f) {
+				ranked.push_back(index);
+			}
+		}
+		return j < ranked.size() ? ranked[j] : -1;
+	}
+
+	bool isRankedBefore(int a, int b) {
+		return std::tuple<float, int>(angleToForwardPoint(a), a) < std::tuple<float, int>(angleToForwardPoint(b), b);
+	}
+
+	// all InputCameras in rank
+	const std::vector<int>& rankedInputCameras() {
+		if (order.empty()) {
+			order.resize(inputCameras.size());
+			std::iota(order.begin(), order.end(), 0);
+			std::stable_sort(order.begin(), order.end(), [this](int a, int b) {
+				return angleToForwardPoint(a) < angleToForwardPoint(b);
+			});
+		}
+		return order;
+	}
+
+	void selectInputsByDistance(const glm::mat4& model, std::unordered_set<int>& result) {
+		result.clear();
+		// the maxNrInputsUsed InputCameras closest to the OutputCamera
+		viewerPosition = glm::vec3(model[3]);
+		cameraIndex.nearest(viewerPosition, maxNrInputsUsed, fill);
+		fillUp(result);
+	}
+
+	void pick(int i, std::unordered_set<int>& result) {
+		if (result.insert(i).second) {
+			picked.push_back(i);
+		}
+	}
+
+	// how far down the ranking InputCamera i is for the pose of the last selectInputs(): its distance for 360 degree inputs,
+	// its angle to the forward point otherwise (see selectInputsByViewingAngles())
+	float rankOf(int i) {
+		if (isDistanceBased) {
+			return glm::length(glm::vec3(inputCameras[i].model[3]) - viewerPosition);
+		}
+		return isRankedByScores ? scoredAngle(i) : angleToForwardPoint(i);
+	}
+
+	bool isInUse(int i) const {
+		return inUseBonus > 0.0f && updatesInUse[i] > 0;
+	}
+
+	// the rank with hysteresis, the InputCameras in use rank inUseBonus higher
+	bool isRankedBeforeWithBonus(int a, int b) {
+		float rankA = rankOf(a) - (isInUse(a) ? inUseBonus : 0.0f);
+		float rankB = rankOf(b) - (isInUse(b) ? inUseBonus : 0.0f);
+		return std::tuple<float, int>(rankA, a) < std::tuple<float, int>(rankB, b);
+	}
+
+	// With hysteresis, an InputCamera in use is picked for corner P instead of first_index if it ranks before it
+	// with its bonus, and sees P as well (or, if first_index does not see P fully, has a heuristic at most inUseBonus lower).
+	int preferInUse(int first_index, const glm::vec3& P) {
+		if (inUseBonus <= 0.0f) {
+			return first_index;
+		}
+		float heuristic = inputCameraSeesPoint(first_index, P);
+		int result = first_index;
+		for (int i : inputsToUse) {
+			float h = inputCameraSeesPoint(i, P);
+			bool qualifies = heuristic == 1 ? h == 1 : h > 0.0001f && h >= heuristic - inUseBonus;
+			if (qualifies && isRankedBeforeWithBonus(i, result)) {
+				result = i;
+			}
+		}
+		return result;
+	}
+
+	// Adds fill, the first InputCameras in rank that are not in result, to result until it is full.
+	// With hysteresis, the InputCameras in use can come before those in fill.
+	void fillUp(std::unordered_set<int>& result) {
+		if (inUseBonus > 0.0f) {
+			for (int i : inputsToUse) {
+				if (result.find(i) == result.end() && std::find(fill.begin(), fill.end(), i) == fill.end()) {
+					fill.push_back(i);
+				}
+			}
+			std::sort(fill.begin(), fill.end(), [this](int a, int b) {
+				return isRankedBeforeWithBonus(a, b);
+			});
+		}
+		for (int j = 0; j < fill.size() && result.size() < maxNrInputsUsed; j++) {
+			pick(fill[j], result);
+		}
+	}
+
+	// Moves inputsToUse towards the selected InputCameras: all of them, unless an InputCamera that is not selected
+	// anymore has not been in use for minDwellUpdates, or more than maxSwitchesPerUpdate InputCameras would be replaced.
+	// The selected InputCameras come in in the order in which they were picked.
+	void updateInputsInUse() {
+		std::unordered_set<int> next;
+		for (int i : inputsToUse) {
+			if (selected.find(i) != selected.end() || updatesInUse[i] < minDwellUpdates) {
+				next.insert(i);
+			}
+		}
+		int nrFreeSlots = maxNrInputsUsed - (int)inputsToUse.size();
+		int nrAdded = 0;
+		for (int i : picked) {
+			if (next.size() == maxNrInputsUsed || (maxSwitchesPerUpdate >= 0 && nrAdded == nrFreeSlots + maxSwitchesPerUpdate)) {
+				break;
+			}
+			if (updatesInUse[i] == 0) {
+				next.insert(i);
+				nrAdded++;
+			}
+		}
+		// the InputCameras that could not be replaced stay, the first in rank first
+		fill.clear();
+		for (int i : inputsToUse) {
+			if (next.find(i) == next.end()) {
+				fill.push_back(i);
+			}
+		}
+		std::sort(fill.begin(), fill.end(), [this](int a, int b) {
+			return isRankedBeforeWithBonus(a, b);
 		});
-		for (int i = 0; i < maxNrInputsUsed; i++) {
-			inputsToUse.insert(indices[i]);
+		for (int j = 0; j < fill.size() && next.size() < maxNrInputsUsed; j++) {
+			next.insert(fill[j]);
+		}
+
+		for (int i : inputsToUse) {
+			if (next.find(i) == next.end()) {
+				updatesInUse[i] = 0;
+			}
+		}
+		for (int i : next) {
+			updatesInUse[i]++;
 		}
+		inputsToUse.swap(next);
 	}
 };
 
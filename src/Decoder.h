@@ -0,0 +1,59 @@
+#ifndef DECODER_H
+#define DECODER_H
+
+
+#include <GL/glew.h>
+#include <stdint.h>
+#include <stddef.h>
+
+
+/*
+* Decoder is the interface through which the Pool drives a video decoder,
+* independent of whether the decoding happens on the GPU (NvDecoder) or on the CPU (AvDecoder).
+*
+* Decode(): sends one demuxed packet to the decoder. Called by the threads of the Pool. Returns false if decoding failed.
+*           Afterwards, picture_index refers to the most recently decoded picture, or is -1 if there is none yet.
+* OutputDelay(): how many packets the decoder holds back, so picture_index is the frame of the packet sent OutputDelay() calls earlier.
+*                Until the first picture comes out, this is at least the number of packets sent so far.
+* HandlePictureDisplay(): copies a decoded picture to the OpenGL texture of the decoder. Called by the OpenGL thread.
+* SetTexture(): changes the OpenGL texture of the decoder, since textures are shared between inputs (see TexturePool).
+*               Called by the OpenGL thread. NvDecoder writes to the texture through its registration with CUDA instead,
+*               which is set with NvDecoder::SetGraphicsResource().
+*
+* Both implementations write the same layout to the texture:
+*   color: the luma plane, followed by the interleaved CbCr plane (NV12) starting at the luma height rounded up to a multiple of 16
+*   depth: only the luma plane
+* with 16-bit samples (most significant bits used) if the bit depth is larger than 8.
+*
+* Optionally, a decoder keeps a copy of every frame of a short looping video (the frame cache, see Pool):
+* EnableFrameCache(): allocates room for nrFrames frames of GetCachedFrameSize() bytes. Returns false if that is not possible.
+* CacheFrame(): copies a decoded picture to the frame cache. Called by the thread of the Pool that decodes this video.
+* DisableFrameCache(): frees the frame cache. Called by the thread of the Pool that decodes this video, before any cached frame was displayed.
+* HandlePictureDisplay(CachedPictureIndex(i)) copies cached frame i to the OpenGL texture.
+*/
+class Decoder {
+public:
+	Decoder(bool isColor) : isColor(isColor) {}
+	virtual ~Decoder() {}
+
+	virtual bool Decode(const uint8_t* pData, int nSize, int nFlags = 0, int64_t nTimestamp = 0) = 0;
+	virtual int HandlePictureDisplay(int decoded_picture_index) = 0;
+	virtual void SetTexture(GLuint texture) = 0;
+	virtual int OutputDelay() { return 0; }
+
+	virtual size_t GetCachedFrameSize() { return 0; }
+	virtual bool EnableFrameCache(int nrFrames) { return false; }
+	virtual void CacheFrame(int decoded_picture_index, int cacheIndex) {}
+	virtual void DisableFrameCache() {}
+
+	static int CachedPictureIndex(int cacheIndex) { return cachedPictureOffset + cacheIndex; }
+	static bool IsCachedPicture(int picture_index) { return picture_index >= cachedPictureOffset; }
+
+	bool isColor = true;
+	int picture_index = -1;
+
+protected:
+	static const int cachedPictureOffset = 1 << 20; // picture indices from here on refer to the frame cache
+};
+
+#endif
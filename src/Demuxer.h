@@ -0,0 +1,33 @@
+#ifndef DEMUXER_H
+#define DEMUXER_H
+
+
+#include <stdint.h>
+
+
+/*
+* Demuxer is the interface through which the Pool reads the packets of a video stream, one packet per frame,
+* independent of whether they come from a container (FFmpegDemuxer) or from a raw YUV file (RawYuvDemuxer).
+*
+* Demux(): returns the next packet, starting over at the first packet after the last one. Called by the threads of the Pool.
+*          The packet stays valid until the next call to Demux().
+* IsKeyFrame(): whether the packet returned by the last call to Demux() is a keyframe.
+* IsIntraOnly(): whether every packet is a keyframe, so a frame never depends on earlier packets.
+* GetNextPacketNr(): the number (in decode order) of the packet the next call to Demux() returns.
+* GetNrFrames(): the number of packets of the stream, call it before Demux().
+* SeekToKeyframeBefore(): positions the demuxer at the last keyframe at or before frameNr,
+*                         and returns the number of frames from there to frameNr, or -1 if seeking failed.
+*/
+class Demuxer {
+public:
+	virtual ~Demuxer() {}
+
+	virtual bool Demux(uint8_t** ppVideo, int* pnVideoBytes) = 0;
+	virtual bool IsKeyFrame() = 0;
+	virtual bool IsIntraOnly() { return false; }
+	virtual int GetNextPacketNr() = 0;
+	virtual int GetNrFrames() = 0;
+	virtual int SeekToKeyframeBefore(int frameNr) = 0;
+};
+
+#endif
@@ -17,6 +17,11 @@ extern "C" {
 #include <libavcodec/avcodec.h>
 }
 #include "NvCodecUtils.h"
+#include "StreamIndex.h"
+#include "Demuxer.h"
+#include <vector>
+#include <algorithm>
+#include <string>
 
 //---------------------------------------------------------------------------
 //! \file FFmpegDemuxer.h 
@@ -27,15 +32,22 @@ extern "C" {
 
 /**
 * @brief libavformat wrapper class. Retrieves the elementary encoded stream from the container format.
+* If useSidecarIndex is set, mp4 files are indexed once into a sidecar file (see StreamIndex).
+* When a valid sidecar exists, libavformat is skipped entirely and the packets are read directly from the file.
 */
-class FFmpegDemuxer {
+class FFmpegDemuxer : public Demuxer {
 private:
     AVFormatContext *fmtc = NULL;
     AVIOContext *avioc = NULL;
     AVPacket pkt, pktFiltered; /*!< AVPacket stores compressed data typically exported by demuxers and then passed as input to decoders */
     AVBSFContext *bsfc = NULL;
+    AVCodecParameters *codecpar = NULL;   /*!< parameters of the video stream, from libavformat or from the sidecar index */
 
-    int iVideoStream;
+    StreamIndex sidecarIndex;
+    FILE *sidecarFile = NULL;             /*!< the video file, only if packets are read through the sidecar index */
+    size_t sidecarCursor = 0;             /*!< the next packet to read through the sidecar index */
+
+    int iVideoStream = -1;
     bool bMp4H264, bMp4HEVC, bMp4MPEG4;
     AVCodecID eVideoCodec;
     AVPixelFormat eChromaFormat;
@@ -47,6 +59,13 @@ private:
 
     unsigned int frameCount = 0;
 
+    bool keyframeIndexBuilt = false;
+    bool keyframeIndexFromContainer = false;
+    std::vector<int> keyframes;               /*!< packet numbers (in decode order) of the keyframes */
+    std::vector<int64_t> keyframeTimestamps;  /*!< timestamps of the keyframes, only if keyframeIndexFromContainer */
+    int nrPackets = 0;
+    int packetNr = 0;                         /*!< the packet number (in decode order) of the next packet Demux() returns */
+
 
 public:
 
@@ -54,32 +73,70 @@ public:
     *   @brief  Private constructor to initialize libavformat resources.
     *   @param  fmtc - Pointer to AVFormatContext allocated inside avformat_open_input()
     */
-    FFmpegDemuxer(const char* szFilePath, bool printInfo = false, int64_t timeScale = 1000 /*Hz*/) {
+    FFmpegDemuxer(const char* szFilePath, bool printInfo = false, bool useSidecarIndex = false, int64_t timeScale = 1000 /*Hz*/) {
 
 		avformat_network_init();
+#if LIBAVFORMAT_VERSION_MAJOR < 58
 		av_register_all();
-		ck(avformat_open_input(&fmtc, szFilePath, NULL, NULL));
-        if (!fmtc) {
-            std::cout << "No AVFormatContext provided for " << szFilePath << ", Check if the filepath is correct" << std::endl;
-            return;
+#endif
+        codecpar = avcodec_parameters_alloc();
+        std::string formatName;
+        AVRational rTimeBase;
+
+        if (useSidecarIndex && sidecarIndex.Read(szFilePath)) {
+            sidecarFile = fopen(szFilePath, "rb");
+            if (!sidecarFile) {
+                std::cout << "Error: could not open " << szFilePath << std::endl;
+                return;
+            }
+            codecpar->codec_type = AVMEDIA_TYPE_VIDEO;
+            codecpar->codec_id = (AVCodecID)sidecarIndex.codecId;
+            codecpar->width = sidecarIndex.width;
+            codecpar->height = sidecarIndex.height;
+            codecpar->format = sidecarIndex.format;
+            if (!sidecarIndex.extradata.empty()) {
+                codecpar->extradata = (uint8_t*)av_mallocz(sidecarIndex.extradata.size() + AV_INPUT_BUFFER_PADDING_SIZE);
+                memcpy(codecpar->extradata, sidecarIndex.extradata.data(), sidecarIndex.extradata.size());
+                codecpar->extradata_size = (int)sidecarIndex.extradata.size();
+            }
+            rTimeBase = av_make_q(sidecarIndex.timeBaseNum, sidecarIndex.timeBaseDen);
+            formatName = "QuickTime / MOV"; // only mp4/mov files get a sidecar index
+            if (printInfo) {
+                std::cout << "Media format: " << formatName << " (read through sidecar index " << StreamIndex::SidecarPath(szFilePath) << ")" << std::endl;
+            }
         }
+        else {
+		    ck(avformat_open_input(&fmtc, szFilePath, NULL, NULL));
+            if (!fmtc) {
+                std::cout << "No AVFormatContext provided for " << szFilePath << ", Check if the filepath is correct" << std::endl;
+                return;
+            }
 
-        if (printInfo) { 
-            std::cout << "Media format: " << fmtc->iformat->long_name << " (" << fmtc->iformat->name << ")" << std::endl; 
-        }
+            if (printInfo) { 
+                std::cout << "Media format: " << fmtc->iformat->long_name << " (" << fmtc->iformat->name << ")" << std::endl; 
+            }
 
-        ck(avformat_find_stream_info(fmtc, NULL));
-        iVideoStream = av_find_best_stream(fmtc, AVMEDIA_TYPE_VIDEO, -1, -1, NULL, 0);
-        if (iVideoStream < 0) {
-            std::cout << "FFmpeg error: " << __FILE__ << " " << __LINE__ << " " << "Could not find stream in input file " << szFilePath;
-            return;
+            ck(avformat_find_stream_info(fmtc, NULL));
+            iVideoStream = av_find_best_stream(fmtc, AVMEDIA_TYPE_VIDEO, -1, -1, NULL, 0);
+            if (iVideoStream < 0) {
+                std::cout << "FFmpeg error: " << __FILE__ << " " << __LINE__ << " " << "Could not find stream in input file " << szFilePath;
+                return;
+            }
+            avcodec_parameters_copy(codecpar, fmtc->streams[iVideoStream]->codecpar);
+            rTimeBase = fmtc->streams[iVideoStream]->time_base;
+            formatName = fmtc->iformat->long_name;
+
+            if (useSidecarIndex && formatName == "QuickTime / MOV") {
+                if (!WriteSidecarIndex(szFilePath)) {
+                    std::cout << "Warning: could not write sidecar index " << StreamIndex::SidecarPath(szFilePath) << std::endl;
+                }
+            }
         }
 
-        eVideoCodec = fmtc->streams[iVideoStream]->codecpar->codec_id;
-        nWidth = fmtc->streams[iVideoStream]->codecpar->width;
-        nHeight = fmtc->streams[iVideoStream]->codecpar->height;
-        eChromaFormat = (AVPixelFormat)fmtc->streams[iVideoStream]->codecpar->format;
-        AVRational rTimeBase = fmtc->streams[iVideoStream]->time_base;
+        eVideoCodec = codecpar->codec_id;
+        nWidth = codecpar->width;
+        nHeight = codecpar->height;
+        eChromaFormat = (AVPixelFormat)codecpar->format;
         timeBase = av_q2d(rTimeBase);
         userTimeScale = timeScale;
 
@@ -127,27 +184,33 @@ public:
         }
 
         bMp4H264 = eVideoCodec == AV_CODEC_ID_H264 && (
-                !strcmp(fmtc->iformat->long_name, "QuickTime / MOV") 
-                || !strcmp(fmtc->iformat->long_name, "FLV (Flash Video)") 
-                || !strcmp(fmtc->iformat->long_name, "Matroska / WebM")
+                formatName == "QuickTime / MOV"
+                || formatName == "FLV (Flash Video)"
+                || formatName == "Matroska / WebM"
             );
         bMp4HEVC = eVideoCodec == AV_CODEC_ID_HEVC && (
-                !strcmp(fmtc->iformat->long_name, "QuickTime / MOV")
-                || !strcmp(fmtc->iformat->long_name, "FLV (Flash Video)")
-                || !strcmp(fmtc->iformat->long_name, "Matroska / WebM")
+                formatName == "QuickTime / MOV"
+                || formatName == "FLV (Flash Video)"
+                || formatName == "Matroska / WebM"
             );
 
         bMp4MPEG4 = eVideoCodec == AV_CODEC_ID_MPEG4 && (
-                !strcmp(fmtc->iformat->long_name, "QuickTime / MOV")
-                || !strcmp(fmtc->iformat->long_name, "FLV (Flash Video)")
-                || !strcmp(fmtc->iformat->long_name, "Matroska / WebM")
+                formatName == "QuickTime / MOV"
+                || formatName == "FLV (Flash Video)"
+                || formatName == "Matroska / WebM"
             );
 
         //Initialize packet fields with default values
+#if LIBAVCODEC_VERSION_MAJOR < 59
         av_init_packet(&pkt);
+        av_init_packet(&pktFiltered);
+#else
+        // av_init_packet() is deprecated, av_read_frame() and av_bsf_receive_packet() set the fields that are used
+        pkt = AVPacket();
+        pktFiltered = AVPacket();
+#endif
         pkt.data = NULL;
         pkt.size = 0;
-        av_init_packet(&pktFiltered);
         pktFiltered.data = NULL;
         pktFiltered.size = 0;
 
@@ -159,7 +222,7 @@ public:
                 return;
             }
             ck(av_bsf_alloc(bsf, &bsfc));
-            avcodec_parameters_copy(bsfc->par_in, fmtc->streams[iVideoStream]->codecpar);
+            avcodec_parameters_copy(bsfc->par_in, codecpar);
             ck(av_bsf_init(bsfc));
         }
         if (bMp4HEVC) {
@@ -169,14 +232,21 @@ public:
                 return;
             }
             ck(av_bsf_alloc(bsf, &bsfc));
-            avcodec_parameters_copy(bsfc->par_in, fmtc->streams[iVideoStream]->codecpar);
+            avcodec_parameters_copy(bsfc->par_in, codecpar);
             ck(av_bsf_init(bsfc));
         }
     }
 
     ~FFmpegDemuxer() {
 
-        if (!fmtc) {
+        if (sidecarFile) {
+            fclose(sidecarFile);
+        }
+        if (codecpar) {
+            avcodec_parameters_free(&codecpar);
+        }
+
+        if (!fmtc && !sidecarFile) {
             return;
         }
 
@@ -191,7 +261,9 @@ public:
             av_bsf_free(&bsfc);
         }
 
-        avformat_close_input(&fmtc);
+        if (fmtc) {
+            avformat_close_input(&fmtc);
+        }
 
         if (avioc) {
             av_freep(&avioc->buffer);
@@ -208,7 +280,7 @@ public:
     }
 
     bool Demux(uint8_t **ppVideo, int *pnVideoBytes) {
-        if (!fmtc) {
+        if (!fmtc && !sidecarFile) {
             return false;
         }
 
@@ -218,22 +290,33 @@ public:
             av_packet_unref(&pkt);
         }
 
-        int e = 0;
-        while ((e = av_read_frame(fmtc, &pkt)) >= 0 && pkt.stream_index != iVideoStream) {
-            av_packet_unref(&pkt);
+        if (sidecarFile) {
+            if (sidecarCursor == sidecarIndex.packets.size()) {
+                // reached end of file, start from the beginning
+                sidecarCursor = 0;
+                packetNr = 0;
+            }
+            if (!ReadSidecarPacket(sidecarIndex.packets[sidecarCursor++])) {
+                return false;
+            }
         }
-        if (e < 0) {
-			if (e == AVERROR_EOF) {
-				// reached end of file, start from the beginning
-				avio_seek(fmtc->pb, 0, SEEK_SET);
-				avformat_seek_file(fmtc, iVideoStream, 0, 0, fmtc->streams[iVideoStream]->duration, 0);
-				while ((e = av_read_frame(fmtc, &pkt)) >= 0 && pkt.stream_index != iVideoStream) {
-					av_packet_unref(&pkt);
-				}
-			}
-			if (e < 0) {
-				return false;
-			}
+        else {
+            int e = 0;
+            while ((e = av_read_frame(fmtc, &pkt)) >= 0 && pkt.stream_index != iVideoStream) {
+                av_packet_unref(&pkt);
+            }
+            if (e < 0) {
+			    if (e == AVERROR_EOF) {
+				    // reached end of file, start from the beginning
+				    SeekToStart();
+				    while ((e = av_read_frame(fmtc, &pkt)) >= 0 && pkt.stream_index != iVideoStream) {
+					    av_packet_unref(&pkt);
+				    }
+			    }
+			    if (e < 0) {
+				    return false;
+			    }
+            }
         }
 
         if (bMp4H264 || bMp4HEVC) {
@@ -248,7 +331,7 @@ public:
 
             if (bMp4MPEG4 && (frameCount == 0)) {
 
-                int extraDataSize = fmtc->streams[iVideoStream]->codecpar->extradata_size;
+                int extraDataSize = codecpar->extradata_size;
 
                 if (extraDataSize > 0) {
 
@@ -260,7 +343,7 @@ public:
                         return false;
                     }
 
-                    memcpy(pDataWithHeader, fmtc->streams[iVideoStream]->codecpar->extradata, extraDataSize);
+                    memcpy(pDataWithHeader, codecpar->extradata, extraDataSize);
                     memcpy(pDataWithHeader+extraDataSize, pkt.data+3, pkt.size - 3*sizeof(uint8_t));
 
                     *ppVideo = pDataWithHeader;
@@ -274,11 +357,208 @@ public:
         }
 
         frameCount++;
+        packetNr++;
+
+        return true;
+    }
+
+    /**
+    *   @brief  Whether the packet returned by the last call to Demux() is a keyframe.
+    */
+    bool IsKeyFrame() {
+        return (pkt.flags & AV_PKT_FLAG_KEY) != 0;
+    }
+
+    /**
+    *   @brief  The packet number (in decode order) of the next packet that Demux() returns, counting from the start of the video.
+    */
+    int GetNextPacketNr() {
+        return packetNr;
+    }
+
+    /**
+    *   @brief  The number of packets (= frames) of the video stream.
+    *           If the container has no index, this demuxes the whole stream once and rewinds, so call it before Demux().
+    */
+    int GetNrFrames() {
+        if (!fmtc && !sidecarFile) {
+            return 0;
+        }
+        BuildKeyframeIndex();
+        return nrPackets;
+    }
+
+    /**
+    *   @brief  Positions the demuxer at the last keyframe at or before frame frameNr, so decoding can start there.
+    *           Frame numbers beyond the end of the video wrap around, like Demux() does.
+    *   @return the number of frames between that keyframe and frameNr, or -1 if seeking failed
+    */
+    int SeekToKeyframeBefore(int frameNr) {
+        if (!fmtc && !sidecarFile) {
+            return -1;
+        }
+        BuildKeyframeIndex();
+        if (nrPackets > 0) {
+            frameNr %= nrPackets;
+        }
+        if (keyframes.empty()) {
+            // nothing to seek to, decode from the start
+            SeekToStart();
+            return frameNr;
+        }
+        int k = (int)(std::upper_bound(keyframes.begin(), keyframes.end(), frameNr) - keyframes.begin()) - 1;
+        if (k < 0) {
+            k = 0;
+        }
+        if (sidecarFile) {
+            sidecarCursor = keyframes[k];
+        }
+        else if (keyframeIndexFromContainer) {
+            if (av_seek_frame(fmtc, iVideoStream, keyframeTimestamps[k], AVSEEK_FLAG_BACKWARD) < 0) {
+                std::cout << "FFmpeg error: " << __FILE__ << " " << __LINE__ << " " << "av_seek_frame() failed" << std::endl;
+                return -1;
+            }
+        }
+        else {
+            // the container cannot seek to a packet number, so skip the packets before the keyframe without decoding them
+            SeekToStart();
+            for (int i = 0; i < keyframes[k]; i++) {
+                if (!ReadVideoPacket()) {
+                    return -1;
+                }
+                av_packet_unref(&pkt);
+            }
+        }
+        if (bsfc) {
+            av_bsf_flush(bsfc);
+        }
+        packetNr = keyframes[k];
+        return frameNr - keyframes[k];
+    }
+
+private:
 
+    void SeekToStart() {
+        packetNr = 0;
+        if (sidecarFile) {
+            sidecarCursor = 0;
+            return;
+        }
+        avio_seek(fmtc->pb, 0, SEEK_SET);
+        avformat_seek_file(fmtc, iVideoStream, 0, 0, fmtc->streams[iVideoStream]->duration, 0);
+    }
+
+    bool ReadSidecarPacket(const StreamIndex::Packet& entry) {
+#ifdef _WIN32
+        if (_fseeki64(sidecarFile, entry.pos, SEEK_SET) != 0) {
+#else
+        if (fseeko(sidecarFile, (off_t)entry.pos, SEEK_SET) != 0) {
+#endif
+            return false;
+        }
+        if (av_new_packet(&pkt, entry.size) < 0) {
+            return false;
+        }
+        if (fread(pkt.data, 1, entry.size, sidecarFile) != (size_t)entry.size) {
+            av_packet_unref(&pkt);
+            return false;
+        }
+        pkt.flags = entry.flags;
+        pkt.pts = entry.pts;
+        pkt.dts = entry.dts;
+        pkt.pos = entry.pos;
         return true;
     }
+
+    /**
+    *   @brief  Demuxes the whole video stream once to write the sidecar index, and rewinds afterwards.
+    */
+    bool WriteSidecarIndex(const char* szFilePath) {
+        StreamIndex index;
+        index.codecId = codecpar->codec_id;
+        index.width = codecpar->width;
+        index.height = codecpar->height;
+        index.format = codecpar->format;
+        index.timeBaseNum = fmtc->streams[iVideoStream]->time_base.num;
+        index.timeBaseDen = fmtc->streams[iVideoStream]->time_base.den;
+        index.extradata.assign(codecpar->extradata, codecpar->extradata + codecpar->extradata_size);
+        while (ReadVideoPacket()) {
+            if (pkt.pos < 0) {
+                // the packet does not map to a byte range of the file
+                av_packet_unref(&pkt);
+                SeekToStart();
+                return false;
+            }
+            StreamIndex::Packet entry = { pkt.pos, pkt.size, pkt.flags, pkt.pts, pkt.dts };
+            index.packets.push_back(entry);
+            av_packet_unref(&pkt);
+        }
+        SeekToStart();
+        return !index.packets.empty() && index.Write(szFilePath);
+    }
+
+    bool ReadVideoPacket() {
+        int e = 0;
+        while ((e = av_read_frame(fmtc, &pkt)) >= 0 && pkt.stream_index != iVideoStream) {
+            av_packet_unref(&pkt);
+        }
+        return e >= 0;
+    }
+
+    /**
+    *   @brief  Collects the keyframes of the video stream, from the index of the container if it has one (e.g. mp4),
+    *           or else by demuxing the whole stream once.
+    */
+    void BuildKeyframeIndex() {
+        if (keyframeIndexBuilt) {
+            return;
+        }
+        keyframeIndexBuilt = true;
+        if (sidecarFile) {
+            nrPackets = (int)sidecarIndex.packets.size();
+            for (int i = 0; i < nrPackets; i++) {
+                if (sidecarIndex.packets[i].flags & AV_PKT_FLAG_KEY) {
+                    keyframes.push_back(i);
+                }
+            }
+            return;
+        }
+        AVStream* st = fmtc->streams[iVideoStream];
+#if LIBAVFORMAT_VERSION_INT >= AV_VERSION_INT(58, 78, 100)
+        int nrIndexEntries = avformat_index_get_entries_count(st);
+#else
+        int nrIndexEntries = st->nb_index_entries;
+#endif
+        if (nrIndexEntries > 0) {
+            keyframeIndexFromContainer = true;
+            nrPackets = nrIndexEntries;
+            for (int i = 0; i < nrIndexEntries; i++) {
+#if LIBAVFORMAT_VERSION_INT >= AV_VERSION_INT(58, 78, 100)
+                const AVIndexEntry* entry = avformat_index_get_entry(st, i);
+#else
+                const AVIndexEntry* entry = &st->index_entries[i];
+#endif
+                if (entry->flags & AVINDEX_KEYFRAME) {
+                    keyframes.push_back(i);
+                    keyframeTimestamps.push_back(entry->timestamp);
+                }
+            }
+            return;
+        }
+
+        SeekToStart();
+        while (ReadVideoPacket()) {
+            if (pkt.flags & AV_PKT_FLAG_KEY) {
+                keyframes.push_back(nrPackets);
+            }
+            nrPackets++;
+            av_packet_unref(&pkt);
+        }
+        SeekToStart();
+    }
 };
 
+#ifdef HAVE_NVDEC
 inline cudaVideoCodec FFmpeg2NvCodecId(AVCodecID id) {
     switch (id) {
     case AV_CODEC_ID_MPEG1VIDEO : return cudaVideoCodec_MPEG1;
@@ -295,5 +575,6 @@ inline cudaVideoCodec FFmpeg2NvCodecId(AVCodecID id) {
     default                     : return cudaVideoCodec_NumCodecs;
     }
 }
+#endif
 
 
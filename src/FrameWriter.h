@@ -0,0 +1,276 @@
+#ifndef FRAME_WRITER_H
+#define FRAME_WRITER_H
+
+
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include <queue>
+#include <map>
+#include <memory>
+#include <vector>
+#include <string>
+#include <fstream>
+#include <iostream>
+#include "ioHelper.h"
+#include "PixelConversion.h"
+#include "VideoEncoder.h"
+#include "Tracer.h"
+
+
+/*
+* FrameWriter saves the output images (-o/--output_dir) on background threads, so the render thread only
+* has to read back the framebuffer and can continue with the next output camera while earlier frames are written.
+*
+* The render thread gets a buffer with acquireBuffer(), reads the framebuffer into it and hands it back with submit().
+* There is a fixed pool of buffers, so the queue of frames to write is bounded: acquireBuffer() blocks
+* if the writer threads fall that far behind.
+*
+* Every output camera writes to one .yuv file (in the OutputPixelFormat, frames appended in order), which is opened
+* on its first frame and kept open until close(). PNGs are written to a file per frame.
+* If a codec is given to init(), every output camera is encoded to a .mp4 or .mkv file by a VideoEncoder instead.
+* The frames are converted out of order by the writer threads, but passed to the encoder in order.
+*
+* close() has to be called before the program exits, it writes the remaining frames.
+*/
+class FrameWriter {
+private:
+	struct Job {
+		unsigned char* image;
+		std::string path;
+		int frameNr;
+		bool saveAsPNG;
+	};
+
+	struct OutputFile {
+		std::mutex mutex;
+		std::ofstream stream;
+		std::unique_ptr<VideoEncoder> encoder; // instead of stream, if the output is encoded
+		std::condition_variable turn;          // signals that nextFrameNr changed
+		int nextFrameNr = 0;                   // the next frame the encoder expects
+		bool failed = false;
+	};
+
+	int width = 0;
+	int height = 0;
+	OutputPixelFormat format = OutputPixelFormat::YUV444P;
+	bool encode = false;
+	VideoEncoder::Settings encoderSettings;
+	std::string container;
+	std::vector<unsigned char*> buffers;
+	std::vector<unsigned char*> freeBuffers;
+	std::queue<Job> jobs;
+	std::mutex mutex;
+	std::condition_variable bufferFreed;
+	std::condition_variable jobAdded;
+	bool stopping = false;
+	std::vector<std::thread> threads;
+	std::map<std::string, std::unique_ptr<OutputFile>> files;
+
+	// the .yuv file or video of an output camera, opened on first use
+	OutputFile* getFile(const std::string& path) {
+		std::lock_guard<std::mutex> lock(mutex);
+		std::unique_ptr<OutputFile>& file = files[path];
+		if (!file) {
+			file.reset(new OutputFile());
+			if (encode) {
+				file->encoder.reset(new VideoEncoder());
+				file->failed = !file->encoder->open(path, width, height, encoderSettings);
+			}
+			else {
+				file->stream.open(path, std::ios::out | std::ios::binary | std::ios::trunc);
+				file->failed = !file->stream.good();
+			}
+		}
+		return file.get();
+	}
+
+	void releaseBuffer(unsigned char* image) {
+		{
+			std::lock_guard<std::mutex> lock(mutex);
+			freeBuffers.push_back(image);
+		}
+		bufferFreed.notify_one();
+	}
+
+	void writeYUV(const Job& job, std::vector<unsigned char>& planes) {
+		size_t frameSize = outputFrameSize(format, width, height);
+		planes.resize(frameSize);
+		convertRGBAToPlanar(format, job.image, width, height, planes.data());
+
+		OutputFile* file = getFile(job.path);
+		std::lock_guard<std::mutex> lock(file->mutex);
+		if (file->failed) {
+			std::cout << "could not write to " << job.path << std::endl;
+			return;
+		}
+		// frames of the same file can be finished out of order by different threads
+		std::streamoff offset = (std::streamoff)job.frameNr * frameSize;
+		if (file->stream.tellp() != offset) {
+			file->stream.seekp(offset);
+		}
+		file->stream.write(reinterpret_cast<const char*>(planes.data()), frameSize);
+		if (!file->stream.good()) {
+			std::cout << "could not write to " << job.path << std::endl;
+			file->failed = true;
+		}
+	}
+
+	// frame is the AVFrame of this thread, allocated on first use
+	void writeVideo(Job& job, AVFrame*& frame) {
+		if (!frame) {
+			frame = VideoEncoder::allocFrame(width, height, format);
+		}
+		else if (av_frame_make_writable(frame) < 0) {
+			// the encoder still holds a reference to the previous frame, and a new buffer could not be allocated
+			std::cout << "Error: could not allocate a frame to encode for " << job.path << std::endl;
+			av_frame_free(&frame);
+		}
+		OutputFile* file = getFile(job.path);
+		if (frame) {
+			convertRGBAToPlanes(format, job.image, width, height, frame->data, frame->linesize);
+		}
+		// the RGBA buffer can be reused while this thread waits for its turn and encodes
+		releaseBuffer(job.image);
+		job.image = NULL;
+
+		std::unique_lock<std::mutex> lock(file->mutex);
+		file->turn.wait(lock, [&] { return file->nextFrameNr >= job.frameNr; });
+		if (!frame || file->failed) {
+			std::cout << "could not write to " << job.path << std::endl;
+		}
+		else {
+			TraceSpan span("Encode frame", "frame", job.frameNr);
+			file->failed = !file->encoder->encode(frame, job.frameNr);
+		}
+		file->nextFrameNr = job.frameNr + 1;
+		lock.unlock();
+		file->turn.notify_all();
+	}
+
+	void writePNG(const Job& job) {
+		if (!stbi_write_png(job.path.c_str(), width, height, 4, job.image, width * 4)) {
+			std::cout << "could not write to " << job.path << std::endl;
+		}
+	}
+
+	void write_loop(int i) {
+		Tracer::instance().setThreadName("Writer thread " + std::to_string(i));
+		std::vector<unsigned char> planes; // reused for every frame
+		AVFrame* frame = NULL;             // idem, if the output is encoded
+		while (true) {
+			Job job;
+			{
+				std::unique_lock<std::mutex> lock(mutex);
+				jobAdded.wait(lock, [this] { return stopping || !jobs.empty(); });
+				if (jobs.empty()) {
+					break;
+				}
+				job = jobs.front();
+				jobs.pop();
+			}
+			{
+				TraceSpan span("Write frame", "frame", job.frameNr);
+				if (job.saveAsPNG) {
+					writePNG(job);
+				}
+				else if (encode) {
+					writeVideo(job, frame);
+				}
+				else {
+					writeYUV(job, planes);
+				}
+			}
+			if (job.image) {
+				releaseBuffer(job.image);
+			}
+		}
+		av_frame_free(&frame);
+	}
+
+public:
+	FrameWriter() {}
+
+	~FrameWriter() {
+		close();
+	}
+
+	// if codecName is not empty, the output of every camera is encoded with that libavcodec encoder, to a video in the container (mp4 or mkv) at fps frames per second
+	void init(int width, int height, OutputPixelFormat format = OutputPixelFormat::YUV444P, std::string codecName = "", int crf = -1, std::string container = "mp4", int fps = 30,
+		int nrThreads = 2, int nrBuffers = 4) {
+		this->width = width;
+		this->height = height;
+		this->format = format;
+		this->encode = codecName != "";
+		this->container = container;
+		encoderSettings.codecName = codecName;
+		encoderSettings.crf = crf;
+		encoderSettings.format = format;
+		encoderSettings.fps = fps;
+		std::cout << "converting the output frames to " << outputPixelFormatName(format) << " with the " << getPixelKernels().name << " kernels" << std::endl;
+		stbi_flip_vertically_on_write(1); // OpenGL reads the rows bottom to top
+		for (int i = 0; i < nrBuffers; i++) {
+			buffers.push_back(new unsigned char[(size_t)width * height * 4]);
+			freeBuffers.push_back(buffers.back());
+		}
+		stopping = false;
+		for (int i = 0; i < nrThreads; i++) {
+			threads.push_back(std::thread(&FrameWriter::write_loop, this, i));
+		}
+	}
+
+	bool isInitialized() {
+		return !buffers.empty();
+	}
+
+	// the extension of the files of the output cameras, if they are not PNGs
+	std::string videoExtension() {
+		return encode ? "." + container : ".yuv";
+	}
+
+	// a buffer of width * height RGBA pixels, blocks until a writer thread frees one
+	unsigned char* acquireBuffer() {
+		TraceSpan span("FrameWriter::acquireBuffer");
+		std::unique_lock<std::mutex> lock(mutex);
+		bufferFreed.wait(lock, [this] { return !freeBuffers.empty(); });
+		unsigned char* buffer = freeBuffers.back();
+		freeBuffers.pop_back();
+		return buffer;
+	}
+
+	// takes back the buffer from acquireBuffer() and writes it to outputPath, as a PNG or as frame frameNr of a .yuv file
+	void submit(unsigned char* image, std::string outputPath, int frameNr, bool saveAsPNG) {
+		if (saveAsPNG) {
+			std::cout << "writing PNG to " << outputPath << std::endl;
+		}
+		else {
+			std::cout << (encode ? "encoding " : "writing ") << outputPixelFormatName(format) << " frame " << frameNr << " to " << outputPath << std::endl;
+		}
+		{
+			std::lock_guard<std::mutex> lock(mutex);
+			jobs.push({ image, outputPath, frameNr, saveAsPNG });
+		}
+		jobAdded.notify_one();
+	}
+
+	// writes the remaining frames and closes the files
+	void close() {
+		{
+			std::lock_guard<std::mutex> lock(mutex);
+			stopping = true;
+		}
+		jobAdded.notify_all();
+		for (std::thread& thread : threads) {
+			thread.join();
+		}
+		threads.clear();
+		files.clear();
+		for (unsigned char* buffer : buffers) {
+			delete[] buffer;
+		}
+		buffers.clear();
+		freeBuffers.clear();
+	}
+};
+
+#endif
@@ -0,0 +1,151 @@
+#ifndef HEADLESS_CONTEXT_H
+#define HEADLESS_CONTEXT_H
+
+
+#include <iostream>
+#ifdef HAVE_EGL
+#include <EGL/egl.h>
+#include <EGL/eglext.h>
+#include <string.h>
+#endif
+
+
+/*
+* HeadlessContext creates an OpenGL 4.1 core context without a window (--headless), through EGL,
+* so output images can be rendered on a machine without a display server (e.g. a render node).
+*
+* The context is made current without a surface (EGL_KHR_surfaceless_context): all rendering goes
+* to the framebuffers of the Application, which is what is read back to save the output images.
+* The display is taken from the first EGL device (EGL_EXT_platform_device), which works with the NVIDIA driver
+* without an X server, or else from Mesa's surfaceless platform, or else the default display.
+*
+* Only available if the application was built with EGL (HAVE_EGL), otherwise create() fails.
+*/
+class HeadlessContext {
+public:
+	HeadlessContext() {}
+
+	bool create() {
+#ifdef HAVE_EGL
+		display = getDisplay();
+		if (display == EGL_NO_DISPLAY) {
+			std::cout << "Error: could not get an EGL display" << std::endl;
+			return false;
+		}
+		EGLint major, minor;
+		if (!eglInitialize(display, &major, &minor)) {
+			std::cout << "Error: could not initialize EGL (error 0x" << std::hex << eglGetError() << std::dec << ")" << std::endl;
+			display = EGL_NO_DISPLAY;
+			return false;
+		}
+		if (!hasExtension(eglQueryString(display, EGL_EXTENSIONS), "EGL_KHR_surfaceless_context")) {
+			std::cout << "Error: the EGL display does not support EGL_KHR_surfaceless_context" << std::endl;
+			destroy();
+			return false;
+		}
+		if (!eglBindAPI(EGL_OPENGL_API)) {
+			std::cout << "Error: the EGL display does not support OpenGL" << std::endl;
+			destroy();
+			return false;
+		}
+
+		const EGLint configAttributes[] = {
+			EGL_RENDERABLE_TYPE, EGL_OPENGL_BIT,
+			EGL_RED_SIZE, 8,
+			EGL_GREEN_SIZE, 8,
+			EGL_BLUE_SIZE, 8,
+			EGL_NONE
+		};
+		EGLConfig config;
+		EGLint nrConfigs = 0;
+		if (!eglChooseConfig(display, configAttributes, &config, 1, &nrConfigs) || nrConfigs == 0) {
+			std::cout << "Error: no suitable EGL config found" << std::endl;
+			destroy();
+			return false;
+		}
+
+		const EGLint contextAttributes[] = {
+			EGL_CONTEXT_MAJOR_VERSION, 4,
+			EGL_CONTEXT_MINOR_VERSION, 1,
+			EGL_CONTEXT_OPENGL_PROFILE_MASK, EGL_CONTEXT_OPENGL_CORE_PROFILE_BIT,
+			EGL_NONE
+		};
+		context = eglCreateContext(display, config, EGL_NO_CONTEXT, contextAttributes);
+		if (context == EGL_NO_CONTEXT) {
+			std::cout << "Error: could not create an OpenGL 4.1 context through EGL (error 0x" << std::hex << eglGetError() << std::dec << ")" << std::endl;
+			destroy();
+			return false;
+		}
+		if (!eglMakeCurrent(display, EGL_NO_SURFACE, EGL_NO_SURFACE, context)) {
+			std::cout << "Error: could not make the EGL context current (error 0x" << std::hex << eglGetError() << std::dec << ")" << std::endl;
+			destroy();
+			return false;
+		}
+		std::cout << "Rendering headless through EGL " << major << "." << minor << std::endl;
+		return true;
+#else
+		std::cout << "Error: --headless is not available, the application was built without EGL" << std::endl;
+		return false;
+#endif
+	}
+
+	void destroy() {
+#ifdef HAVE_EGL
+		if (display != EGL_NO_DISPLAY) {
+			eglMakeCurrent(display, EGL_NO_SURFACE, EGL_NO_SURFACE, EGL_NO_CONTEXT);
+			if (context != EGL_NO_CONTEXT) {
+				eglDestroyContext(display, context);
+				context = EGL_NO_CONTEXT;
+			}
+			eglTerminate(display);
+			display = EGL_NO_DISPLAY;
+		}
+#endif
+	}
+
+private:
+#ifdef HAVE_EGL
+	EGLDisplay display = EGL_NO_DISPLAY;
+	EGLContext context = EGL_NO_CONTEXT;
+
+	static bool hasExtension(const char* extensions, const char* name) {
+		if (!extensions) {
+			return false;
+		}
+		size_t length = strlen(name);
+		for (const char* s = strstr(extensions, name); s; s = strstr(s + length, name)) {
+			if ((s == extensions || s[-1] == ' ') && (s[length] == ' ' || s[length] == '\0')) {
+				return true;
+			}
+		}
+		return false;
+	}
+
+	static EGLDisplay getDisplay() {
+		const char* clientExtensions = eglQueryString(EGL_NO_DISPLAY, EGL_EXTENSIONS);
+		PFNEGLGETPLATFORMDISPLAYEXTPROC eglGetPlatformDisplayEXT =
+			(PFNEGLGETPLATFORMDISPLAYEXTPROC)eglGetProcAddress("eglGetPlatformDisplayEXT");
+
+		if (eglGetPlatformDisplayEXT && hasExtension(clientExtensions, "EGL_EXT_platform_device")) {
+			PFNEGLQUERYDEVICESEXTPROC eglQueryDevicesEXT = (PFNEGLQUERYDEVICESEXTPROC)eglGetProcAddress("eglQueryDevicesEXT");
+			EGLDeviceEXT device;
+			EGLint nrDevices = 0;
+			if (eglQueryDevicesEXT && eglQueryDevicesEXT(1, &device, &nrDevices) && nrDevices > 0) {
+				EGLDisplay display = eglGetPlatformDisplayEXT(EGL_PLATFORM_DEVICE_EXT, device, NULL);
+				if (display != EGL_NO_DISPLAY) {
+					return display;
+				}
+			}
+		}
+		if (eglGetPlatformDisplayEXT && hasExtension(clientExtensions, "EGL_MESA_platform_surfaceless")) {
+			EGLDisplay display = eglGetPlatformDisplayEXT(0x31DD /* EGL_PLATFORM_SURFACELESS_MESA */, EGL_DEFAULT_DISPLAY, NULL);
+			if (display != EGL_NO_DISPLAY) {
+				return display;
+			}
+		}
+		return eglGetDisplay(EGL_DEFAULT_DISPLAY);
+	}
+#endif
+};
+
+#endif
@@ -0,0 +1,180 @@
+#ifndef IMAGE_LOADER_H
+#define IMAGE_LOADER_H
+
+
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include <atomic>
+#include <chrono>
+#include <queue>
+#include <vector>
+#include <string>
+#include <cstdio>
+#include <climits>
+#include <algorithm>
+#include <iostream>
+#include "stb_image.h"
+#include "Tracer.h"
+
+
+/*
+* ImageLoader decodes a list of PNG files (or other formats stb_image reads) on a pool of threads.
+*
+* add() all images, start() the threads, and call next() on the thread that uses the images (e.g. to upload them
+* to OpenGL): it returns the images in the order in which they finish, so the first ones can be used while
+* the others are still being decoded. release() frees the pixels of an image once they are no longer needed.
+*
+* Every thread reads the files into one buffer that it reuses, and stb_image decodes from that buffer.
+* The time to read and decode each file is kept, printTimings() prints them.
+*/
+class ImageLoader {
+public:
+	struct Image {
+		std::string path;
+		int channels;         // the number of channels to decode to (1 = grey, 3 = RGB, 4 = RGBA)
+		bool is16Bit;         // if true, data holds unsigned shorts, otherwise unsigned chars
+		void* data = NULL;    // NULL if the image could not be loaded
+		int width = 0;
+		int height = 0;
+		float readMs = 0.0f;
+		float decodeMs = 0.0f;
+	};
+
+	ImageLoader() {}
+
+	~ImageLoader() {
+		stop();
+		for (Image& image : images) {
+			stbi_image_free(image.data);
+		}
+	}
+
+	// returns the index of the image
+	int add(std::string path, int channels, bool is16Bit) {
+		Image image;
+		image.path = path;
+		image.channels = channels;
+		image.is16Bit = is16Bit;
+		images.push_back(image);
+		return (int)images.size() - 1;
+	}
+
+	void start(int nrThreads) {
+		startTime = std::chrono::steady_clock::now();
+		this->nrThreads = nrThreads = (std::max)(1, (std::min)(nrThreads, (int)images.size()));
+		for (int i = 0; i < nrThreads; i++) {
+			threads.push_back(std::thread(&ImageLoader::load_loop, this, i));
+		}
+	}
+
+	// blocks until the next image is decoded and returns its index, or -1 once all images have been returned
+	int next() {
+		std::unique_lock<std::mutex> lock(mutex);
+		if (nrReturned == (int)images.size()) {
+			return -1;
+		}
+		imageDone.wait(lock, [this] { return !done.empty(); });
+		int index = done.front();
+		done.pop();
+		nrReturned++;
+		return index;
+	}
+
+	const Image& get(int index) {
+		return images[index];
+	}
+
+	void release(int index) {
+		stbi_image_free(images[index].data);
+		images[index].data = NULL;
+	}
+
+	// the threads do not start on new images anymore, and stop() waits for the images they are decoding
+	void stop() {
+		stopping = true;
+		for (std::thread& thread : threads) {
+			thread.join();
+		}
+		threads.clear();
+	}
+
+	void printTimings() {
+		float totalMs = std::chrono::duration<float, std::milli>(std::chrono::steady_clock::now() - startTime).count();
+		float sumMs = 0.0f;
+		for (const Image& image : images) {
+			std::cout << "  " << image.path << ": read in " << image.readMs << " ms, decoded in " << image.decodeMs << " ms" << std::endl;
+			sumMs += image.readMs + image.decodeMs;
+		}
+		std::cout << "Loaded " << images.size() << " images in " << totalMs << " ms on " << nrThreads << " threads ("
+			<< sumMs << " ms of reading and decoding)" << std::endl;
+	}
+
+private:
+	std::vector<Image> images;
+	std::vector<std::thread> threads;
+	int nrThreads = 0;
+	std::atomic<int> nextImage{ 0 };
+	std::atomic<bool> stopping{ false };
+	std::mutex mutex;
+	std::condition_variable imageDone;
+	std::queue<int> done;
+	int nrReturned = 0;
+	std::chrono::steady_clock::time_point startTime;
+
+	// buffer only grows, size is the number of bytes of the file
+	static bool readFile(const std::string& path, std::vector<unsigned char>& buffer, /*out*/ int& size) {
+		FILE* file = fopen(path.c_str(), "rb");
+		if (!file) {
+			return false;
+		}
+		fseek(file, 0, SEEK_END);
+		long fileSize = ftell(file);
+		fseek(file, 0, SEEK_SET);
+		bool ok = fileSize > 0 && fileSize <= INT_MAX;
+		if (ok) {
+			if ((size_t)fileSize > buffer.size()) {
+				buffer.resize((size_t)fileSize);
+			}
+			ok = fread(buffer.data(), 1, (size_t)fileSize, file) == (size_t)fileSize;
+		}
+		fclose(file);
+		size = (int)fileSize;
+		return ok;
+	}
+
+	void load(Image& image, std::vector<unsigned char>& fileBuffer) {
+		TraceSpan span("Load image");
+		std::chrono::steady_clock::time_point t0 = std::chrono::steady_clock::now();
+		int fileSize = 0;
+		bool ok = readFile(image.path, fileBuffer, fileSize);
+		std::chrono::steady_clock::time_point t1 = std::chrono::steady_clock::now();
+		if (ok) {
+			int nrChannels;
+			if (image.is16Bit) {
+				image.data = stbi_load_16_from_memory(fileBuffer.data(), fileSize, &image.width, &image.height, &nrChannels, image.channels);
+			}
+			else {
+				image.data = stbi_load_from_memory(fileBuffer.data(), fileSize, &image.width, &image.height, &nrChannels, image.channels);
+			}
+		}
+		std::chrono::steady_clock::time_point t2 = std::chrono::steady_clock::now();
+		image.readMs = std::chrono::duration<float, std::milli>(t1 - t0).count();
+		image.decodeMs = std::chrono::duration<float, std::milli>(t2 - t1).count();
+	}
+
+	void load_loop(int i) {
+		Tracer::instance().setThreadName("Image loader thread " + std::to_string(i));
+		std::vector<unsigned char> fileBuffer; // reused for every file
+		for (int index = nextImage++; index < (int)images.size() && !stopping; index = nextImage++) {
+			load(images[index], fileBuffer);
+			{
+				std::lock_guard<std::mutex> lock(mutex);
+				done.push(index);
+			}
+			imageDone.notify_one();
+		}
+	}
+};
+
+#endif
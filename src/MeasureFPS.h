@@ -7,60 +7,211 @@
 #include <vector>
 #include <iostream>
 #include <fstream>
+#include <algorithm>
+#include "Tracer.h"
+#include "PoolStats.h"
 
-void SpinUntilTargetTime(Uint64 startTime, float targetTime) {
-	float passedTimeMs = (SDL_GetPerformanceCounter() - startTime) / (float)SDL_GetPerformanceFrequency() * 1000.0f;
-	while (passedTimeMs < targetTime) {
-		passedTimeMs = (SDL_GetPerformanceCounter() - startTime) / (float)SDL_GetPerformanceFrequency() * 1000.0f;
+/*
+* FramePacer waits until a frame deadline without keeping a core busy, so the threads of the Pool can use it:
+* it sleeps until spinMarginMs before the deadline and only spins for the rest.
+* The margin adapts to how much the sleeps overshoot on this machine (SDL_Delay has a granularity of 1 ms at best),
+* which keeps the deadlines as accurate as spinning the whole time.
+* Frames that were already past their deadline before waiting, or that overshot it, are counted as missed.
+*/
+class FramePacer {
+private:
+	float spinMarginMs = 2.0f;
+	float overshootMs = 1.0f;   // running average of how much later than requested SDL_Delay returns
+	int nrFrames = 0;
+	int nrMissedDeadlines = 0;
+
+	static float MsSince(Uint64 startTime) {
+		return (SDL_GetPerformanceCounter() - startTime) / (float)SDL_GetPerformanceFrequency() * 1000.0f;
+	}
+
+public:
+	FramePacer() {}
+
+	// waits until targetTime ms after startTime, returns false if the deadline was missed
+	bool WaitUntilTargetTime(Uint64 startTime, float targetTime) {
+		TraceSpan span("FramePacer::WaitUntilTargetTime");
+		nrFrames++;
+		float passedTimeMs = MsSince(startTime);
+		if (passedTimeMs >= targetTime) {
+			nrMissedDeadlines++;
+			return false;
+		}
+		float sleepTimeMs = targetTime - passedTimeMs - spinMarginMs;
+		if (sleepTimeMs >= 1.0f) {
+			Uint32 sleepMs = (Uint32)sleepTimeMs;
+			Uint64 sleepStart = SDL_GetPerformanceCounter();
+			SDL_Delay(sleepMs);
+			float overshoot = MsSince(sleepStart) - (float)sleepMs;
+			overshootMs = 0.9f * overshootMs + 0.1f * (std::max)(overshoot, 0.0f);
+			// spin for twice the usual overshoot, or for the worst overshoot seen recently
+			spinMarginMs = (std::max)(spinMarginMs * 0.99f, (std::max)(2.0f * overshootMs, overshoot));
+			spinMarginMs = (std::min)((std::max)(spinMarginMs, 0.5f), targetTime);
+		}
+		passedTimeMs = MsSince(startTime);
+		while (passedTimeMs < targetTime) {
+			passedTimeMs = MsSince(startTime);
+		}
+		if (passedTimeMs > targetTime + 0.5f) {
+			nrMissedDeadlines++;
+			return false;
+		}
+		return true;
 	}
-}
+
+	void PrintSummary() {
+		if (nrFrames > 0) {
+			std::cout << "Frame pacing: " << nrMissedDeadlines << " of " << nrFrames << " frames missed their deadline (" << 100.0f * nrMissedDeadlines / nrFrames << "%)" << std::endl;
+		}
+	}
+};
 
 /*
 * FpsMonitor keeps track of the achieved framerates during rendering and
-* can write the results to a CSV file.
+* streams them to a CSV file, so memory use does not grow with the length of the run:
+* the rows are buffered and appended to the file about once per second.
+*
+* The statistics are kept in fixed-size histograms (see LatencyHistogram):
+* the milliseconds per rendered frame, and per video frame (all frames rendered with the same video frame).
+* A frame that takes longer than one refresh interval (1000 / targetFps ms) misses one or more vsyncs.
+* Every 10 seconds and at Close(), the summary is written to a JSON file next to the CSV file, and printed at Close().
 */
 class FpsMonitor {
 private:
-	// containers for holding the framerate data:
-	std::vector<float> msPerFrame;
-	std::vector<int> videoFrameNrs;
-
 	// some state:
 	bool isVR;
 	Uint64 prevTime = 0;
 
+	std::ofstream csvFile;
+	std::string jsonPath;
+	std::string rows;                  // buffered CSV rows
+	bool isStatic = false;
+	float msPerVsync = 0.0f;
+	float msSinceCSVFlush = 0.0f;
+	float msSinceJSONFlush = 0.0f;
+
+	LatencyHistogram frameTimes;       // in microseconds
+	LatencyHistogram videoFrameTimes;  // in microseconds
+	uint64_t nrFramesWithMissedVsync = 0;
+	uint64_t nrMissedVsyncs = 0;
+	int currentVideoFrameNr = -1;
+	float msCurrentVideoFrame = 0.0f;
+
+	void FlushCSV() {
+		csvFile << rows;
+		csvFile.flush();
+		rows.clear();
+		msSinceCSVFlush = 0.0f;
+	}
+
+	void WriteJSONSummary() {
+		std::ofstream jsonFile;
+		jsonFile.open(jsonPath);
+		jsonFile << "{\n";
+		WriteHistogramToJSON(jsonFile, "ms_per_frame", frameTimes);
+		jsonFile << ",\n";
+		WriteHistogramToJSON(jsonFile, "ms_per_video_frame", videoFrameTimes);
+		jsonFile << ",\n\t\"target_fps\": " << (msPerVsync > 0 ? 1000.0f / msPerVsync : 0.0f)
+			<< ",\n\t\"frames_with_missed_vsync\": " << nrFramesWithMissedVsync
+			<< ",\n\t\"missed_vsyncs\": " << nrMissedVsyncs << "\n}\n";
+		jsonFile.close();
+		msSinceJSONFlush = 0.0f;
+	}
+
+	static void WriteHistogramToJSON(std::ofstream& jsonFile, const char* name, const LatencyHistogram& h) {
+		jsonFile << "\t\"" << name << "\": {\"count\": " << h.count() << ", \"mean\": " << h.mean() / 1000.0
+			<< ", \"p50\": " << h.percentile(50) / 1000.0 << ", \"p95\": " << h.percentile(95) / 1000.0
+			<< ", \"p99\": " << h.percentile(99) / 1000.0 << ", \"max\": " << h.max() / 1000.0 << "}";
+	}
+
+	static void PrintHistogram(const char* name, const LatencyHistogram& h) {
+		std::cout << name << ": " << h.count() << " frames, mean " << h.mean() / 1000.0 << " ms, p50 " << h.percentile(50) / 1000.0
+			<< " ms, p95 " << h.percentile(95) / 1000.0 << " ms, p99 " << h.percentile(99) / 1000.0 << " ms, max " << h.max() / 1000.0 << " ms" << std::endl;
+	}
+
 public:
 	FpsMonitor(bool isVR) : isVR(isVR) {};
 
-	// only used if isStatic is false
-	void AddTime(float timeToAdd, int videoFrameNr) {
-		msPerFrame.push_back(timeToAdd);
-		videoFrameNrs.push_back(videoFrameNr);
-	}
+	// start streaming to the CSV file at path, a frame misses a vsync if it takes longer than 1000 / targetFps ms
+	bool Open(std::string path, bool isStatic, int targetFps) {
+		this->isStatic = isStatic;
+		msPerVsync = targetFps > 0 ? 1000.0f / (float)targetFps : 0.0f;
+		jsonPath = path;
+		size_t extension = jsonPath.rfind(".csv");
+		if (extension != std::string::npos && extension == jsonPath.size() - 4) {
+			jsonPath = jsonPath.substr(0, extension);
+		}
+		jsonPath += "_summary.json";
 
-	void WriteToCSVFile(std::string path, bool isStatic) {
-		
-		bool useVideoFrameNr = videoFrameNrs.size() == msPerFrame.size();
-		std::ofstream csvFile;
 		csvFile.open(path);
+		if (!csvFile.is_open()) {
+			std::cout << "Error: could not open " << path << std::endl;
+			return false;
+		}
+		csvFile << ((isStatic) ? "Frame nr," : "Video frame nr,") << "Milliseconds per frame\n";
+		return true;
+	}
 
-		// write the first row
-		if (useVideoFrameNr) {
-			csvFile << ((isStatic)? "Frame nr," : "Video frame nr,");
+	// only used if isStatic is false
+	void AddTime(float timeToAdd, int videoFrameNr) {
+		if (!csvFile.is_open()) {
+			return;
 		}
-		csvFile << "Milliseconds per frame\n";
+		rows += std::to_string(videoFrameNr);
+		rows += ',';
+		rows += std::to_string(timeToAdd);
+		rows += '\n';
 
-		// write the other rows
-		for (int i = 0; i < msPerFrame.size(); i++) {
-			if (useVideoFrameNr) {
-				csvFile << std::to_string(videoFrameNrs[i]) + ',';
+		frameTimes.record((int64_t)(timeToAdd * 1000.0f));
+		if (msPerVsync > 0 && timeToAdd > msPerVsync * 1.05f) {
+			// a small tolerance for timer jitter
+			nrFramesWithMissedVsync++;
+			nrMissedVsyncs += (uint64_t)(timeToAdd / msPerVsync - 0.05f);
+		}
+		if (videoFrameNr != currentVideoFrameNr) {
+			if (currentVideoFrameNr >= 0) {
+				videoFrameTimes.record((int64_t)(msCurrentVideoFrame * 1000.0f));
 			}
-			csvFile << std::to_string(msPerFrame[i]) + '\n';
+			currentVideoFrameNr = videoFrameNr;
+			msCurrentVideoFrame = 0.0f;
+		}
+		msCurrentVideoFrame += timeToAdd;
+
+		msSinceCSVFlush += timeToAdd;
+		msSinceJSONFlush += timeToAdd;
+		if (msSinceCSVFlush >= 1000.0f) {
+			FlushCSV();
+		}
+		if (msSinceJSONFlush >= 10000.0f) {
+			WriteJSONSummary();
 		}
+	}
+
+	void Close() {
+		if (!csvFile.is_open()) {
+			return;
+		}
+		if (currentVideoFrameNr >= 0) {
+			videoFrameTimes.record((int64_t)(msCurrentVideoFrame * 1000.0f));
+			currentVideoFrameNr = -1;
+		}
+		FlushCSV();
 		csvFile.close();
-		std::cout << "Wrote to " << path << std::endl;
+		WriteJSONSummary();
+		PrintHistogram("Milliseconds per frame", frameTimes);
+		if (!isStatic) {
+			PrintHistogram("Milliseconds per video frame", videoFrameTimes);
+		}
+		if (msPerVsync > 0) {
+			std::cout << nrFramesWithMissedVsync << " frames missed " << nrMissedVsyncs << " vsyncs in total (at " << 1000.0f / msPerVsync << " fps)" << std::endl;
+		}
+		std::cout << "Wrote to " << jsonPath << std::endl;
 	}
 
 };
 
-#endif
\ No newline at end of file
+#endif
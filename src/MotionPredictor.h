@@ -0,0 +1,74 @@
+#ifndef MOTION_PREDICTOR_H
+#define MOTION_PREDICTOR_H
+
+
+#include <glm.hpp>
+#include <gtc/quaternion.hpp>
+#include <deque>
+
+
+/*
+* MotionPredictor extrapolates the pose (OutputCamera::model) of the viewer, whether it is controlled by the mouse
+* and keyboard or by the HMD, so the inputs it will need can be decoded before they are used for rendering.
+*
+* addPose() is called once per video frame. The velocity and angular velocity are averaged over the last
+* historySize poses, which smooths out the jitter of HMD tracking, and kept constant for the prediction.
+*/
+class MotionPredictor {
+private:
+	struct Pose {
+		glm::vec3 position;
+		glm::quat rotation;
+	};
+
+	std::deque<Pose> poses;
+	int historySize = 4;
+
+public:
+	MotionPredictor() {}
+
+	MotionPredictor(int historySize) : historySize(historySize < 2 ? 2 : historySize) {}
+
+	void addPose(const glm::mat4& model) {
+		Pose pose;
+		pose.position = glm::vec3(model[3]);
+		pose.rotation = glm::normalize(glm::quat_cast(glm::mat3(model)));
+		poses.push_back(pose);
+		if (poses.size() > historySize) {
+			poses.pop_front();
+		}
+	}
+
+	// the pose nrFrames video frames after the last one that was added
+	glm::mat4 predict(int nrFrames) const {
+		if (poses.empty()) {
+			return glm::mat4(1);
+		}
+		const Pose& first = poses.front();
+		const Pose& last = poses.back();
+		glm::vec3 position = last.position;
+		glm::quat rotation = last.rotation;
+		if (poses.size() >= 2) {
+			float nrSteps = float(poses.size() - 1);
+			position += (last.position - first.position) / nrSteps * float(nrFrames);
+
+			glm::quat delta = last.rotation * glm::inverse(first.rotation);
+			if (delta.w < 0) {
+				delta = -delta; // take the shortest path
+			}
+			float angle = glm::angle(delta);
+			if (angle > 1e-4f) {
+				rotation = glm::normalize(glm::angleAxis(angle / nrSteps * float(nrFrames), glm::axis(delta)) * last.rotation);
+			}
+		}
+		glm::mat4 model = glm::mat4_cast(rotation);
+		model[3] = glm::vec4(position, 1);
+		return model;
+	}
+
+	void reset() {
+		poses.clear();
+	}
+};
+
+#endif
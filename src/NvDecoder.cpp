@@ -173,7 +173,8 @@ int NvDecoder::HandleVideoSequence(CUVIDEOFORMAT *pVideoFormat)
     ;
     m_videoInfo << std::endl;
 
-    int nDecodeSurface = pVideoFormat->min_num_decode_surfaces;
+    // extra surfaces so decoded frames are not overwritten while they wait to be copied to the OpenGL texture
+    int nDecodeSurface = (std::min)((int)pVideoFormat->min_num_decode_surfaces + m_nDecodeAhead, 32);
 
     CUVIDDECODECAPS decodecaps;
     memset(&decodecaps, 0, sizeof(decodecaps));
@@ -339,9 +340,12 @@ int NvDecoder::HandlePictureDecode(CUVIDPICPARAMS *pPicParams) {
 *  0: fail, >=1: succeeded
 */
 int NvDecoder::HandlePictureDisplay(int decoded_picture_index) {
-	if (decoded_picture_index < 0) {
+	if (decoded_picture_index < 0 || !glGraphicsResource) {
 		return -1;
 	}
+	if (IsCachedPicture(decoded_picture_index)) {
+		return HandleCachedPictureDisplay(decoded_picture_index - cachedPictureOffset);
+	}
     CUVIDPROCPARAMS videoProcessingParameters = {};
 	memset(&videoProcessingParameters, 0, sizeof(videoProcessingParameters));
 
@@ -387,8 +391,86 @@ int NvDecoder::HandlePictureDisplay(int decoded_picture_index) {
     return 1;
 }
 
-NvDecoder::NvDecoder(CUcontext* cuContext, CUgraphicsResource* glGraphicsResource, bool isColor, cudaVideoCodec eCodec, bool printInfo, unsigned int clkRate) :
-    m_cuContext(cuContext), glGraphicsResource(glGraphicsResource), isColor(isColor), printInfo(printInfo), m_eCodec(eCodec)
+int NvDecoder::HandleCachedPictureDisplay(int cacheIndex) {
+	size_t nWidthInBytes = GetWidth() * m_nBPP;
+	CUDA_DRVAPI_CALL(cuCtxPushCurrent(*m_cuContext));
+	CUarray MYmappedArray;
+	ck(cuGraphicsMapResources(1, glGraphicsResource, 0));
+	ck(cuGraphicsSubResourceGetMappedArray(&MYmappedArray, *glGraphicsResource, 0, 0));
+
+	CUDA_MEMCPY2D m = { 0 };
+	m.srcMemoryType = CU_MEMORYTYPE_DEVICE;
+	m.srcDevice = m_dpFrameCache + cacheIndex * GetCachedFrameSize();
+	m.srcPitch = nWidthInBytes;
+	m.dstMemoryType = CU_MEMORYTYPE_ARRAY;
+	m.dstArray = MYmappedArray;
+	m.WidthInBytes = nWidthInBytes;
+	m.Height = GetCachedFrameSize() / nWidthInBytes;
+	CUDA_DRVAPI_CALL(cuMemcpy2D(&m));
+	ck(cuGraphicsUnmapResources(1, glGraphicsResource, 0));
+	CUDA_DRVAPI_CALL(cuCtxPopCurrent(NULL));
+	return 1;
+}
+
+size_t NvDecoder::GetCachedFrameSize() {
+	// the same rows that HandlePictureDisplay() copies to the OpenGL texture
+	size_t nHeight = isColor ? m_nSurfaceHeight + size_t(m_nLumaHeight / 2) : m_nLumaHeight;
+	return GetWidth() * m_nBPP * nHeight;
+}
+
+bool NvDecoder::EnableFrameCache(int nrFrames) {
+	CUDA_DRVAPI_CALL(cuCtxPushCurrent(*m_cuContext));
+	CUresult result = cuMemAlloc(&m_dpFrameCache, nrFrames * GetCachedFrameSize());
+	CUDA_DRVAPI_CALL(cuCtxPopCurrent(NULL));
+	if (result != CUDA_SUCCESS) {
+		m_dpFrameCache = 0;
+		return false;
+	}
+	m_nCachedFrames = nrFrames;
+	return true;
+}
+
+// called by a thread of the Pool, while the OpenGL thread may map another picture in HandlePictureDisplay(),
+// which is fine since the decoder is created with 2 output surfaces (ulNumOutputSurfaces)
+void NvDecoder::CacheFrame(int decoded_picture_index, int cacheIndex) {
+	if (!m_dpFrameCache || decoded_picture_index < 0 || cacheIndex >= m_nCachedFrames) {
+		return;
+	}
+	CUVIDPROCPARAMS videoProcessingParameters = {};
+	CUdeviceptr dpSrcFrame = 0;
+	unsigned int nSrcPitch = 0;
+	CUDA_DRVAPI_CALL(cuCtxPushCurrent(*m_cuContext));
+	NVDEC_API_CALL(cuvidMapVideoFrame(m_hDecoder, decoded_picture_index, &dpSrcFrame, &nSrcPitch, &videoProcessingParameters));
+
+	size_t nWidthInBytes = GetWidth() * m_nBPP;
+	CUDA_MEMCPY2D m = { 0 };
+	m.srcMemoryType = CU_MEMORYTYPE_DEVICE;
+	m.srcDevice = dpSrcFrame;
+	m.srcPitch = nSrcPitch;
+	m.dstMemoryType = CU_MEMORYTYPE_DEVICE;
+	m.dstDevice = m_dpFrameCache + cacheIndex * GetCachedFrameSize();
+	m.dstPitch = nWidthInBytes;
+	m.WidthInBytes = nWidthInBytes;
+	m.Height = GetCachedFrameSize() / nWidthInBytes;
+	CUDA_DRVAPI_CALL(cuMemcpy2D(&m));
+
+	NVDEC_API_CALL(cuvidUnmapVideoFrame(m_hDecoder, dpSrcFrame));
+	CUDA_DRVAPI_CALL(cuCtxPopCurrent(NULL));
+}
+
+void NvDecoder::DisableFrameCache() {
+	if (!m_dpFrameCache) {
+		return;
+	}
+	CUDA_DRVAPI_CALL(cuCtxPushCurrent(*m_cuContext));
+	CUDA_DRVAPI_CALL(cuMemFree(m_dpFrameCache));
+	CUDA_DRVAPI_CALL(cuCtxPopCurrent(NULL));
+	m_dpFrameCache = 0;
+	m_nCachedFrames = 0;
+}
+
+NvDecoder::NvDecoder(CUcontext* cuContext, CUgraphicsResource* glGraphicsResource, bool isColor, cudaVideoCodec eCodec, int decodeAhead, bool printInfo, unsigned int clkRate) :
+    Decoder(isColor), m_cuContext(cuContext), glGraphicsResource(glGraphicsResource), printInfo(printInfo), m_nDecodeAhead(decodeAhead), m_eCodec(eCodec)
 {
     NVDEC_API_CALL(cuvidCtxLockCreate(&m_ctxLock, *cuContext));
 
@@ -406,7 +488,9 @@ NvDecoder::NvDecoder(CUcontext* cuContext, CUgraphicsResource* glGraphicsResourc
     videoParserParameters.pfnGetOperatingPoint = HandleOperatingPointProc;
     NVDEC_API_CALL(cuvidCreateVideoParser(&m_hParser, &videoParserParameters));
 
-	ck(cuGraphicsResourceSetMapFlags(*glGraphicsResource, CU_GRAPHICS_MAP_RESOURCE_FLAGS_WRITE_DISCARD));
+	if (glGraphicsResource) {
+		ck(cuGraphicsResourceSetMapFlags(*glGraphicsResource, CU_GRAPHICS_MAP_RESOURCE_FLAGS_WRITE_DISCARD));
+	}
 }
 
 NvDecoder::~NvDecoder() {
@@ -417,13 +501,16 @@ NvDecoder::~NvDecoder() {
     if (m_hDecoder) {
         cuvidDestroyDecoder(m_hDecoder);
     }
+    if (m_dpFrameCache) {
+        cuMemFree(m_dpFrameCache);
+    }
     cuCtxPopCurrent(NULL);
 
     cuvidCtxLockDestroy(m_ctxLock);
 
 }
 
-void NvDecoder::Decode(const uint8_t *pData, int nSize, int nFlags, int64_t nTimestamp)
+bool NvDecoder::Decode(const uint8_t *pData, int nSize, int nFlags, int64_t nTimestamp)
 {
     CUVIDSOURCEDATAPACKET packet = { 0 };
     packet.payload = pData;
@@ -435,5 +522,6 @@ void NvDecoder::Decode(const uint8_t *pData, int nSize, int nFlags, int64_t nTim
     }
     NVDEC_API_CALL(cuvidParseVideoData(m_hParser, &packet));
     m_cuvidStream = 0;
+    return true;
 }
 
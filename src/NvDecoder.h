@@ -22,6 +22,7 @@
 #include <string.h>
 #include "nvcuvid.h"
 #include "NvCodecUtils.h"
+#include "Decoder.h"
 #include <map>
 
 /**
@@ -73,7 +74,7 @@ inline NVDECException NVDECException::makeNVDECException(const std::string& erro
     } while (0)
 
 /**
-* @brief Base class for decoder interface.
+* @brief NVDEC implementation of the Decoder interface.
 * NvDecoder is derived from NVidia's NvDecoder class. 
 * HandleVideoSequence(): initializes the NVidia decoder on the GPU. Called after the constructor.
 * Decode(): takes care of sending the FFMPEG demuxed packets to the GPU. Called in the OpenGL rendering loop.
@@ -81,15 +82,17 @@ inline NVDECException NVDECException::makeNVDECException(const std::string& erro
 * HandlePictureDisplay(): copies the decoded video frame to the correct OpenGL texture, ready to use for display.
 *                         called by HandlePictureDecode().
 */
-class NvDecoder {
+class NvDecoder : public Decoder {
 
 public:
     /**
     *  @brief This function is used to initialize the decoder session.
     *  Application must call this function to initialize the decoder, before
     *  starting to decode any frames.
+    *  decodeAhead is the number of decoded frames that can wait to be copied to the OpenGL texture,
+    *  for each of them an extra decode surface is allocated.
     */
-    NvDecoder(CUcontext* cuContext, CUgraphicsResource* glGraphicsResource, bool isColor, cudaVideoCodec eCodec, bool printInfo = false, unsigned int clkRate = 1000);
+    NvDecoder(CUcontext* cuContext, CUgraphicsResource* glGraphicsResource, bool isColor, cudaVideoCodec eCodec, int decodeAhead = 1, bool printInfo = false, unsigned int clkRate = 1000);
     ~NvDecoder();
 
 
@@ -183,7 +186,7 @@ public:
     *   @param  nFlags - CUvideopacketflags for setting decode options
     *   @param  nTimestamp - presentation timestamp
     */
-    void Decode(const uint8_t *pData, int nSize, int nFlags = 0, int64_t nTimestamp = 0);
+    bool Decode(const uint8_t *pData, int nSize, int nFlags = 0, int64_t nTimestamp = 0);
 
     void setDecoderSessionID(int sessionID) { decoderSessionID = sessionID; }
     int getDecoderSessionID() { return decoderSessionID; }
@@ -194,6 +197,29 @@ public:
 	*/
 	int HandlePictureDisplay(int decoded_picture_index);
 
+    /**
+    *   @brief  The parser only hands a picture to the decoder once the next packet has arrived
+    */
+    int OutputDelay() { return 1; }
+
+    /**
+    *   @brief  Not used, HandlePictureDisplay() copies to the texture registered with SetGraphicsResource(), see Decoder
+    */
+    void SetTexture(GLuint texture) {}
+
+    /**
+    *   @brief  Changes the CUDA registration of the OpenGL texture that HandlePictureDisplay() copies to
+    */
+    void SetGraphicsResource(CUgraphicsResource* graphicsResource) { glGraphicsResource = graphicsResource; }
+
+    /**
+    *   @brief  Frame cache in GPU memory, see Decoder
+    */
+    size_t GetCachedFrameSize();
+    bool EnableFrameCache(int nrFrames);
+    void CacheFrame(int decoded_picture_index, int cacheIndex);
+    void DisableFrameCache();
+
 
 private:
     int decoderSessionID; // Decoder session identifier. Used to gather session level stats.
@@ -226,6 +252,11 @@ private:
     */
     int HandlePictureDecode(CUVIDPICPARAMS *pPicParams);
 
+    /**
+    *   @brief  Copies a frame from the frame cache to the OpenGL texture
+    */
+    int HandleCachedPictureDisplay(int cacheIndex);
+
     /**
     *   @brief  This function gets called when AV1 sequence encounter more than one operating points
     */
@@ -256,10 +287,9 @@ private:
     unsigned int m_nOperatingPoint = 0;
     bool  m_bDispAllLayers = false;
     bool printInfo = false;
+    int m_nDecodeAhead = 1;
+    CUdeviceptr m_dpFrameCache = 0;
+    int m_nCachedFrames = 0;
 
-public:
-	bool isColor = true;
-	int picture_index = -1;
-private:
 	CUgraphicsResource* glGraphicsResource = NULL;
 };
@@ -0,0 +1,442 @@
+#ifndef PIXEL_CONVERSION_H
+#define PIXEL_CONVERSION_H
+
+
+#include <stdint.h>
+#include <stddef.h>
+#include <string>
+
+#if defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+#define PIXEL_CONVERSION_SSE2
+#define PIXEL_CONVERSION_AVX2
+#include <immintrin.h>
+#if defined(_MSC_VER) && !defined(__clang__)
+#include <intrin.h>
+#endif
+#endif
+#if defined(__ARM_NEON) || defined(__ARM_NEON__)
+#define PIXEL_CONVERSION_NEON
+#include <arm_neon.h>
+#endif
+
+// AVX2 functions are compiled for AVX2 without -mavx2 for the whole program, they are only called if the CPU has AVX2
+#if defined(PIXEL_CONVERSION_AVX2) && (defined(__GNUC__) || defined(__clang__))
+#define PIXEL_CONVERSION_TARGET_AVX2 __attribute__((target("avx2")))
+#else
+#define PIXEL_CONVERSION_TARGET_AVX2
+#endif
+
+
+/*
+* Conversion of the framebuffer that is read back with glReadPixels (RGBA, rows bottom to top) to the planar
+* layouts of the .yuv output files. When the output is saved, the shaders do not convert YCbCr to RGB,
+* so the R, G and B channels hold Y, Cb and Cr. The vertical flip is done while converting.
+*
+* The row kernels have a scalar, SSE2, AVX2 and NEON version. The fastest one the CPU supports is chosen once, at runtime.
+* The 10- and 16-bit formats are written in the byte order of the host, i.e. little endian on x86 and ARM.
+*/
+enum class OutputPixelFormat {
+	YUV444P,     // 3 full resolution 8-bit planes
+	YUV420P,     // full resolution Y, Cb and Cr at half resolution in both dimensions (averages of 2x2 pixels)
+	YUV444P10LE, // 3 full resolution planes of 16-bit little-endian values in [0,1023]
+	YUV444P16LE  // 3 full resolution planes of 16-bit little-endian values in [0,65535]
+};
+
+bool parseOutputPixelFormat(const std::string& name, /*out*/ OutputPixelFormat& format) {
+	if (name == "yuv444p") {
+		format = OutputPixelFormat::YUV444P;
+	}
+	else if (name == "yuv420p") {
+		format = OutputPixelFormat::YUV420P;
+	}
+	else if (name == "yuv444p10le") {
+		format = OutputPixelFormat::YUV444P10LE;
+	}
+	else if (name == "yuv444p16le") {
+		format = OutputPixelFormat::YUV444P16LE;
+	}
+	else {
+		return false;
+	}
+	return true;
+}
+
+const char* outputPixelFormatName(OutputPixelFormat format) {
+	switch (format) {
+	case OutputPixelFormat::YUV420P: return "yuv420p";
+	case OutputPixelFormat::YUV444P10LE: return "yuv444p10le";
+	case OutputPixelFormat::YUV444P16LE: return "yuv444p16le";
+	default: return "yuv444p";
+	}
+}
+
+// YUV420P averages the chroma of 2x2 pixels, so it needs an even width and height
+bool isOutputSizeSupported(OutputPixelFormat format, int width, int height) {
+	return format != OutputPixelFormat::YUV420P || (width % 2 == 0 && height % 2 == 0);
+}
+
+// the number of bytes of one frame, width and height need to be even for YUV420P
+size_t outputFrameSize(OutputPixelFormat format, int width, int height) {
+	size_t pixels = (size_t)width * height;
+	switch (format) {
+	case OutputPixelFormat::YUV420P: return pixels + 2 * (pixels / 4);
+	case OutputPixelFormat::YUV444P10LE:
+	case OutputPixelFormat::YUV444P16LE: return 3 * pixels * 2;
+	default: return 3 * pixels;
+	}
+}
+
+
+// n RGBA pixels to n Y, Cb and Cr values
+typedef void (*RowToPlanar8)(const uint8_t* rgba, int n, uint8_t* y, uint8_t* cb, uint8_t* cr);
+// idem, with the values scaled from 8 bits to bitDepth bits (in [9,16])
+typedef void (*RowToPlanar16)(const uint8_t* rgba, int n, uint16_t* y, uint16_t* cb, uint16_t* cr, int bitDepth);
+// 2 rows of n RGBA pixels (n even) to 2 rows of n Y values and n/2 Cb and Cr values
+typedef void (*RowsTo420)(const uint8_t* rgba0, const uint8_t* rgba1, int n, uint8_t* y0, uint8_t* y1, uint8_t* cb, uint8_t* cr);
+
+struct PixelKernels {
+	const char* name;
+	RowToPlanar8 toPlanar8;
+	RowToPlanar16 toPlanar16;
+	RowsTo420 to420;
+};
+
+
+// scalar versions, also used for the pixels at the end of a row that do not fill a vector
+
+void rowToPlanar8_scalar(const uint8_t* rgba, int n, uint8_t* y, uint8_t* cb, uint8_t* cr) {
+	for (int i = 0; i < n; i++) {
+		y[i] = rgba[4 * i];
+		cb[i] = rgba[4 * i + 1];
+		cr[i] = rgba[4 * i + 2];
+	}
+}
+
+// replicates the high bits in the new low bits, so 0 maps to 0 and 255 to the maximum value
+inline uint16_t expandTo(uint8_t v, int bitDepth) {
+	return (uint16_t)((v << (bitDepth - 8)) | (v >> (16 - bitDepth)));
+}
+
+void rowToPlanar16_scalar(const uint8_t* rgba, int n, uint16_t* y, uint16_t* cb, uint16_t* cr, int bitDepth) {
+	for (int i = 0; i < n; i++) {
+		y[i] = expandTo(rgba[4 * i], bitDepth);
+		cb[i] = expandTo(rgba[4 * i + 1], bitDepth);
+		cr[i] = expandTo(rgba[4 * i + 2], bitDepth);
+	}
+}
+
+void rowsTo420_scalar(const uint8_t* rgba0, const uint8_t* rgba1, int n, uint8_t* y0, uint8_t* y1, uint8_t* cb, uint8_t* cr) {
+	for (int i = 0; i < n; i++) {
+		y0[i] = rgba0[4 * i];
+		y1[i] = rgba1[4 * i];
+	}
+	for (int i = 0; i < n / 2; i++) {
+		const uint8_t* p0 = rgba0 + 8 * i;
+		const uint8_t* p1 = rgba1 + 8 * i;
+		cb[i] = (uint8_t)((p0[1] + p0[5] + p1[1] + p1[5] + 2) >> 2);
+		cr[i] = (uint8_t)((p0[2] + p0[6] + p1[2] + p1[6] + 2) >> 2);
+	}
+}
+
+
+#ifdef PIXEL_CONVERSION_SSE2
+
+// channel c of 8 RGBA pixels as 8 16-bit values
+inline __m128i channel8x16_sse2(__m128i a0, __m128i a1, int c) {
+	const __m128i mask = _mm_set1_epi32(0xFF);
+	const __m128i shift = _mm_cvtsi32_si128(8 * c);
+	return _mm_packs_epi32(_mm_and_si128(_mm_srl_epi32(a0, shift), mask), _mm_and_si128(_mm_srl_epi32(a1, shift), mask));
+}
+
+void rowToPlanar8_sse2(const uint8_t* rgba, int n, uint8_t* y, uint8_t* cb, uint8_t* cr) {
+	uint8_t* planes[3] = { y, cb, cr };
+	int i = 0;
+	for (; i + 16 <= n; i += 16) {
+		const __m128i* p = reinterpret_cast<const __m128i*>(rgba + 4 * i);
+		__m128i a0 = _mm_loadu_si128(p);
+		__m128i a1 = _mm_loadu_si128(p + 1);
+		__m128i a2 = _mm_loadu_si128(p + 2);
+		__m128i a3 = _mm_loadu_si128(p + 3);
+		for (int c = 0; c < 3; c++) {
+			__m128i v = _mm_packus_epi16(channel8x16_sse2(a0, a1, c), channel8x16_sse2(a2, a3, c));
+			_mm_storeu_si128(reinterpret_cast<__m128i*>(planes[c] + i), v);
+		}
+	}
+	rowToPlanar8_scalar(rgba + 4 * i, n - i, y + i, cb + i, cr + i);
+}
+
+void rowToPlanar16_sse2(const uint8_t* rgba, int n, uint16_t* y, uint16_t* cb, uint16_t* cr, int bitDepth) {
+	uint16_t* planes[3] = { y, cb, cr };
+	const __m128i left = _mm_cvtsi32_si128(bitDepth - 8);
+	const __m128i right = _mm_cvtsi32_si128(16 - bitDepth);
+	int i = 0;
+	for (; i + 8 <= n; i += 8) {
+		const __m128i* p = reinterpret_cast<const __m128i*>(rgba + 4 * i);
+		__m128i a0 = _mm_loadu_si128(p);
+		__m128i a1 = _mm_loadu_si128(p + 1);
+		for (int c = 0; c < 3; c++) {
+			__m128i v = channel8x16_sse2(a0, a1, c);
+			v = _mm_or_si128(_mm_sll_epi16(v, left), _mm_srl_epi16(v, right));
+			_mm_storeu_si128(reinterpret_cast<__m128i*>(planes[c] + i), v);
+		}
+	}
+	rowToPlanar16_scalar(rgba + 4 * i, n - i, y + i, cb + i, cr + i, bitDepth);
+}
+
+void rowsTo420_sse2(const uint8_t* rgba0, const uint8_t* rgba1, int n, uint8_t* y0, uint8_t* y1, uint8_t* cb, uint8_t* cr) {
+	uint8_t* chroma[2] = { cb, cr };
+	const __m128i ones = _mm_set1_epi16(1);
+	const __m128i two = _mm_set1_epi32(2);
+	int i = 0;
+	for (; i + 16 <= n; i += 16) {
+		const __m128i* p0 = reinterpret_cast<const __m128i*>(rgba0 + 4 * i);
+		const __m128i* p1 = reinterpret_cast<const __m128i*>(rgba1 + 4 * i);
+		__m128i a[4], b[4];
+		for (int k = 0; k < 4; k++) {
+			a[k] = _mm_loadu_si128(p0 + k);
+			b[k] = _mm_loadu_si128(p1 + k);
+		}
+		_mm_storeu_si128(reinterpret_cast<__m128i*>(y0 + i), _mm_packus_epi16(channel8x16_sse2(a[0], a[1], 0), channel8x16_sse2(a[2], a[3], 0)));
+		_mm_storeu_si128(reinterpret_cast<__m128i*>(y1 + i), _mm_packus_epi16(channel8x16_sse2(b[0], b[1], 0), channel8x16_sse2(b[2], b[3], 0)));
+		for (int c = 1; c < 3; c++) {
+			// vertical sums of 16 pixels, then madd adds the horizontal neighbours
+			__m128i s01 = _mm_add_epi16(channel8x16_sse2(a[0], a[1], c), channel8x16_sse2(b[0], b[1], c));
+			__m128i s23 = _mm_add_epi16(channel8x16_sse2(a[2], a[3], c), channel8x16_sse2(b[2], b[3], c));
+			__m128i q01 = _mm_srli_epi32(_mm_add_epi32(_mm_madd_epi16(s01, ones), two), 2);
+			__m128i q23 = _mm_srli_epi32(_mm_add_epi32(_mm_madd_epi16(s23, ones), two), 2);
+			__m128i q = _mm_packs_epi32(q01, q23);
+			_mm_storel_epi64(reinterpret_cast<__m128i*>(chroma[c - 1] + i / 2), _mm_packus_epi16(q, q));
+		}
+	}
+	rowsTo420_scalar(rgba0 + 4 * i, rgba1 + 4 * i, n - i, y0 + i, y1 + i, cb + i / 2, cr + i / 2);
+}
+
+#endif // PIXEL_CONVERSION_SSE2
+
+
+#ifdef PIXEL_CONVERSION_AVX2
+
+// channel c of 16 RGBA pixels as 16 16-bit values, in order
+PIXEL_CONVERSION_TARGET_AVX2 inline __m256i channel16x16_avx2(__m256i a0, __m256i a1, int c) {
+	const __m256i mask = _mm256_set1_epi32(0xFF);
+	const __m128i shift = _mm_cvtsi32_si128(8 * c);
+	__m256i v = _mm256_packs_epi32(_mm256_and_si256(_mm256_srl_epi32(a0, shift), mask), _mm256_and_si256(_mm256_srl_epi32(a1, shift), mask));
+	// packs works per 128-bit lane: a0lo a1lo | a0hi a1hi -> a0lo a0hi | a1lo a1hi
+	return _mm256_permute4x64_epi64(v, 0xD8);
+}
+
+PIXEL_CONVERSION_TARGET_AVX2 void rowToPlanar8_avx2(const uint8_t* rgba, int n, uint8_t* y, uint8_t* cb, uint8_t* cr) {
+	uint8_t* planes[3] = { y, cb, cr };
+	int i = 0;
+	for (; i + 32 <= n; i += 32) {
+		const __m256i* p = reinterpret_cast<const __m256i*>(rgba + 4 * i);
+		__m256i a0 = _mm256_loadu_si256(p);
+		__m256i a1 = _mm256_loadu_si256(p + 1);
+		__m256i a2 = _mm256_loadu_si256(p + 2);
+		__m256i a3 = _mm256_loadu_si256(p + 3);
+		for (int c = 0; c < 3; c++) {
+			__m256i v = _mm256_packus_epi16(channel16x16_avx2(a0, a1, c), channel16x16_avx2(a2, a3, c));
+			v = _mm256_permute4x64_epi64(v, 0xD8);
+			_mm256_storeu_si256(reinterpret_cast<__m256i*>(planes[c] + i), v);
+		}
+	}
+	rowToPlanar8_scalar(rgba + 4 * i, n - i, y + i, cb + i, cr + i);
+}
+
+PIXEL_CONVERSION_TARGET_AVX2 void rowToPlanar16_avx2(const uint8_t* rgba, int n, uint16_t* y, uint16_t* cb, uint16_t* cr, int bitDepth) {
+	uint16_t* planes[3] = { y, cb, cr };
+	const __m128i left = _mm_cvtsi32_si128(bitDepth - 8);
+	const __m128i right = _mm_cvtsi32_si128(16 - bitDepth);
+	int i = 0;
+	for (; i + 16 <= n; i += 16) {
+		const __m256i* p = reinterpret_cast<const __m256i*>(rgba + 4 * i);
+		__m256i a0 = _mm256_loadu_si256(p);
+		__m256i a1 = _mm256_loadu_si256(p + 1);
+		for (int c = 0; c < 3; c++) {
+			__m256i v = channel16x16_avx2(a0, a1, c);
+			v = _mm256_or_si256(_mm256_sll_epi16(v, left), _mm256_srl_epi16(v, right));
+			_mm256_storeu_si256(reinterpret_cast<__m256i*>(planes[c] + i), v);
+		}
+	}
+	rowToPlanar16_scalar(rgba + 4 * i, n - i, y + i, cb + i, cr + i, bitDepth);
+}
+
+PIXEL_CONVERSION_TARGET_AVX2 void rowsTo420_avx2(const uint8_t* rgba0, const uint8_t* rgba1, int n, uint8_t* y0, uint8_t* y1, uint8_t* cb, uint8_t* cr) {
+	uint8_t* chroma[2] = { cb, cr };
+	const __m256i ones = _mm256_set1_epi16(1);
+	const __m256i two = _mm256_set1_epi32(2);
+	int i = 0;
+	for (; i + 32 <= n; i += 32) {
+		const __m256i* p0 = reinterpret_cast<const __m256i*>(rgba0 + 4 * i);
+		const __m256i* p1 = reinterpret_cast<const __m256i*>(rgba1 + 4 * i);
+		__m256i a[4], b[4];
+		for (int k = 0; k < 4; k++) {
+			a[k] = _mm256_loadu_si256(p0 + k);
+			b[k] = _mm256_loadu_si256(p1 + k);
+		}
+		__m256i v0 = _mm256_packus_epi16(channel16x16_avx2(a[0], a[1], 0), channel16x16_avx2(a[2], a[3], 0));
+		__m256i v1 = _mm256_packus_epi16(channel16x16_avx2(b[0], b[1], 0), channel16x16_avx2(b[2], b[3], 0));
+		_mm256_storeu_si256(reinterpret_cast<__m256i*>(y0 + i), _mm256_permute4x64_epi64(v0, 0xD8));
+		_mm256_storeu_si256(reinterpret_cast<__m256i*>(y1 + i), _mm256_permute4x64_epi64(v1, 0xD8));
+		for (int c = 1; c < 3; c++) {
+			__m256i s01 = _mm256_add_epi16(channel16x16_avx2(a[0], a[1], c), channel16x16_avx2(b[0], b[1], c));
+			__m256i s23 = _mm256_add_epi16(channel16x16_avx2(a[2], a[3], c), channel16x16_avx2(b[2], b[3], c));
+			__m256i q01 = _mm256_srli_epi32(_mm256_add_epi32(_mm256_madd_epi16(s01, ones), two), 2);
+			__m256i q23 = _mm256_srli_epi32(_mm256_add_epi32(_mm256_madd_epi16(s23, ones), two), 2);
+			__m256i q = _mm256_permute4x64_epi64(_mm256_packs_epi32(q01, q23), 0xD8);
+			q = _mm256_permute4x64_epi64(_mm256_packus_epi16(q, q), 0xD8);
+			_mm_storeu_si128(reinterpret_cast<__m128i*>(chroma[c - 1] + i / 2), _mm256_castsi256_si128(q));
+		}
+	}
+	rowsTo420_scalar(rgba0 + 4 * i, rgba1 + 4 * i, n - i, y0 + i, y1 + i, cb + i / 2, cr + i / 2);
+}
+
+bool cpuSupportsAVX2() {
+#if defined(_MSC_VER) && !defined(__clang__)
+	int info[4];
+	__cpuid(info, 0);
+	if (info[0] < 7) {
+		return false;
+	}
+	__cpuid(info, 1);
+	bool osxsave = (info[2] & (1 << 27)) != 0;
+	bool avx = (info[2] & (1 << 28)) != 0;
+	// the OS also needs to save the ymm registers
+	if (!osxsave || !avx || (_xgetbv(0) & 6) != 6) {
+		return false;
+	}
+	__cpuidex(info, 7, 0);
+	return (info[1] & (1 << 5)) != 0;
+#else
+	__builtin_cpu_init();
+	return __builtin_cpu_supports("avx2") != 0;
+#endif
+}
+
+#endif // PIXEL_CONVERSION_AVX2
+
+
+#ifdef PIXEL_CONVERSION_NEON
+
+void rowToPlanar8_neon(const uint8_t* rgba, int n, uint8_t* y, uint8_t* cb, uint8_t* cr) {
+	int i = 0;
+	for (; i + 16 <= n; i += 16) {
+		uint8x16x4_t p = vld4q_u8(rgba + 4 * i);
+		vst1q_u8(y + i, p.val[0]);
+		vst1q_u8(cb + i, p.val[1]);
+		vst1q_u8(cr + i, p.val[2]);
+	}
+	rowToPlanar8_scalar(rgba + 4 * i, n - i, y + i, cb + i, cr + i);
+}
+
+void rowToPlanar16_neon(const uint8_t* rgba, int n, uint16_t* y, uint16_t* cb, uint16_t* cr, int bitDepth) {
+	uint16_t* planes[3] = { y, cb, cr };
+	const int16x8_t left = vdupq_n_s16((int16_t)(bitDepth - 8));
+	const int16x8_t right = vdupq_n_s16((int16_t)(bitDepth - 16)); // negative: shift right
+	int i = 0;
+	for (; i + 16 <= n; i += 16) {
+		uint8x16x4_t p = vld4q_u8(rgba + 4 * i);
+		for (int c = 0; c < 3; c++) {
+			uint16x8_t lo = vmovl_u8(vget_low_u8(p.val[c]));
+			uint16x8_t hi = vmovl_u8(vget_high_u8(p.val[c]));
+			vst1q_u16(planes[c] + i, vorrq_u16(vshlq_u16(lo, left), vshlq_u16(lo, right)));
+			vst1q_u16(planes[c] + i + 8, vorrq_u16(vshlq_u16(hi, left), vshlq_u16(hi, right)));
+		}
+	}
+	rowToPlanar16_scalar(rgba + 4 * i, n - i, y + i, cb + i, cr + i, bitDepth);
+}
+
+void rowsTo420_neon(const uint8_t* rgba0, const uint8_t* rgba1, int n, uint8_t* y0, uint8_t* y1, uint8_t* cb, uint8_t* cr) {
+	int i = 0;
+	for (; i + 16 <= n; i += 16) {
+		uint8x16x4_t p0 = vld4q_u8(rgba0 + 4 * i);
+		uint8x16x4_t p1 = vld4q_u8(rgba1 + 4 * i);
+		vst1q_u8(y0 + i, p0.val[0]);
+		vst1q_u8(y1 + i, p1.val[0]);
+		// pairwise sums of both rows, then (sum + 2) >> 2
+		vst1_u8(cb + i / 2, vrshrn_n_u16(vpadalq_u8(vpaddlq_u8(p0.val[1]), p1.val[1]), 2));
+		vst1_u8(cr + i / 2, vrshrn_n_u16(vpadalq_u8(vpaddlq_u8(p0.val[2]), p1.val[2]), 2));
+	}
+	rowsTo420_scalar(rgba0 + 4 * i, rgba1 + 4 * i, n - i, y0 + i, y1 + i, cb + i / 2, cr + i / 2);
+}
+
+#endif // PIXEL_CONVERSION_NEON
+
+
+PixelKernels selectPixelKernels() {
+#ifdef PIXEL_CONVERSION_AVX2
+	if (cpuSupportsAVX2()) {
+		return { "AVX2", rowToPlanar8_avx2, rowToPlanar16_avx2, rowsTo420_avx2 };
+	}
+#endif
+#ifdef PIXEL_CONVERSION_SSE2
+	return { "SSE2", rowToPlanar8_sse2, rowToPlanar16_sse2, rowsTo420_sse2 };
+#elif defined(PIXEL_CONVERSION_NEON)
+	return { "NEON", rowToPlanar8_neon, rowToPlanar16_neon, rowsTo420_neon };
+#else
+	return { "scalar", rowToPlanar8_scalar, rowToPlanar16_scalar, rowsTo420_scalar };
+#endif
+}
+
+// chosen on the first call
+const PixelKernels& getPixelKernels() {
+	static PixelKernels kernels = selectPixelKernels();
+	return kernels;
+}
+
+// rgba: width * height RGBA pixels, rows bottom to top (as read by glReadPixels)
+// planes: the Y, Cb and Cr planes, rows top to bottom, with linesizes[i] bytes between the rows of plane i
+// kernels: the row kernels to use, see getPixelKernels()
+void convertRGBAToPlanes(const PixelKernels& kernels, OutputPixelFormat format, const uint8_t* rgba, int width, int height, uint8_t* const planes[3], const int linesizes[3]) {
+	size_t stride = (size_t)width * 4;
+	if (format == OutputPixelFormat::YUV420P) {
+		for (int row = 0; row + 1 < height; row += 2) {
+			const uint8_t* src0 = rgba + (size_t)(height - row - 1) * stride;
+			kernels.to420(src0, src0 - stride, width, planes[0] + (size_t)row * linesizes[0], planes[0] + (size_t)(row + 1) * linesizes[0],
+				planes[1] + (size_t)(row / 2) * linesizes[1], planes[2] + (size_t)(row / 2) * linesizes[2]);
+		}
+	}
+	else if (format == OutputPixelFormat::YUV444P10LE || format == OutputPixelFormat::YUV444P16LE) {
+		int bitDepth = format == OutputPixelFormat::YUV444P10LE ? 10 : 16;
+		for (int row = 0; row < height; row++) {
+			uint16_t* y = reinterpret_cast<uint16_t*>(planes[0] + (size_t)row * linesizes[0]);
+			uint16_t* cb = reinterpret_cast<uint16_t*>(planes[1] + (size_t)row * linesizes[1]);
+			uint16_t* cr = reinterpret_cast<uint16_t*>(planes[2] + (size_t)row * linesizes[2]);
+			kernels.toPlanar16(rgba + (size_t)(height - row - 1) * stride, width, y, cb, cr, bitDepth);
+		}
+	}
+	else {
+		for (int row = 0; row < height; row++) {
+			kernels.toPlanar8(rgba + (size_t)(height - row - 1) * stride, width,
+				planes[0] + (size_t)row * linesizes[0], planes[1] + (size_t)row * linesizes[1], planes[2] + (size_t)row * linesizes[2]);
+		}
+	}
+}
+
+// idem, with the fastest kernels the CPU supports
+void convertRGBAToPlanes(OutputPixelFormat format, const uint8_t* rgba, int width, int height, uint8_t* const planes[3], const int linesizes[3]) {
+	convertRGBAToPlanes(getPixelKernels(), format, rgba, width, height, planes, linesizes);
+}
+
+// idem, to outputFrameSize(format, width, height) bytes with the planes one after the other
+void convertRGBAToPlanar(const PixelKernels& kernels, OutputPixelFormat format, const uint8_t* rgba, int width, int height, uint8_t* out) {
+	size_t pixels = (size_t)width * height;
+	if (format == OutputPixelFormat::YUV420P) {
+		uint8_t* planes[3] = { out, out + pixels, out + pixels + pixels / 4 };
+		int linesizes[3] = { width, width / 2, width / 2 };
+		convertRGBAToPlanes(kernels, format, rgba, width, height, planes, linesizes);
+	}
+	else {
+		size_t planeSize = outputFrameSize(format, width, height) / 3;
+		uint8_t* planes[3] = { out, out + planeSize, out + 2 * planeSize };
+		int rowSize = (int)(planeSize / height);
+		int linesizes[3] = { rowSize, rowSize, rowSize };
+		convertRGBAToPlanes(kernels, format, rgba, width, height, planes, linesizes);
+	}
+}
+
+void convertRGBAToPlanar(OutputPixelFormat format, const uint8_t* rgba, int width, int height, uint8_t* out) {
+	convertRGBAToPlanar(getPixelKernels(), format, rgba, width, height, out);
+}
+
+#endif
@@ -7,50 +7,163 @@
 #include <queue>
 #include <condition_variable>
 #include <unordered_set>
+#include <atomic>
+#include <algorithm>
+#include "SpscQueue.h"
+#include "Demuxer.h"
+#include "Decoder.h"
+#include "PoolStats.h"
+#include "Tracer.h"
 
 
+// what the Pool does with a video frame of an input
+enum class Residency {
+	Cold,    // only demuxed, the packets since the last keyframe are kept so decoding can catch up once the input is needed again
+	Warm,    // decoded, but not copied to the OpenGL texture
+	Active,  // decoded and copied to the OpenGL texture, for rendering
+};
+
 /*
 * Pool manages the thread pool.
 * 
 * Each thread executes update_loop(), where they continually receive packets from 
 * the demuxers and send the packet to the decoders.
 * 
-* Threads process data popped from the input_queue and push the results to the output_queue.
-* This ensures the video frames are decoded in the correct order.
-* Additionally, the threads occasionally consult memcpy_array and demux_array before continuing.
-* The mutexes and condition variables are used to prevent race conditions.
+* Each video stream has its own lock-free job queue, filled only by the main thread.
+* A thread claims a stream before it runs the next job of that stream, so the jobs of a stream never run in parallel
+* and the frames of that stream are demuxed and decoded in order.
+* Each stream has a home thread, which looks at its own streams first: the color and depth stream of an input have different
+* home threads, so they are decoded in parallel. A thread without work of its own takes the next job of any other stream
+* that is not claimed, so a busy or slow stream does not hold up the other streams of its home thread.
+* pushJob() wakes up the home thread of the stream if it is idle, and otherwise another idle thread.
+* Threads store the results in a completion slot of the input.
+*
+* Each stream can be decoded up to decodeAhead video frames ahead of rendering:
+* a thread takes one of the decode_credits of a stream before running a job of a frame that will be rendered,
+* and copyFromGPUToOpenGLTexture() gives it back once the main thread has copied that frame to the OpenGL texture.
+* If there is no credit, the job is parked in the stream (blocking the later jobs of that stream only)
+* and the thread moves on to other streams, until returning the credit wakes up a thread again.
+* A frame that will be rendered can be decodeAhead frames ahead of one that was not rendered yet if the frames
+* in between are not rendered (no credits are taken for those), and both frames use the same completion slot.
+* So the job is also parked until the render thread has taken the older frame from the slot.
+* Each input has decodeAhead completion slots, used in turn by consecutive video frames.
+*
+* Streams for which enableFrameCache() was called keep a copy of every decoded frame in the frame cache of their decoder,
+* keyed by packet number. Once the whole video has been decoded once, the thread stops demuxing and decoding that stream
+* and serves the following loops from the cache.
+*
+* Jobs of cold inputs are only demuxed. Their packets are buffered (starting over at every keyframe), and decoded
+* all at once by the first job of that stream that is not cold, so the decoder catches up with the other inputs.
+*
+* If enableStats() is called, the duration of every stage of every job is recorded in stats (see PoolStats).
 */
 class Pool {
+	// the decoded color and depth picture of one input, the render thread only waits on the slot of the input it needs
+	struct CompletionSlot {
+		int picture_index[2] = { -1, -1 }; // color, depth
+		int frameNr[2] = { -1, -1 };
+		int64_t decodedTime[2] = { 0, 0 }; // only if stats are enabled
+		std::atomic<int> nrDecoded{ 0 };   // the slot is ready when both the color and depth picture are decoded
+		Semaphore ready;
+		std::atomic<bool> filled[2] = { {false}, {false} }; // written by a thread and not yet taken by the render thread
+	};
+
+	typedef std::tuple<int, int, Residency, int64_t> Job; // (inputIndex in range [0, nrImages*2-1], frame number, residency, push time)
+
+	// the jobs of a video stream, only run by the thread that claimed the stream
+	struct Stream {
+		SpscQueue<Job>* jobs = NULL;
+		std::atomic<bool> claimed{ false };
+		std::atomic<bool> blocked{ false }; // the parked job waits for a decode credit or its completion slot
+		std::atomic<int> parkedSlot{ 0 };   // the completion slot of the parked job
+		Job parked;                         // taken from jobs, but not run yet
+		int64_t takenTime = 0;              // when the last job was taken from jobs, only if stats are enabled
+	};
+
+	struct Worker {
+		Semaphore wakeup;                   // posted when there may be work for this thread
+		std::atomic<bool> idle{ false };    // the thread found no work and waits for wakeup
+		std::vector<int> streamOrder;       // the streams of this thread first, then those of the next threads
+	};
+
+	// only accessed by the thread that claimed the stream
+	struct FrameCache {
+		int nrFrames = 0;       // 0 if the stream is not cached
+		int nrFilled = 0;
+		int position = 0;       // the next frame to serve once the cache is filled
+		std::vector<bool> filled;
+	};
+
+	// the packets of a cold stream that still need to be decoded, only accessed by the thread that claimed the stream
+	struct PacketBuffer {
+		std::vector<std::vector<uint8_t>> packets; // reused, only the first nrPackets are valid
+		std::vector<int> packetNrs;
+		int nrPackets = 0;
+		int keyframe = -1; // the most recent keyframe in the buffer, once the packets before it are no longer needed they are dropped
+	};
+
+
 	int nrThreads = 2; // should be at least 2 to prevent deadlock
 	std::vector<std::thread> pool;
-	std::mutex input_queue_mutex;
-	std::mutex output_queue_mutex;
-	std::mutex memcpy_array_mutex;
-	std::mutex demux_array_mutex;
-	std::condition_variable_any input_condition;
-	std::condition_variable_any output_condition;
-	std::condition_variable_any memcpy_condition;
-	std::condition_variable_any demux_condition;
-	std::vector<std::tuple<int, int, bool>> input_queue; // (inputIndex in range [0, nrImages*2-1], frame number, useForRendering)
-	std::vector<std::tuple<int, int>> output_queue; // (inputIndex, avframeIndex, startFromBeginning) with inputIndex in range [0, nrImages*2-1]
-	std::vector<bool> memcpy_array; // indicates which decoders are free to start decoding the next frame
-	std::vector<int> demux_array; // indicates which demuxers are free to start demuxing the next frame
-	bool terminate_pool = false;
+	std::vector<Stream*> streams;
+	std::vector<Worker*> workers; // per thread
+	std::vector<CompletionSlot*> completion_slots; // decodeAhead per input
+	std::vector<Semaphore*> decode_credits; // per stream: how many more frames can be decoded before the oldest one needs to be copied
+	std::vector<FrameCache> frame_caches; // per stream
+	std::vector<PacketBuffer> cold_packets; // per stream
+	std::atomic<bool> terminate_pool{ false };
+	std::atomic<bool> failed{ false };
 	int nrImages = 0;
-	std::vector<FFmpegDemuxer*> demuxers;
-	std::vector<NvDecoder*> decoders;
+	int decodeAhead = 1;
+	std::vector<Demuxer*> demuxers;
+	std::vector<Decoder*> decoders;
 
 public:
+	PoolStats stats;
 
 	Pool() {}
 
-	void init(int nrImages, std::vector<FFmpegDemuxer*> demuxers, std::vector<NvDecoder*> decoders, int nrThreads) {
+	void init(int nrImages, std::vector<Demuxer*> demuxers, std::vector<Decoder*> decoders, int nrThreads, int decodeAhead) {
 		this->nrImages = nrImages;
 		this->demuxers = demuxers;
 		this->decoders = decoders;
 		this->nrThreads = nrThreads;
-		this->memcpy_array = std::vector<bool>(decoders.size(), true);
-		this->demux_array = std::vector<int>(demuxers.size(), 0);
+		this->decodeAhead = decodeAhead;
+		for (int i = 0; i < nrImages * decodeAhead; i++) {
+			completion_slots.push_back(new CompletionSlot());
+		}
+		for (int i = 0; i < decoders.size(); i++) {
+			decode_credits.push_back(new Semaphore(decodeAhead));
+		}
+		frame_caches.resize(decoders.size());
+		cold_packets.resize(decoders.size());
+		// streams that are not used for rendering can run ahead, so leave room for a few frames per stream
+		// if a job queue is full anyway, the main thread waits until the threads catch up
+		for (int i = 0; i < decoders.size(); i++) {
+			streams.push_back(new Stream());
+			streams[i]->jobs = new SpscQueue<Job>(decodeAhead + 8);
+		}
+		for (int t = 0; t < nrThreads; t++) {
+			workers.push_back(new Worker());
+			for (int k = 0; k < nrThreads; k++) {
+				for (int i = 0; i < streams.size(); i++) {
+					if (threadForStream(i) == (t + k) % nrThreads) {
+						workers[t]->streamOrder.push_back(i);
+					}
+				}
+			}
+		}
+	}
+
+	// call before startThreadPool(), once decoders[inputIndex]->EnableFrameCache(nrFrames) succeeded
+	void enableFrameCache(int inputIndex, int nrFrames) {
+		frame_caches[inputIndex].nrFrames = nrFrames;
+		frame_caches[inputIndex].filled.assign(nrFrames, false);
+	}
+
+	// call before startThreadPool()
+	void enableStats() {
+		stats.init((int)decoders.size());
 	}
 
 	void startThreadPool() {
@@ -59,171 +172,358 @@ public:
 		}
 	}
 
+	// schedule the first decodeAhead frames
 	void startDemuxingFirstFrames(std::unordered_set<int> inputsToUse) {
-		{
-			std::lock_guard<std::mutex> lock(input_queue_mutex);
+		for (int frameNr = 0; frameNr < decodeAhead; frameNr++) {
 			for (int i = 0; i < nrImages; i++) {
-				bool useForRendering = inputsToUse.find(i) != inputsToUse.end();
-				input_queue.push_back(std::tuple<int, int, bool>(2*i, 0, useForRendering));  // decode first frame of ith color(if i even) or depth (if i odd) image 
-				input_queue.push_back(std::tuple<int, int, bool>(2*i+1, 0, useForRendering));  // decode first frame of ith color(if i even) or depth (if i odd) image 
+				Residency residency = inputsToUse.find(i) != inputsToUse.end() ? Residency::Active : Residency::Warm;
+				pushJob(2 * i, frameNr, residency);      // decode frame of ith color image
+				pushJob(2 * i + 1, frameNr, residency);  // decode frame of ith depth image
 			}
-		} // to unlock
-		input_condition.notify_all();
+		}
 	}
 
-	void startDemuxingNextFrame(int inputIndex, int frameNr, bool useForRendering) {
-		{
-			std::lock_guard<std::mutex> lock(input_queue_mutex);
-			input_queue.push_back(std::tuple<int, int, bool>(2 * inputIndex, frameNr, useForRendering));      // decode next frame of ith color image
-			input_queue.push_back(std::tuple<int, int, bool>(2 * inputIndex + 1, frameNr, useForRendering));  // decode next frame of ith color image
-		} // to unlock
-		input_condition.notify_all();
-	}
-
-	std::tuple<int, int, int, int> waitUntilInputFrameIsDecoded(int inputIndex) {
-		int index0;
-		int index1;
-		std::tuple<int, int> output0;
-		std::tuple<int, int> output1;
-		{
-			// check if color and depth are decoded
-			std::unique_lock<std::mutex> lock(output_queue_mutex);
-			output_condition.wait(lock, [this, inputIndex, &index0, &index1]() mutable {
-				bool foundColor = false;
-				bool foundDepth = false;
-				for (int i = 0; i < output_queue.size(); i++) {
-					if (std::get<0>(output_queue[i]) == 2 * inputIndex) {
-						foundColor = true;
-						index0 = i;
-					}
-					else if (std::get<0>(output_queue[i]) == 2 * inputIndex + 1) {
-						foundDepth = true;
-						index1 = i;
-					}
-					if (foundColor && foundDepth) return true;
-				}
-				return false;
-				});
-			output0 = output_queue[index0];
-			output1 = output_queue[index1];
-			output_queue.erase(output_queue.begin() + (index0 > index1 ? index0 : index1));
-			output_queue.erase(output_queue.begin() + (index0 > index1 ? index1 : index0));
-		} // release lock
-		output_condition.notify_all();
-		return std::tuple<int, int, int, int>(std::get<0>(output0), std::get<1>(output0), std::get<0>(output1), std::get<1>(output1));
+	void startDemuxingNextFrame(int inputIndex, int frameNr, Residency residency) {
+		pushJob(2 * inputIndex, frameNr, residency);      // decode next frame of ith color image
+		pushJob(2 * inputIndex + 1, frameNr, residency);  // decode next frame of ith depth image
+	}
+
+	// whether a thread stopped because demuxing or decoding failed, the main loop should stop as well
+	bool hasFailed() {
+		return failed.load();
+	}
+
+	// returns picture indices of -1 if hasFailed()
+	std::tuple<int, int, int, int> waitUntilInputFrameIsDecoded(int inputIndex, int frameNr) {
+		TraceSpan span("waitUntilInputFrameIsDecoded", "input", inputIndex);
+		CompletionSlot* slot = completion_slots[completionSlotIndex(2 * inputIndex, frameNr)];
+		int64_t waitStart = stats.isEnabled() ? PoolStats::now() : 0;
+		slot->ready.wait();
+		if (failed) {
+			return std::tuple<int, int, int, int>(2 * inputIndex, -1, 2 * inputIndex + 1, -1);
+		}
+		if (stats.isEnabled()) {
+			int64_t waitEnd = PoolStats::now();
+			for (int k = 0; k < 2; k++) {
+				stats.record(2 * inputIndex + k, PoolStats::RenderWait, waitEnd - waitStart);
+				stats.record(2 * inputIndex + k, PoolStats::Handoff, waitEnd - slot->decodedTime[k]);
+			}
+		}
+		if (slot->frameNr[0] != frameNr || slot->frameNr[1] != frameNr) {
+			std::cout << "Error: expected frame " << frameNr << " of input " << inputIndex << ", but got color frame " << slot->frameNr[0] << " and depth frame " << slot->frameNr[1] << std::endl;
+		}
+		std::tuple<int, int, int, int> pictures(2 * inputIndex, slot->picture_index[0], 2 * inputIndex + 1, slot->picture_index[1]);
+		// hand the slot back to the threads, a later frame of this input may be parked until then
+		slot->nrDecoded.store(0, std::memory_order_relaxed);
+		for (int k = 0; k < 2; k++) {
+			slot->filled[k].store(false);
+			if (streams[2 * inputIndex + k]->blocked) {
+				wakeThreadFor(2 * inputIndex + k);
+			}
+		}
+		return pictures;
 	}
 
 	void copyFromGPUToOpenGLTexture(int inputIndex0, int decoded_picture_index0, int inputIndex1, int decoded_picture_index1) {
 		decoders[inputIndex0]->HandlePictureDisplay(decoded_picture_index0);
 		decoders[inputIndex1]->HandlePictureDisplay(decoded_picture_index1);
-		// signal the thread pool that these decoders are now free to decode the next frame
-		{
-			std::lock_guard<std::mutex> lock(memcpy_array_mutex);
-			memcpy_array[inputIndex0] = true;
-			memcpy_array[inputIndex1] = true;
-		}
-		memcpy_condition.notify_all();
+		// signal the thread pool that these decoders can decode one more frame ahead
+		decode_credits[inputIndex0]->post();
+		wakeThreadFor(inputIndex0);
+		decode_credits[inputIndex1]->post();
+		wakeThreadFor(inputIndex1);
 	}
 
 	void update_loop(int threadIndex) {
-
-		int inputIndex = -2;
-		int frameNr = -1;
+		Tracer::instance().setThreadName("Pool thread " + std::to_string(threadIndex));
+		Worker* worker = workers[threadIndex];
 
 		while (!terminate_pool) {
-			int index = 0;
-			std::unique_lock<std::mutex> lock(input_queue_mutex);
-			input_condition.wait(lock, [this, inputIndex, &index, frameNr]() mutable {
-				if (terminate_pool) return true;
-				if (input_queue.empty()) return false;
-				if (std::get<1>(input_queue.front()) == frameNr && std::get<0>(input_queue.front()) == inputIndex + 1) {
-					if (input_queue.size() == 1) {
-						return false;
-					}
-					else {
-						index = 1;
-					}
-				}
-				return true;
-				});
-			if (terminate_pool) {
-				lock.unlock();
-				input_condition.notify_all();
+			// start over with the streams of this thread after every job
+			JobResult result = NoJob;
+			for (int i = 0; i < worker->streamOrder.size() && result == NoJob; i++) {
+				result = runNextJob(worker->streamOrder[i]);
+			}
+			if (result == Failed) {
 				break;
 			}
-			inputIndex = std::get<0>(input_queue[index]);
-			frameNr = std::get<1>(input_queue[index]);
-			bool useForRendering = std::get<2>(input_queue[index]);
-			input_queue.erase(input_queue.begin() + index);
-			lock.unlock();
-			input_condition.notify_all();
-			
-			{
-				std::unique_lock<std::mutex> lock2(demux_array_mutex);
-				demux_condition.wait(lock2, [this, inputIndex, frameNr]() {return demux_array[inputIndex] == frameNr || terminate_pool; });
+			if (result == NoJob) {
+				worker->idle.store(true);
+				worker->wakeup.wait();
+				worker->idle.store(false);
 			}
-			demux_condition.notify_all();
-			if (terminate_pool) {
-				break;
+		}
+	}
+
+	void cleanup() {
+		terminate_pool = true;
+		// wake up all threads.
+		for (Worker* worker : workers) {
+			worker->wakeup.post();
+		}
+		for (std::thread& thread : pool)
+		{
+			thread.join();
+		}
+		pool.clear();
+		for (Worker* worker : workers) {
+			delete worker;
+		}
+		workers.clear();
+		for (Stream* stream : streams) {
+			delete stream->jobs;
+			delete stream;
+		}
+		streams.clear();
+		for (CompletionSlot* slot : completion_slots) {
+			delete slot;
+		}
+		completion_slots.clear();
+		for (Semaphore* semaphore : decode_credits) {
+			delete semaphore;
+		}
+		decode_credits.clear();
+		frame_caches.clear();
+		cold_packets.clear();
+	}
+
+private:
+	enum JobResult {
+		NoJob,      // the stream has no job that can run now, or another thread claimed it
+		Ran,        // a job ran, or the stream may have a job that can run now
+		Failed,     // demuxing or decoding failed, the thread stops
+	};
+
+	JobResult runNextJob(int inputIndex) {
+		Stream& stream = *streams[inputIndex];
+		// cheap checks first, so idle threads do not keep claiming streams without work
+		if (stream.blocked ? !canRunParkedJob(inputIndex) : stream.jobs->size() == 0) {
+			return NoJob;
+		}
+		if (stream.claimed.load(std::memory_order_relaxed) || stream.claimed.exchange(true, std::memory_order_acquire)) {
+			return NoJob;
+		}
+
+		Job job;
+		bool wasBlocked = stream.blocked;
+		bool hasJob = wasBlocked;
+		if (wasBlocked) {
+			job = stream.parked;
+		}
+		else {
+			hasJob = stream.jobs->pop(job);
+			if (hasJob && stats.isEnabled()) {
+				stream.takenTime = PoolStats::now();
+				stats.record(inputIndex, PoolStats::QueueWait, stream.takenTime - std::get<3>(job));
+			}
+		}
+		if (hasJob && std::get<2>(job) == Residency::Active) {
+			int slotIndex = completionSlotIndex(inputIndex, std::get<1>(job));
+			if (completion_slots[slotIndex]->filled[inputIndex % 2] || !decode_credits[inputIndex]->tryWait()) {
+				// park the job, the frames of this stream need to stay in order
+				stream.parked = job;
+				stream.parkedSlot = slotIndex;
+				stream.blocked = true;
+				hasJob = false;
+			}
+			else if (stats.isEnabled()) {
+				stats.record(inputIndex, PoolStats::CreditWait, PoolStats::now() - stream.takenTime);
 			}
+		}
 
-			int nVideoBytes = 0;
-			uint8_t* pVideo = NULL;
-			if (!demux(inputIndex, nVideoBytes, pVideo)) {
-				break;
+		bool ok = true;
+		if (hasJob) {
+			stream.blocked = false;
+			ok = runJob(job);
+		}
+		stream.claimed.store(false, std::memory_order_release);
+		if (!ok) {
+			failed = true;
+			// wake up the main thread, whichever frame it waits for
+			for (CompletionSlot* slot : completion_slots) {
+				slot->ready.post();
 			}
+			return Failed;
+		}
+		if (hasJob) {
+			return Ran;
+		}
+		// a job or credit may have arrived while the stream was claimed, after the thread that was woken up for it skipped the stream
+		return (stream.blocked ? canRunParkedJob(inputIndex) : stream.jobs->size() > 0) ? Ran : NoJob;
+	}
 
-			if (useForRendering) {
-				{
-					std::unique_lock<std::mutex> lock2(memcpy_array_mutex);
-					memcpy_condition.wait(lock2, [this, inputIndex]() {return memcpy_array[inputIndex] || terminate_pool; });
-					memcpy_array[inputIndex] = false;
+	// approximate if another thread claimed the stream
+	bool canRunParkedJob(int inputIndex) {
+		return !completion_slots[streams[inputIndex]->parkedSlot]->filled[inputIndex % 2] && decode_credits[inputIndex]->isAvailable();
+	}
+
+	int completionSlotIndex(int inputIndex, int frameNr) {
+		return (inputIndex / 2) * decodeAhead + frameNr % decodeAhead;
+	}
+
+	// returns false if demuxing or decoding failed
+	bool runJob(const Job& job) {
+		int inputIndex = std::get<0>(job);
+		int frameNr = std::get<1>(job);
+		Residency residency = std::get<2>(job);
+		bool useForRendering = residency == Residency::Active;
+		bool measure = stats.isEnabled();
+		int64_t time = measure ? PoolStats::now() : 0;
+
+		FrameCache& cache = frame_caches[inputIndex];
+		bool fromCache = cache.nrFrames > 0 && cache.nrFilled == cache.nrFrames;
+
+		int nVideoBytes = 0;
+		uint8_t* pVideo = NULL;
+		int cacheIndex = -1;
+		if (fromCache) {
+			cacheIndex = cache.position;
+			cache.position = (cache.position + 1) % cache.nrFrames;
+		}
+		else {
+			{
+				TraceSpan span("Demux", "stream", inputIndex);
+				if (!demux(inputIndex, nVideoBytes, pVideo)) {
+					return false;
 				}
-				memcpy_condition.notify_all();
 			}
-			if (terminate_pool) {
-				break;
+			if (measure) {
+				int64_t demuxed = PoolStats::now();
+				stats.record(inputIndex, PoolStats::Demux, demuxed - time);
+				time = demuxed;
+			}
+			if (cache.nrFrames > 0) {
+				int packetNr = demuxers[inputIndex]->GetNextPacketNr() - 1;
+				if (packetNr < 0 || packetNr >= cache.nrFrames) {
+					std::cout << "Warning: input " << inputIndex / 2 << (inputIndex % 2 == 0 ? " color" : " depth") << " has more frames than expected, disabling its frame cache" << std::endl;
+					// the cache is not filled yet, so none of its frames is waiting to be displayed
+					decoders[inputIndex]->DisableFrameCache();
+					cache = FrameCache();
+					cacheIndex = -1;
+				}
+				else {
+					// the decoder still holds back the frames of the last OutputDelay() packets
+					cacheIndex = ((packetNr - decoders[inputIndex]->OutputDelay()) % cache.nrFrames + cache.nrFrames) % cache.nrFrames;
+				}
 			}
+		}
 
-			int decoded_picture_index = -1;
-			if (nVideoBytes) {
-				decoders[inputIndex]->Decode(pVideo, nVideoBytes);
-				decoded_picture_index = decoders[inputIndex]->picture_index;
+		if (residency == Residency::Cold) {
+			if (!fromCache) {
+				bufferPacket(inputIndex, pVideo, nVideoBytes);
 			}
+			return true;
+		}
 
-			// signal that other threads can use demuxers[inputIndex] from now on
-			{
-				std::lock_guard<std::mutex> lock(demux_array_mutex);
-				demux_array[inputIndex]++;
+		int decoded_picture_index = -1;
+		if (fromCache) {
+			decoded_picture_index = Decoder::CachedPictureIndex(cacheIndex);
+		}
+		else if (nVideoBytes) {
+			TraceSpan span("Decode", "stream", inputIndex);
+			if (!decodeBufferedPackets(inputIndex) || !decoders[inputIndex]->Decode(pVideo, nVideoBytes, 0, demuxers[inputIndex]->GetNextPacketNr() - 1)) {
+				std::cout << "Decoding failed for input " << inputIndex / 2 << (inputIndex % 2 == 0 ? " color" : " depth") << std::endl;
+				return false;
+			}
+			decoded_picture_index = decoders[inputIndex]->picture_index;
+			if (cacheIndex >= 0 && decoded_picture_index >= 0 && !cache.filled[cacheIndex]) {
+				decoders[inputIndex]->CacheFrame(decoded_picture_index, cacheIndex);
+				cache.filled[cacheIndex] = true;
+				cache.nrFilled++;
+				cache.position = (cacheIndex + 1) % cache.nrFrames;
+			}
+			if (measure) {
+				int64_t decoded = PoolStats::now();
+				stats.record(inputIndex, PoolStats::Decode, decoded - time);
+				time = decoded;
+			}
+		}
+
+		if (useForRendering) {
+			// let main thread know the decoding is done, once both the color and depth are decoded
+			CompletionSlot* slot = completion_slots[completionSlotIndex(inputIndex, frameNr)];
+			slot->filled[inputIndex % 2] = true;
+			slot->picture_index[inputIndex % 2] = decoded_picture_index;
+			slot->frameNr[inputIndex % 2] = frameNr;
+			slot->decodedTime[inputIndex % 2] = time;
+			if (slot->nrDecoded.fetch_add(1, std::memory_order_acq_rel) == 1) {
+				slot->ready.post();
 			}
-			demux_condition.notify_all();
+		}
+		return true;
+	}
 
+	// the home thread of the color stream of input i is thread i % nrThreads, that of the depth stream the next thread
+	int threadForStream(int inputIndex) {
+		return (inputIndex / 2 + inputIndex % 2) % nrThreads;
+	}
 
-			if (useForRendering) {
-				// let main thread know the decoding is done
-				{
-					std::lock_guard<std::mutex> lock3(output_queue_mutex);
-					output_queue.push_back(std::tuple<int,int>(inputIndex, decoded_picture_index));
-				} // release lock
-				output_condition.notify_all();
+	void pushJob(int inputIndex, int frameNr, Residency residency) {
+		int64_t pushTime = stats.isEnabled() ? PoolStats::now() : 0;
+		while (!streams[inputIndex]->jobs->push(Job(inputIndex, frameNr, residency, pushTime))) {
+			if (failed) {
+				// the thread that would make room may have stopped
+				return;
 			}
+			std::this_thread::yield();
 		}
+		wakeThreadFor(inputIndex);
 	}
 
-	void cleanup() {
-		terminate_pool = true;
-		// wake up all threads.
-		input_condition.notify_all();
-		memcpy_condition.notify_all();
-		output_condition.notify_all();
-		for (std::thread& thread : pool)
-		{
-			thread.join();
+	// the home thread of the stream if it is idle, otherwise the next idle thread, so that one steals the job
+	// if no thread is idle, the home thread will find the job once it is done with its current one
+	void wakeThreadFor(int inputIndex) {
+		int home = threadForStream(inputIndex);
+		int threadIndex = home;
+		for (int k = 0; k < nrThreads; k++) {
+			if (workers[(home + k) % nrThreads]->idle.load()) {
+				threadIndex = (home + k) % nrThreads;
+				break;
+			}
 		}
-		pool.clear();
+		workers[threadIndex]->wakeup.post();
 	}
 
-private:
+	void bufferPacket(int inputIndex, const uint8_t* pVideo, int nVideoBytes) {
+		if (!nVideoBytes) {
+			return;
+		}
+		PacketBuffer& buffer = cold_packets[inputIndex];
+		if (demuxers[inputIndex]->IsIntraOnly()) {
+			// every frame decodes on its own, nothing to catch up on
+			buffer.nrPackets = 0;
+			return;
+		}
+		if (demuxers[inputIndex]->IsKeyFrame()) {
+			buffer.keyframe = buffer.nrPackets;
+		}
+		if (buffer.nrPackets == buffer.packets.size()) {
+			buffer.packets.push_back(std::vector<uint8_t>());
+			buffer.packetNrs.push_back(0);
+		}
+		buffer.packets[buffer.nrPackets].assign(pVideo, pVideo + nVideoBytes);
+		buffer.packetNrs[buffer.nrPackets++] = demuxers[inputIndex]->GetNextPacketNr() - 1;
+		// decoding can restart at the keyframe, unless the decoder would still hold back frames from before it
+		if (buffer.keyframe > 0 && buffer.nrPackets - buffer.keyframe > decoders[inputIndex]->OutputDelay()) {
+			std::rotate(buffer.packets.begin(), buffer.packets.begin() + buffer.keyframe, buffer.packets.begin() + buffer.nrPackets);
+			std::rotate(buffer.packetNrs.begin(), buffer.packetNrs.begin() + buffer.keyframe, buffer.packetNrs.begin() + buffer.nrPackets);
+			buffer.nrPackets -= buffer.keyframe;
+			buffer.keyframe = 0;
+		}
+	}
+
+	bool decodeBufferedPackets(int inputIndex) {
+		PacketBuffer& buffer = cold_packets[inputIndex];
+		int nrPackets = buffer.nrPackets;
+		buffer.nrPackets = 0;
+		buffer.keyframe = -1;
+		for (int i = 0; i < nrPackets; i++) {
+			if (!decoders[inputIndex]->Decode(buffer.packets[i].data(), (int)buffer.packets[i].size(), 0, buffer.packetNrs[i])) {
+				return false;
+			}
+		}
+		return true;
+	}
 
 	bool demux(int inputIndex, int & nVideoBytes, uint8_t* & pVideo) {
 		
@@ -0,0 +1,158 @@
+#ifndef POOLSTATS_H
+#define POOLSTATS_H
+
+
+#include <stdint.h>
+#include <chrono>
+#include <vector>
+#include <string>
+#include <fstream>
+#include <iostream>
+
+
+/*
+* LatencyHistogram counts durations in microseconds in log-linear buckets (like HdrHistogram):
+* values below 64 us are counted exactly, larger values with a relative error below 1/32.
+* Recording is not thread-safe, each histogram should only be written by one thread.
+*/
+class LatencyHistogram {
+private:
+	static const int subBucketBits = 6;
+	static const int subBucketCount = 1 << subBucketBits;
+	static const int halfSubBucketCount = subBucketCount / 2;
+	static const int maxShift = 34;   // values up to 2^40 us
+
+	std::vector<uint64_t> counts;
+	uint64_t totalCount = 0;
+	uint64_t sum = 0;
+	uint64_t maxValue = 0;
+
+	static int indexOf(uint64_t value, int& shift) {
+		shift = 0;
+		while ((value >> shift) >= (uint64_t)subBucketCount && shift < maxShift) {
+			shift++;
+		}
+		int subBucket = (int)(value >> shift);
+		if (subBucket >= subBucketCount) {
+			subBucket = subBucketCount - 1;
+		}
+		return shift * halfSubBucketCount + subBucket;
+	}
+
+	// the middle of the range of values counted at index
+	static uint64_t valueAt(int index) {
+		if (index < subBucketCount) {
+			return (uint64_t)index;
+		}
+		int shift = (index - halfSubBucketCount) / halfSubBucketCount;
+		uint64_t subBucket = (uint64_t)(index - shift * halfSubBucketCount);
+		return (subBucket << shift) + ((uint64_t(1) << shift) >> 1);
+	}
+
+public:
+	LatencyHistogram() : counts((maxShift + 1) * halfSubBucketCount + halfSubBucketCount, 0) {}
+
+	void record(int64_t microseconds) {
+		uint64_t value = microseconds < 0 ? 0 : (uint64_t)microseconds;
+		int shift;
+		counts[indexOf(value, shift)]++;
+		totalCount++;
+		sum += value;
+		if (value > maxValue) {
+			maxValue = value;
+		}
+	}
+
+	uint64_t count() const {
+		return totalCount;
+	}
+
+	double mean() const {
+		return totalCount == 0 ? 0.0 : (double)sum / (double)totalCount;
+	}
+
+	uint64_t max() const {
+		return maxValue;
+	}
+
+	// percentile in [0,100]
+	uint64_t percentile(double percentile) const {
+		if (totalCount == 0) {
+			return 0;
+		}
+		uint64_t rank = (uint64_t)(percentile / 100.0 * (double)totalCount + 0.5);
+		if (rank < 1) {
+			rank = 1;
+		}
+		uint64_t cumulative = 0;
+		for (int i = 0; i < counts.size(); i++) {
+			cumulative += counts[i];
+			if (cumulative >= rank) {
+				uint64_t value = valueAt(i);
+				return value > maxValue ? maxValue : value;
+			}
+		}
+		return maxValue;
+	}
+};
+
+
+/*
+* PoolStats holds a LatencyHistogram per video stream per stage of the Pool.
+* The stages of a job are recorded by the thread that handles the stream, the handoff to the render thread
+* by the render thread, so every histogram has a single writer and no locking is needed.
+* Read the histograms only once the threads of the Pool have stopped.
+*/
+class PoolStats {
+public:
+	enum Stage {
+		QueueWait,   // from pushing the job until a thread starts it
+		Demux,       // Demuxer::Demux
+		CreditWait,  // waiting until the render thread copied an older frame of the stream (decode_credits)
+		Decode,      // Decoder::Decode, including catching up after being cold and filling the frame cache
+		Handoff,     // from the decoded frame being ready until the render thread picks it up
+		RenderWait,  // the render thread waiting in waitUntilInputFrameIsDecoded for the input
+		NrStages
+	};
+
+	void init(int nrStreams) {
+		histograms = std::vector<LatencyHistogram>(nrStreams * NrStages);
+	}
+
+	bool isEnabled() const {
+		return !histograms.empty();
+	}
+
+	static int64_t now() {
+		return std::chrono::duration_cast<std::chrono::microseconds>(std::chrono::steady_clock::now().time_since_epoch()).count();
+	}
+
+	void record(int stream, Stage stage, int64_t microseconds) {
+		histograms[stream * NrStages + stage].record(microseconds);
+	}
+
+	void WriteToCSVFile(std::string path) {
+		static const char* stageNames[NrStages] = { "queue wait", "demux", "credit wait", "decode", "handoff", "render wait" };
+		std::ofstream csvFile;
+		csvFile.open(path);
+		csvFile << "Input,Stream,Stage,Count,Mean us,P50 us,P90 us,P99 us,P99.9 us,Max us\n";
+		for (int stream = 0; stream < histograms.size() / NrStages; stream++) {
+			for (int stage = 0; stage < NrStages; stage++) {
+				const LatencyHistogram& h = histograms[stream * NrStages + stage];
+				if (h.count() == 0) {
+					continue;
+				}
+				csvFile << stream / 2 << ',' << (stream % 2 == 0 ? "color" : "depth") << ',' << stageNames[stage] << ','
+					<< h.count() << ',' << h.mean() << ',' << h.percentile(50) << ',' << h.percentile(90) << ','
+					<< h.percentile(99) << ',' << h.percentile(99.9) << ',' << h.max() << '\n';
+			}
+		}
+		csvFile.close();
+		std::cout << "Wrote to " << path << std::endl;
+	}
+
+private:
+	std::vector<LatencyHistogram> histograms;
+};
+
+#endif
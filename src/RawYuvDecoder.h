@@ -0,0 +1,126 @@
+#ifndef RAW_YUV_DECODER_H
+#define RAW_YUV_DECODER_H
+
+
+#include <GL/glew.h>
+#include <string.h>
+#include <vector>
+#include "Decoder.h"
+
+
+/*
+* RawYuvDecoder "decodes" the frames of a RawYuvDemuxer: the packets already are planar YUV 4:2:0 frames,
+* with samples of bitDepth bits (2 bytes per sample, little endian, if bitDepth > 8).
+*
+* Decode() only brings the frame in the layout of the texture (see Decoder): the U and V planes are interleaved,
+* and samples of 9 to 15 bits are shifted to the most significant bits. If the luma samples already have the
+* layout of the texture (8 or 16 bits), the luma plane is not copied at all: HandlePictureDisplay() uploads it
+* straight from the packet, i.e. from the memory mapping of the file, which stays valid as long as the demuxer exists.
+*
+* There are decodeAhead + 1 staging pictures, so a picture is not overwritten while it waits to be uploaded.
+*/
+class RawYuvDecoder : public Decoder {
+public:
+	RawYuvDecoder(GLuint texture, int width, int height, int bitDepth, bool isColor, int decodeAhead = 1)
+		: Decoder(isColor), texture(texture), width(width), height(height), bitDepth(bitDepth), nrPictures(decodeAhead + 1) {
+
+		bytesPerSample = bitDepth > 8 ? 2 : 1;
+		chromaOffset = ((height + 16 - 1) / 16) * 16;
+		zeroCopyLuma = bitDepth == 8 || bitDepth == 16;
+		size_t lumaSize = zeroCopyLuma ? 0 : (size_t)width * height * bytesPerSample;
+		size_t chromaSize = isColor ? (size_t)width * (height / 2) * bytesPerSample : 0;
+		for (int i = 0; i < nrPictures; i++) {
+			pictures.push_back(Picture());
+			pictures.back().luma.resize(lumaSize);
+			pictures.back().chroma.resize(chromaSize);
+		}
+	}
+
+	bool Decode(const uint8_t* pData, int nSize, int nFlags = 0, int64_t nTimestamp = 0) {
+		if (!pData || nSize <= 0) {
+			return true;
+		}
+		int index = (picture_index + 1) % nrPictures;
+		Picture& picture = pictures[index];
+		size_t lumaSamples = (size_t)width * height;
+		if (zeroCopyLuma) {
+			picture.lumaSource = pData;
+		}
+		else {
+			shiftToMSB((const uint16_t*)pData, (uint16_t*)picture.luma.data(), lumaSamples);
+			picture.lumaSource = picture.luma.data();
+		}
+		if (isColor) {
+			// interleave the U and V planes
+			size_t chromaSamples = (size_t)(width / 2) * (height / 2);
+			const uint8_t* u = pData + lumaSamples * bytesPerSample;
+			const uint8_t* v = u + chromaSamples * bytesPerSample;
+			if (bytesPerSample == 1) {
+				uint8_t* dst = picture.chroma.data();
+				for (size_t i = 0; i < chromaSamples; i++) {
+					dst[2 * i] = u[i];
+					dst[2 * i + 1] = v[i];
+				}
+			}
+			else {
+				const uint16_t* u16 = (const uint16_t*)u;
+				const uint16_t* v16 = (const uint16_t*)v;
+				uint16_t* dst = (uint16_t*)picture.chroma.data();
+				int shift = 16 - bitDepth;
+				for (size_t i = 0; i < chromaSamples; i++) {
+					dst[2 * i] = (uint16_t)(u16[i] << shift);
+					dst[2 * i + 1] = (uint16_t)(v16[i] << shift);
+				}
+			}
+		}
+		picture_index = index;
+		return true;
+	}
+
+	int HandlePictureDisplay(int decoded_picture_index) {
+		if (decoded_picture_index < 0 || decoded_picture_index >= nrPictures || !texture) {
+			return -1;
+		}
+		const Picture& picture = pictures[decoded_picture_index];
+		GLenum type = bytesPerSample == 2 ? GL_UNSIGNED_SHORT : GL_UNSIGNED_BYTE;
+		glBindTexture(GL_TEXTURE_2D, texture);
+		glPixelStorei(GL_UNPACK_ALIGNMENT, bytesPerSample);
+		glTexSubImage2D(GL_TEXTURE_2D, 0, 0, 0, width, height, GL_RED, type, picture.lumaSource);
+		if (isColor) {
+			glTexSubImage2D(GL_TEXTURE_2D, 0, 0, chromaOffset, width, height / 2, GL_RED, type, picture.chroma.data());
+		}
+		glPixelStorei(GL_UNPACK_ALIGNMENT, 4);
+		glBindTexture(GL_TEXTURE_2D, 0);
+		return 1;
+	}
+
+	void SetTexture(GLuint texture) {
+		this->texture = texture;
+	}
+
+private:
+	struct Picture {
+		const uint8_t* lumaSource = NULL; // the packet, or luma
+		std::vector<uint8_t> luma;        // only if the luma samples need to be shifted
+		std::vector<uint8_t> chroma;      // the interleaved CbCr rows, only for color
+	};
+
+	void shiftToMSB(const uint16_t* src, uint16_t* dst, size_t n) {
+		int shift = 16 - bitDepth;
+		for (size_t i = 0; i < n; i++) {
+			dst[i] = (uint16_t)(src[i] << shift);
+		}
+	}
+
+	GLuint texture = 0;
+	int width = 0;
+	int height = 0;
+	int bitDepth = 8;
+	int nrPictures = 2;
+	int bytesPerSample = 1;
+	int chromaOffset = 0;
+	bool zeroCopyLuma = true;
+	std::vector<Picture> pictures;
+};
+
+#endif
@@ -0,0 +1,213 @@
+#ifndef RAW_YUV_DEMUXER_H
+#define RAW_YUV_DEMUXER_H
+
+
+#include <stdint.h>
+#include <stddef.h>
+#include <string>
+#include <iostream>
+#ifdef _WIN32
+#ifndef NOMINMAX
+#define NOMINMAX
+#endif
+#include <windows.h>
+#else
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <fcntl.h>
+#include <unistd.h>
+#endif
+#include "Demuxer.h"
+
+
+/*
+* RawYuvDemuxer reads a raw planar YUV 4:2:0 file (yuv420p, or yuv420p10le etc. if bitDepth > 8, as used by
+* the MPEG immersive video test sequences) without decoding: the file is memory-mapped, and every "packet"
+* that Demux() returns is a pointer to the next frame in the mapping, so frames are never copied by the demuxer.
+*
+* The frames are found from the resolution and bit depth: width * height luma samples followed by two
+* (width / 2) * (height / 2) chroma planes, with 2 bytes per sample (little endian) if bitDepth > 8.
+* After each Demux(), the kernel is asked to read the next readAhead frames into memory (madvise),
+* so the thread that uses the frames does not have to wait on the disk.
+*/
+class RawYuvDemuxer : public Demuxer {
+public:
+	static size_t FrameSize(int width, int height, int bitDepth) {
+		return ((size_t)width * height + 2 * (size_t)(width / 2) * (height / 2)) * (bitDepth > 8 ? 2 : 1);
+	}
+
+	RawYuvDemuxer(const char* szFilePath, int width, int height, int bitDepth, int readAhead = 4, bool printInfo = false)
+		: path(szFilePath), readAhead(readAhead) {
+		frameSize = FrameSize(width, height, bitDepth);
+		if (!Map()) {
+			std::cout << "Error: could not map " << path << std::endl;
+			return;
+		}
+		nrFrames = (int)(fileSize / frameSize);
+		if (nrFrames == 0) {
+			std::cout << "Error: " << path << " is smaller than one " << width << "x" << height << " " << bitDepth << "-bit YUV 4:2:0 frame" << std::endl;
+			Unmap();
+			return;
+		}
+		if (fileSize % frameSize != 0) {
+			std::cout << "Warning: the size of " << path << " is not a multiple of the size of a " << width << "x" << height << " " << bitDepth
+				<< "-bit YUV 4:2:0 frame, the last " << fileSize % frameSize << " bytes are ignored" << std::endl;
+		}
+		if (printInfo) {
+			std::cout << "Reading raw " << width << "x" << height << " " << bitDepth << "-bit YUV 4:2:0 files (" << nrFrames << " frames in " << path << ")" << std::endl;
+		}
+		for (int i = 0; i < readAhead; i++) {
+			Prefetch(i);
+		}
+	}
+
+	~RawYuvDemuxer() {
+		Unmap();
+	}
+
+	bool IsOpen() {
+		return mapping != NULL;
+	}
+
+	bool Demux(uint8_t** ppVideo, int* pnVideoBytes) {
+		*pnVideoBytes = 0;
+		if (!mapping) {
+			return false;
+		}
+		if (frameNr == nrFrames) {
+			// reached end of file, start from the beginning
+			frameNr = 0;
+		}
+		*ppVideo = mapping + (size_t)frameNr * frameSize;
+		*pnVideoBytes = (int)frameSize;
+		frameNr++;
+		// the frames before this one were already requested by earlier calls
+		Prefetch(frameNr + readAhead - 1);
+		return true;
+	}
+
+	bool IsKeyFrame() {
+		return true;
+	}
+
+	bool IsIntraOnly() {
+		return true;
+	}
+
+	int GetNextPacketNr() {
+		return frameNr;
+	}
+
+	int GetNrFrames() {
+		return nrFrames;
+	}
+
+	int SeekToKeyframeBefore(int frameNr) {
+		if (!mapping) {
+			return -1;
+		}
+		this->frameNr = frameNr % nrFrames;
+		for (int i = 0; i < readAhead; i++) {
+			Prefetch(this->frameNr + i);
+		}
+		return 0;
+	}
+
+private:
+	std::string path;
+	uint8_t* mapping = NULL;
+	size_t fileSize = 0;
+	size_t frameSize = 0;
+	int nrFrames = 0;
+	int frameNr = 0;   // the frame the next call to Demux() returns
+	int readAhead = 4;
+#ifdef _WIN32
+	HANDLE file = INVALID_HANDLE_VALUE;
+	HANDLE fileMapping = NULL;
+#endif
+
+	// asks the kernel to start reading frame i (modulo the number of frames) into memory
+	void Prefetch(int i) {
+		if (!mapping || readAhead <= 0) {
+			return;
+		}
+		size_t start = (size_t)(i % nrFrames) * frameSize;
+#ifdef _WIN32
+		WIN32_MEMORY_RANGE_ENTRY range;
+		range.VirtualAddress = mapping + start;
+		range.NumberOfBytes = frameSize;
+		PrefetchVirtualMemory(GetCurrentProcess(), 1, &range, 0);
+#else
+		// madvise needs a page aligned address
+		size_t pageSize = (size_t)sysconf(_SC_PAGESIZE);
+		size_t alignedStart = start - start % pageSize;
+		madvise(mapping + alignedStart, frameSize + (start - alignedStart), MADV_WILLNEED);
+#endif
+	}
+
+	bool Map() {
+#ifdef _WIN32
+		file = CreateFileA(path.c_str(), GENERIC_READ, FILE_SHARE_READ, NULL, OPEN_EXISTING, FILE_FLAG_SEQUENTIAL_SCAN, NULL);
+		if (file == INVALID_HANDLE_VALUE) {
+			return false;
+		}
+		LARGE_INTEGER size;
+		if (!GetFileSizeEx(file, &size) || size.QuadPart == 0) {
+			CloseHandle(file);
+			file = INVALID_HANDLE_VALUE;
+			return false;
+		}
+		fileSize = (size_t)size.QuadPart;
+		fileMapping = CreateFileMappingA(file, NULL, PAGE_READONLY, 0, 0, NULL);
+		if (fileMapping) {
+			mapping = (uint8_t*)MapViewOfFile(fileMapping, FILE_MAP_READ, 0, 0, 0);
+		}
+		if (!mapping) {
+			Unmap();
+			return false;
+		}
+		return true;
+#else
+		int fd = open(path.c_str(), O_RDONLY);
+		if (fd < 0) {
+			return false;
+		}
+		struct stat info;
+		if (fstat(fd, &info) != 0 || info.st_size == 0) {
+			close(fd);
+			return false;
+		}
+		fileSize = (size_t)info.st_size;
+		void* address = mmap(NULL, fileSize, PROT_READ, MAP_SHARED, fd, 0);
+		close(fd); // the mapping keeps the file open
+		if (address == MAP_FAILED) {
+			return false;
+		}
+		mapping = (uint8_t*)address;
+		return true;
+#endif
+	}
+
+	void Unmap() {
+#ifdef _WIN32
+		if (mapping) {
+			UnmapViewOfFile(mapping);
+		}
+		if (fileMapping) {
+			CloseHandle(fileMapping);
+			fileMapping = NULL;
+		}
+		if (file != INVALID_HANDLE_VALUE) {
+			CloseHandle(file);
+			file = INVALID_HANDLE_VALUE;
+		}
+#else
+		if (mapping) {
+			munmap(mapping, fileSize);
+		}
+#endif
+		mapping = NULL;
+	}
+};
+
+#endif
@@ -0,0 +1,366 @@
+#ifndef SELECTION_GRID_H
+#define SELECTION_GRID_H
+
+
+#include <stdint.h>
+#include <stdio.h>
+#include <string.h>
+#include <string>
+#include <vector>
+#include <thread>
+#include <functional>
+#include <algorithm>
+#include <cmath>
+#include <iostream>
+#ifdef _WIN32
+#ifndef NOMINMAX
+#define NOMINMAX
+#endif
+#include <windows.h>
+#else
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <fcntl.h>
+#include <unistd.h>
+#endif
+#include "ioHelper.h"
+#include "StreamIndex.h"
+
+
+/*
+* SelectionGrid stores which InputCameras CameraVisibilityHelper selects for a grid of viewpoints, so that at runtime
+* the selection only has to choose among the inputs stored for the viewpoints around the pose of the OutputCamera.
+*
+* The viewpoints are all combinations of:
+* - a position on a regular grid of dims[0] x dims[1] x dims[2] nodes, cellSize apart, around the positions of the InputCameras
+* - a viewing direction: the center of one of nrDirectionBins x nrDirectionBins bins on each face of a cube,
+*   with the up vector of the OutputCamera as close as possible to +y
+* For every viewpoint, the table holds maxNrInputsUsed indices of InputCameras (uint16_t, 0xFFFF if unused).
+*
+* The grid is stored next to the input json (<json>.grid) as a Header followed by the table, in the byte order
+* of the machine, and memory-mapped when it is opened. It is only valid for the json file with the same size and
+* modification time, and for the same number of inputs, maxNrInputsUsed, field of view and layout of the grid.
+*/
+class SelectionGrid {
+public:
+	struct Header {
+		char magic[8];
+		int64_t jsonSize;
+		int64_t jsonMtime;
+		int32_t version;
+		int32_t nrInputs;
+		int32_t maxNrInputsUsed;
+		int32_t dims[3];
+		int32_t nrDirectionBins;
+		float FOV_x;
+		float FOV_y;
+		float minCorner[3];
+		float cellSize;
+		int32_t reserved;
+	};
+
+	SelectionGrid() {}
+
+	SelectionGrid(const SelectionGrid&) = delete;
+	SelectionGrid& operator=(const SelectionGrid&) = delete;
+
+	~SelectionGrid() {
+		close();
+	}
+
+	static std::string sidecarPath(const std::string& jsonPath) {
+		return jsonPath + ".grid";
+	}
+
+	// The table of a grid holds dims[0] * dims[1] * dims[2] * 216 * maxNrInputsUsed indices, and building it takes one
+	// selection per viewpoint, so layout() refuses grids with a larger table than this
+	// (with --selection_grid 16 and 8 inputs, about 5 MB for a flat rig and 14 MB for a rig as deep as it is wide).
+	static const size_t maxTableBytes = 32 * 1024 * 1024;
+
+	// The largest resolution, at most resolution, for which the table of the rig fits in maxTableBytes, 0 if none does
+	static int largestResolution(const std::vector<InputCamera>& inputCameras, int maxNrInputsUsed, int resolution) {
+		Header header;
+		memset(&header, 0, sizeof(Header));
+		header.maxNrInputsUsed = maxNrInputsUsed;
+		header.nrDirectionBins = directionBinsPerSide;
+		for (; resolution >= 2; resolution--) {
+			placeNodes(inputCameras, resolution, header);
+			if (tableSize(header) * sizeof(uint16_t) <= maxTableBytes) {
+				return resolution;
+			}
+		}
+		return 0;
+	}
+
+	// The layout of the grid for a rig: resolution nodes along the longest side of the bounding box of the InputCameras,
+	// which is enlarged by a quarter of that side in every direction, so the OutputCamera can move around the rig.
+	// Returns false if the rig cannot be stored (more than 0xFFFF InputCameras, or a table larger than maxTableBytes).
+	static bool layout(const std::string& jsonPath, const std::vector<InputCamera>& inputCameras, int maxNrInputsUsed,
+		float FOV_x, float FOV_y, int resolution, Header& header) {
+		if (inputCameras.size() >= 0xFFFF) {
+			return false;
+		}
+		memset(&header, 0, sizeof(Header));
+		memcpy(header.magic, "ODIBRSEL", 8);
+		if (!StreamIndex::GetFileInfo(jsonPath, header.jsonSize, header.jsonMtime)) {
+			return false;
+		}
+		header.version = formatVersion;
+		header.nrInputs = (int32_t)inputCameras.size();
+		header.maxNrInputsUsed = maxNrInputsUsed;
+		header.nrDirectionBins = directionBinsPerSide;
+		header.FOV_x = FOV_x;
+		header.FOV_y = FOV_y;
+		placeNodes(inputCameras, resolution, header);
+		if (tableSize(header) * sizeof(uint16_t) > maxTableBytes) {
+			std::cout << "Error: the selection grid would take " << (tableSize(header) * sizeof(uint16_t) >> 20)
+				<< " MB, at most " << (maxTableBytes >> 20) << " MB is allowed" << std::endl;
+			return false;
+		}
+		return true;
+	}
+
+	// Maps the grid at path if it matches expected
+	bool open(const std::string& path, const Header& expected) {
+		close();
+		if (!map(path)) {
+			return false;
+		}
+		if (fileSize < sizeof(Header) || !isSameLayout(*(const Header*)mapping, expected)
+			|| fileSize != sizeof(Header) + tableSize(expected) * sizeof(uint16_t)) {
+			close();
+			return false;
+		}
+		header = expected;
+		table = (const uint16_t*)(mapping + sizeof(Header));
+		return true;
+	}
+
+	// Fills the table by calling select for every viewpoint, on as many threads as there are selectors
+	// (each selector is only called by one thread), and writes it to path.
+	// If it cannot be written, the grid is still used from memory.
+	void build(const std::string& path, const Header& layout, const std::vector<std::function<void(const glm::mat4&, std::vector<int>&)>>& selectors) {
+		close();
+		header = layout;
+		built.assign(tableSize(header), 0xFFFF);
+		int nrViewpoints = (int)(built.size() / header.maxNrInputsUsed);
+		std::vector<std::thread> threads;
+		for (int t = 0; t < selectors.size(); t++) {
+			threads.push_back(std::thread([this, t, nrViewpoints, &selectors]() {
+				std::vector<int> selection;
+				for (int v = t; v < nrViewpoints; v += (int)selectors.size()) {
+					selectors[t](viewpoint(v), selection);
+					for (int j = 0; j < selection.size() && j < header.maxNrInputsUsed; j++) {
+						built[(size_t)v * header.maxNrInputsUsed + j] = (uint16_t)selection[j];
+					}
+				}
+			}));
+		}
+		for (std::thread& thread : threads) {
+			thread.join();
+		}
+		table = built.data();
+
+		FILE* file = fopen(path.c_str(), "wb");
+		bool ok = file != NULL
+			&& fwrite(&header, sizeof(Header), 1, file) == 1
+			&& fwrite(built.data(), sizeof(uint16_t), built.size(), file) == built.size();
+		if (file) {
+			ok = fclose(file) == 0 && ok;
+		}
+		if (!ok) {
+			std::cout << "Warning: could not write " << path << ", the selection grid is only kept in memory" << std::endl;
+			remove(path.c_str());
+		}
+		else if (open(path, layout)) {
+			// the mapping replaces the copy in memory
+			std::vector<uint16_t>().swap(built);
+		}
+	}
+
+	bool isOpen() const {
+		return table != NULL;
+	}
+
+	int nrViewpoints() const {
+		return isOpen() ? (int)(tableSize(header) / header.maxNrInputsUsed) : 0;
+	}
+
+	// The union of the InputCameras stored for the 8 grid nodes around the position of the OutputCamera,
+	// in the 2 x 2 direction bins around its viewing direction.
+	// Returns false if the OutputCamera is outside of the grid.
+	bool lookup(const glm::mat4& model, std::vector<int>& candidates) const {
+		candidates.clear();
+		if (!isOpen()) {
+			return false;
+		}
+		int first[3];
+		for (int a = 0; a < 3; a++) {
+			float g = (model[3][a] - header.minCorner[a]) / header.cellSize;
+			if (!(g >= 0.0f && g <= header.dims[a] - 1)) {
+				return false;
+			}
+			first[a] = std::min((int)g, header.dims[a] - 2);
+		}
+		int bins[4];
+		directionBins(-glm::vec3(model[2]), bins);
+		for (int corner = 0; corner < 8; corner++) {
+			int node = nodeIndex(first[0] + (corner & 1), first[1] + ((corner >> 1) & 1), first[2] + ((corner >> 2) & 1));
+			for (int bin : bins) {
+				const uint16_t* selection = table + ((size_t)node * nrDirectionBins() + bin) * header.maxNrInputsUsed;
+				for (int j = 0; j < header.maxNrInputsUsed && selection[j] != 0xFFFF; j++) {
+					candidates.push_back(selection[j]);
+				}
+			}
+		}
+		std::sort(candidates.begin(), candidates.end());
+		candidates.erase(std::unique(candidates.begin(), candidates.end()), candidates.end());
+		return true;
+	}
+
+	void close() {
+		unmap();
+		std::vector<uint16_t>().swap(built);
+		table = NULL;
+	}
+
+private:
+	static const int32_t formatVersion = 1;
+	static const int32_t directionBinsPerSide = 6;
+
+	Header header;
+	const uint16_t* table = NULL;     // points into mapping, or to built
+	std::vector<uint16_t> built;      // the table if it was built but could not be written
+	uint8_t* mapping = NULL;
+	size_t fileSize = 0;
+
+	static bool isSameLayout(const Header& a, const Header& b) {
+		return memcmp(a.magic, b.magic, 8) == 0 && a.jsonSize == b.jsonSize && a.jsonMtime == b.jsonMtime
+			&& a.version == b.version && a.nrInputs == b.nrInputs && a.maxNrInputsUsed == b.maxNrInputsUsed
+			&& a.dims[0] == b.dims[0] && a.dims[1] == b.dims[1] && a.dims[2] == b.dims[2] && a.nrDirectionBins == b.nrDirectionBins
+			&& a.FOV_x == b.FOV_x && a.FOV_y == b.FOV_y && a.cellSize == b.cellSize
+			&& a.minCorner[0] == b.minCorner[0] && a.minCorner[1] == b.minCorner[1] && a.minCorner[2] == b.minCorner[2];
+	}
+
+	// sets dims, minCorner and cellSize, see layout()
+	static void placeNodes(const std::vector<InputCamera>& inputCameras, int resolution, Header& header) {
+		glm::vec3 low = glm::vec3(inputCameras[0].model[3]);
+		glm::vec3 high = low;
+		for (const InputCamera& input : inputCameras) {
+			low = glm::min(low, glm::vec3(input.model[3]));
+			high = glm::max(high, glm::vec3(input.model[3]));
+		}
+		float longestSide = std::max(std::max(high.x - low.x, high.y - low.y), std::max(high.z - low.z, 1e-3f));
+		low -= glm::vec3(0.25f * longestSide);
+		high += glm::vec3(0.25f * longestSide);
+		header.cellSize = 1.5f * longestSide / (resolution - 1);
+		for (int a = 0; a < 3; a++) {
+			header.dims[a] = std::max(2, (int)std::ceil((high[a] - low[a]) / header.cellSize - 1e-3f) + 1);
+			// center the nodes on the bounding box
+			header.minCorner[a] = 0.5f * (low[a] + high[a]) - 0.5f * (header.dims[a] - 1) * header.cellSize;
+		}
+	}
+
+	static size_t tableSize(const Header& h) {
+		return (size_t)h.dims[0] * h.dims[1] * h.dims[2] * 6 * h.nrDirectionBins * h.nrDirectionBins * h.maxNrInputsUsed;
+	}
+
+	int nrDirectionBins() const {
+		return 6 * header.nrDirectionBins * header.nrDirectionBins;
+	}
+
+	int nodeIndex(int x, int y, int z) const {
+		return (x * header.dims[1] + y) * header.dims[2] + z;
+	}
+
+	// the face of the cube that direction points to (+x, -x, +y, -y, +z, -z), and the 2 x 2 bins on that face
+	// with their centers around direction
+	void directionBins(const glm::vec3& direction, int bins[4]) const {
+		glm::vec3 a = glm::abs(direction);
+		int axis = a.x >= a.y && a.x >= a.z ? 0 : (a.y >= a.z ? 1 : 2);
+		int face = 2 * axis + (direction[axis] < 0 ? 1 : 0);
+		int b = header.nrDirectionBins;
+		float major = std::max(a[axis], 1e-12f);
+		int u = std::min(b - 2, std::max(0, (int)std::floor((direction[(axis + 1) % 3] / major + 1.0f) * 0.5f * b - 0.5f)));
+		int v = std::min(b - 2, std::max(0, (int)std::floor((direction[(axis + 2) % 3] / major + 1.0f) * 0.5f * b - 0.5f)));
+		for (int corner = 0; corner < 4; corner++) {
+			bins[corner] = (face * b + u + (corner & 1)) * b + v + (corner >> 1);
+		}
+	}
+
+	// the model matrix of the OutputCamera at viewpoint v
+	glm::mat4 viewpoint(int v) const {
+		int bin = v % nrDirectionBins();
+		int node = v / nrDirectionBins();
+		int b = header.nrDirectionBins;
+		int face = bin / (b * b);
+		int axis = face / 2;
+		glm::vec3 forward;
+		forward[axis] = face % 2 == 0 ? 1.0f : -1.0f;
+		forward[(axis + 1) % 3] = ((bin / b) % b + 0.5f) / b * 2.0f - 1.0f;
+		forward[(axis + 2) % 3] = (bin % b + 0.5f) / b * 2.0f - 1.0f;
+		forward = glm::normalize(forward);
+		glm::vec3 up = std::abs(forward.y) > 0.99f ? glm::vec3(0, 0, 1) : glm::vec3(0, 1, 0);
+		glm::vec3 z = -forward;
+		glm::vec3 x = glm::normalize(glm::cross(up, z));
+		glm::vec3 y = glm::cross(z, x);
+		int zi = node % header.dims[2];
+		int yi = (node / header.dims[2]) % header.dims[1];
+		int xi = node / (header.dims[2] * header.dims[1]);
+		glm::vec3 position = glm::vec3(header.minCorner[0], header.minCorner[1], header.minCorner[2]) + header.cellSize * glm::vec3(xi, yi, zi);
+		return glm::mat4(glm::vec4(x, 0), glm::vec4(y, 0), glm::vec4(z, 0), glm::vec4(position, 1));
+	}
+
+	bool map(const std::string& path) {
+#ifdef _WIN32
+		HANDLE file = CreateFileA(path.c_str(), GENERIC_READ, FILE_SHARE_READ, NULL, OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL, NULL);
+		if (file == INVALID_HANDLE_VALUE) {
+			return false;
+		}
+		LARGE_INTEGER size;
+		HANDLE fileMapping = NULL;
+		if (GetFileSizeEx(file, &size) && size.QuadPart > 0) {
+			fileSize = (size_t)size.QuadPart;
+			fileMapping = CreateFileMappingA(file, NULL, PAGE_READONLY, 0, 0, NULL);
+		}
+		if (fileMapping) {
+			mapping = (uint8_t*)MapViewOfFile(fileMapping, FILE_MAP_READ, 0, 0, 0);
+			CloseHandle(fileMapping); // the view keeps the mapping open
+		}
+		CloseHandle(file);
+		return mapping != NULL;
+#else
+		int fd = ::open(path.c_str(), O_RDONLY);
+		if (fd < 0) {
+			return false;
+		}
+		struct stat info;
+		if (fstat(fd, &info) != 0 || info.st_size == 0) {
+			::close(fd);
+			return false;
+		}
+		fileSize = (size_t)info.st_size;
+		void* address = mmap(NULL, fileSize, PROT_READ, MAP_SHARED, fd, 0);
+		::close(fd); // the mapping keeps the file open
+		if (address == MAP_FAILED) {
+			return false;
+		}
+		mapping = (uint8_t*)address;
+		return true;
+#endif
+	}
+
+	void unmap() {
+		if (mapping) {
+#ifdef _WIN32
+			UnmapViewOfFile(mapping);
+#else
+			munmap(mapping, fileSize);
+#endif
+		}
+		mapping = NULL;
+		fileSize = 0;
+	}
+};
+
+#endif
@@ -0,0 +1,115 @@
+#ifndef SPSCQUEUE_H
+#define SPSCQUEUE_H
+
+
+#include <atomic>
+#include <mutex>
+#include <condition_variable>
+#include <vector>
+
+
+/*
+* SpscQueue is a bounded lock-free ring buffer for exactly one producer thread and one consumer thread.
+* The capacity is rounded up to a power of two. push() returns false if the queue is full, pop() if it is empty.
+* head and tail are kept on separate cache lines so the producer and consumer do not invalidate each other's line.
+*/
+template <typename T>
+class SpscQueue {
+public:
+	SpscQueue(size_t minCapacity) {
+		capacity = 1;
+		while (capacity < minCapacity) {
+			capacity <<= 1;
+		}
+		mask = capacity - 1;
+		buffer.resize(capacity);
+	}
+
+	bool push(const T& item) {
+		size_t t = tail.load(std::memory_order_relaxed);
+		if (t - head.load(std::memory_order_acquire) == capacity) {
+			return false;
+		}
+		buffer[t & mask] = item;
+		tail.store(t + 1, std::memory_order_release);
+		return true;
+	}
+
+	bool pop(T& item) {
+		size_t h = head.load(std::memory_order_relaxed);
+		if (h == tail.load(std::memory_order_acquire)) {
+			return false;
+		}
+		item = buffer[h & mask];
+		head.store(h + 1, std::memory_order_release);
+		return true;
+	}
+
+	// approximate if called by a thread other than the producer or consumer
+	size_t size() const {
+		return tail.load(std::memory_order_acquire) - head.load(std::memory_order_acquire);
+	}
+
+private:
+	std::vector<T> buffer;
+	size_t capacity = 0;
+	size_t mask = 0;
+	char padding0[64];
+	std::atomic<size_t> head{ 0 };
+	char padding1[64];
+	std::atomic<size_t> tail{ 0 };
+	char padding2[64];
+};
+
+
+/*
+* Semaphore is a counting semaphore that only takes a lock when a thread actually needs to sleep or be woken up.
+* post() wakes up at most one waiting thread, so a producer can wake up the one consumer that has work.
+* tryWait() never sleeps, so a thread can move on to other work instead.
+*/
+class Semaphore {
+public:
+	Semaphore(int initialCount = 0) : count(initialCount) {}
+
+	void post() {
+		if (count.fetch_add(1, std::memory_order_release) < 0) {
+			{
+				std::lock_guard<std::mutex> lock(mutex);
+				wakeups++;
+			}
+			condition.notify_one();
+		}
+	}
+
+	void wait() {
+		if (count.fetch_sub(1, std::memory_order_acquire) <= 0) {
+			std::unique_lock<std::mutex> lock(mutex);
+			condition.wait(lock, [this]() {return wakeups > 0; });
+			wakeups--;
+		}
+	}
+
+	// takes one if the count is positive, without ever sleeping
+	bool tryWait() {
+		int c = count.load(std::memory_order_relaxed);
+		while (c > 0) {
+			if (count.compare_exchange_weak(c, c - 1, std::memory_order_acquire, std::memory_order_relaxed)) {
+				return true;
+			}
+		}
+		return false;
+	}
+
+	// whether tryWait() would succeed, approximate if other threads take or post at the same time
+	bool isAvailable() const {
+		return count.load(std::memory_order_acquire) > 0;
+	}
+
+private:
+	std::atomic<int> count;
+	int wakeups = 0;
+	std::mutex mutex;
+	std::condition_variable condition;
+};
+
+#endif
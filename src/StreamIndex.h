@@ -0,0 +1,137 @@
+#ifndef STREAMINDEX_H
+#define STREAMINDEX_H
+
+
+#include <stdio.h>
+#include <stdint.h>
+#include <string.h>
+#include <sys/types.h>
+#include <sys/stat.h>
+#include <string>
+#include <vector>
+
+
+/*
+* StreamIndex is the content of a sidecar index file (<video>.idx) that is written next to an mp4 video the first time it is opened.
+* It holds everything FFmpegDemuxer needs to demux the video stream without libavformat:
+* the codec parameters, the codec extradata and the byte offset, size, flags and timestamps of every packet.
+* The sidecar is only valid as long as the size and modification time of the video file did not change.
+*
+* The file starts with the magic "ODIBRIDX" and a version number; all values are stored in the byte order of the machine.
+*/
+class StreamIndex {
+public:
+	struct Packet {
+		int64_t pos;
+		int32_t size;
+		int32_t flags;
+		int64_t pts;
+		int64_t dts;
+	};
+
+	int64_t fileSize = 0;
+	int64_t fileMtime = 0;
+	int32_t codecId = 0;
+	int32_t width = 0;
+	int32_t height = 0;
+	int32_t format = -1;
+	int32_t timeBaseNum = 0;
+	int32_t timeBaseDen = 1;
+	std::vector<uint8_t> extradata;
+	std::vector<Packet> packets;
+
+	static std::string SidecarPath(const std::string& videoPath) {
+		return videoPath + ".idx";
+	}
+
+	static bool GetFileInfo(const std::string& path, int64_t& size, int64_t& mtime) {
+#ifdef _WIN32
+		struct _stat64 info;
+		if (_stat64(path.c_str(), &info) != 0) {
+			return false;
+		}
+#else
+		struct stat info;
+		if (stat(path.c_str(), &info) != 0) {
+			return false;
+		}
+#endif
+		size = (int64_t)info.st_size;
+		mtime = (int64_t)info.st_mtime;
+		return true;
+	}
+
+	// returns false if the sidecar does not exist, is corrupt or does not match the video (anymore)
+	bool Read(const std::string& videoPath) {
+		int64_t size, mtime;
+		if (!GetFileInfo(videoPath, size, mtime)) {
+			return false;
+		}
+		FILE* file = fopen(SidecarPath(videoPath).c_str(), "rb");
+		if (!file) {
+			return false;
+		}
+		char magic[8];
+		int32_t version = 0;
+		int32_t extradataSize = 0;
+		int64_t nrPackets = 0;
+		bool ok = fread(magic, 1, 8, file) == 8 && memcmp(magic, "ODIBRIDX", 8) == 0
+			&& readValue(file, version) && version == formatVersion
+			&& readValue(file, fileSize) && readValue(file, fileMtime)
+			&& fileSize == size && fileMtime == mtime
+			&& readValue(file, codecId) && readValue(file, width) && readValue(file, height) && readValue(file, format)
+			&& readValue(file, timeBaseNum) && readValue(file, timeBaseDen)
+			&& readValue(file, extradataSize) && extradataSize >= 0 && extradataSize <= fileSize
+			&& readValue(file, nrPackets) && nrPackets > 0 && nrPackets <= fileSize;
+		if (ok) {
+			extradata.resize(extradataSize);
+			packets.resize((size_t)nrPackets);
+			ok = fread(extradata.data(), 1, extradataSize, file) == (size_t)extradataSize
+				&& fread(packets.data(), sizeof(Packet), packets.size(), file) == packets.size();
+		}
+		fclose(file);
+		return ok;
+	}
+
+	bool Write(const std::string& videoPath) {
+		if (!GetFileInfo(videoPath, fileSize, fileMtime)) {
+			return false;
+		}
+		FILE* file = fopen(SidecarPath(videoPath).c_str(), "wb");
+		if (!file) {
+			return false;
+		}
+		int32_t version = formatVersion;
+		int32_t extradataSize = (int32_t)extradata.size();
+		int64_t nrPackets = (int64_t)packets.size();
+		bool ok = fwrite("ODIBRIDX", 1, 8, file) == 8
+			&& writeValue(file, version)
+			&& writeValue(file, fileSize) && writeValue(file, fileMtime)
+			&& writeValue(file, codecId) && writeValue(file, width) && writeValue(file, height) && writeValue(file, format)
+			&& writeValue(file, timeBaseNum) && writeValue(file, timeBaseDen)
+			&& writeValue(file, extradataSize)
+			&& writeValue(file, nrPackets)
+			&& fwrite(extradata.data(), 1, extradata.size(), file) == extradata.size()
+			&& fwrite(packets.data(), sizeof(Packet), packets.size(), file) == packets.size();
+		ok = fclose(file) == 0 && ok;
+		if (!ok) {
+			remove(SidecarPath(videoPath).c_str());
+		}
+		return ok;
+	}
+
+private:
+	static const int32_t formatVersion = 1;
+
+	template <typename T>
+	static bool readValue(FILE* file, T& value) {
+		return fread(&value, sizeof(T), 1, file) == 1;
+	}
+
+	template <typename T>
+	static bool writeValue(FILE* file, const T& value) {
+		return fwrite(&value, sizeof(T), 1, file) == 1;
+	}
+};
+
+#endif
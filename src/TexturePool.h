@@ -0,0 +1,135 @@
+#ifndef TEXTUREPOOL_H
+#define TEXTUREPOOL_H
+
+
+#include <GL/glew.h>
+#ifdef HAVE_NVDEC
+#include <cuda.h>
+#include <cudaGL.h>
+#endif
+#include <vector>
+#include "NvCodecUtils.h"
+
+
+/*
+* TexturePool owns the color and depth textures of the inputs, as a number of slots that each hold one color and one depth texture.
+*
+* For images, or if every input is rendered, each input has its own slot (bind()).
+* Otherwise there are only as many slots as inputs that can be rendered at the same time (--max_nr_inputs),
+* so memory scales with that instead of with the size of the camera rig:
+* before the decoded frame of an input is copied to a texture, acquire() gives the input a slot,
+* taking the least recently used slot of another input if the input has none.
+*
+* Only accessed by the OpenGL thread.
+*/
+class TexturePool {
+public:
+	struct Slot {
+		GLuint color = 0;
+		GLuint depth = 0;
+#ifdef HAVE_NVDEC
+		CUgraphicsResource* colorResource = NULL; // only if the textures are registered with CUDA
+		CUgraphicsResource* depthResource = NULL;
+#endif
+		int input = -1;                           // the input whose frame is in the textures, -1 if none
+		int lastUsed = -1;                        // the video frame for which the textures were last written
+	};
+
+	TexturePool() {}
+
+	void init(int nrInputs) {
+		inputToSlot = std::vector<int>(nrInputs, -1);
+	}
+
+	// takes ownership of the textures
+	int addSlot(GLuint color, GLuint depth) {
+		Slot slot;
+		slot.color = color;
+		slot.depth = depth;
+		slots.push_back(slot);
+		return (int)slots.size() - 1;
+	}
+
+	int getNrSlots() {
+		return (int)slots.size();
+	}
+
+#ifdef HAVE_NVDEC
+	// the CUDA context needs to be current
+	void registerWithCuda() {
+		for (Slot& slot : slots) {
+			slot.colorResource = new CUgraphicsResource();
+			slot.depthResource = new CUgraphicsResource();
+			ck(cuGraphicsGLRegisterImage(slot.colorResource, slot.color, GL_TEXTURE_2D, CU_GRAPHICS_REGISTER_FLAGS_WRITE_DISCARD));
+			ck(cuGraphicsGLRegisterImage(slot.depthResource, slot.depth, GL_TEXTURE_2D, CU_GRAPHICS_REGISTER_FLAGS_WRITE_DISCARD));
+			ck(cuGraphicsResourceSetMapFlags(*slot.colorResource, CU_GRAPHICS_MAP_RESOURCE_FLAGS_WRITE_DISCARD));
+			ck(cuGraphicsResourceSetMapFlags(*slot.depthResource, CU_GRAPHICS_MAP_RESOURCE_FLAGS_WRITE_DISCARD));
+		}
+	}
+
+	void unregisterFromCuda() {
+		for (Slot& slot : slots) {
+			if (slot.colorResource) {
+				ck(cuGraphicsUnregisterResource(*slot.colorResource));
+				ck(cuGraphicsUnregisterResource(*slot.depthResource));
+				delete slot.colorResource;
+				delete slot.depthResource;
+				slot.colorResource = NULL;
+				slot.depthResource = NULL;
+			}
+		}
+	}
+#endif
+
+	void bind(int input, int slotIndex) {
+		Slot& slot = slots[slotIndex];
+		if (slot.input >= 0) {
+			inputToSlot[slot.input] = -1;
+		}
+		if (inputToSlot[input] >= 0) {
+			slots[inputToSlot[input]].input = -1;
+		}
+		slot.input = input;
+		inputToSlot[input] = slotIndex;
+	}
+
+	// returns the slot of the input, binding it to a free or else the least recently used slot if it has none
+	Slot& acquire(int input, int frameNr) {
+		int slotIndex = inputToSlot[input];
+		if (slotIndex < 0) {
+			slotIndex = 0;
+			for (int s = 1; s < slots.size(); s++) {
+				bool isFree = slots[s].input < 0;
+				bool bestIsFree = slots[slotIndex].input < 0;
+				if ((isFree && !bestIsFree) || (isFree == bestIsFree && slots[s].lastUsed < slots[slotIndex].lastUsed)) {
+					slotIndex = s;
+				}
+			}
+			bind(input, slotIndex);
+		}
+		slots[slotIndex].lastUsed = frameNr;
+		return slots[slotIndex];
+	}
+
+	// NULL if the textures do not hold a frame of the input
+	const Slot* find(int input) {
+		int slotIndex = inputToSlot[input];
+		return slotIndex < 0 ? NULL : &slots[slotIndex];
+	}
+
+	// unregisterFromCuda() needs to be called first, before the CUDA context is destroyed
+	void cleanup() {
+		for (Slot& slot : slots) {
+			glDeleteTextures(1, &slot.color);
+			glDeleteTextures(1, &slot.depth);
+		}
+		slots.clear();
+		inputToSlot.clear();
+	}
+
+private:
+	std::vector<Slot> slots;
+	std::vector<int> inputToSlot; // per input, -1 if the input has no slot
+};
+
+#endif
@@ -0,0 +1,155 @@
+#ifndef TRACER_H
+#define TRACER_H
+
+
+#include <stdint.h>
+#include <chrono>
+#include <mutex>
+#include <vector>
+#include <string>
+#include <fstream>
+#include <iostream>
+
+
+/*
+* Tracer records spans (name, start, duration, thread) for --trace and writes them as Chrome Trace Event JSON,
+* which can be opened in Perfetto (ui.perfetto.dev) or chrome://tracing.
+*
+* Every thread records into its own ring buffer, so recording takes no lock. Once a buffer is full,
+* the oldest spans of that thread are overwritten. A thread only takes a lock once, to register its buffer.
+* enable() has to be called before any thread records, and writeToJSONFile() after all other threads stopped.
+*
+* Usage: TraceSpan span("RenderTarget"); records the span from its construction until the end of the scope.
+*/
+class Tracer {
+private:
+	struct Event {
+		const char* name;    // string literal
+		const char* argName; // string literal, or NULL if there is no argument
+		int arg;
+		int64_t start;       // microseconds since enable()
+		int64_t duration;
+	};
+
+	struct ThreadBuffer {
+		std::vector<Event> events;
+		size_t nrRecorded = 0;
+		int tid = 0;
+		std::string name;
+	};
+
+	bool enabled = false;
+	size_t eventsPerThread = 0;
+	std::chrono::steady_clock::time_point startTime;
+	std::mutex mutex;
+	std::vector<ThreadBuffer*> buffers;
+
+	Tracer() {}
+
+	ThreadBuffer* getThreadBuffer() {
+		static thread_local ThreadBuffer* buffer = NULL;
+		if (!buffer) {
+			std::lock_guard<std::mutex> lock(mutex);
+			buffer = new ThreadBuffer();
+			buffer->events.resize(eventsPerThread);
+			buffer->tid = (int)buffers.size() + 1;
+			buffer->name = "Thread " + std::to_string(buffer->tid);
+			buffers.push_back(buffer);
+		}
+		return buffer;
+	}
+
+public:
+	~Tracer() {
+		for (ThreadBuffer* buffer : buffers) {
+			delete buffer;
+		}
+	}
+
+	static Tracer& instance() {
+		static Tracer tracer;
+		return tracer;
+	}
+
+	void enable(size_t eventsPerThread = 1 << 18) {
+		this->eventsPerThread = eventsPerThread;
+		startTime = std::chrono::steady_clock::now();
+		enabled = true;
+	}
+
+	bool isEnabled() const {
+		return enabled;
+	}
+
+	int64_t now() const {
+		return std::chrono::duration_cast<std::chrono::microseconds>(std::chrono::steady_clock::now() - startTime).count();
+	}
+
+	// the name shown for the calling thread
+	void setThreadName(const std::string& name) {
+		if (enabled) {
+			getThreadBuffer()->name = name;
+		}
+	}
+
+	void record(const char* name, int64_t start, int64_t end, const char* argName = NULL, int arg = 0) {
+		ThreadBuffer* buffer = getThreadBuffer();
+		Event& event = buffer->events[buffer->nrRecorded % eventsPerThread];
+		event.name = name;
+		event.argName = argName;
+		event.arg = arg;
+		event.start = start;
+		event.duration = end - start;
+		buffer->nrRecorded++;
+	}
+
+	void writeToJSONFile(std::string path) {
+		std::ofstream jsonFile;
+		jsonFile.open(path);
+		jsonFile << "{\"traceEvents\":[\n";
+		bool first = true;
+		for (ThreadBuffer* buffer : buffers) {
+			jsonFile << (first ? "" : ",\n") << "{\"name\":\"thread_name\",\"ph\":\"M\",\"pid\":1,\"tid\":" << buffer->tid
+				<< ",\"args\":{\"name\":\"" << buffer->name << "\"}}";
+			first = false;
+			size_t nrEvents = buffer->nrRecorded < eventsPerThread ? buffer->nrRecorded : eventsPerThread;
+			for (size_t i = buffer->nrRecorded - nrEvents; i < buffer->nrRecorded; i++) {
+				const Event& event = buffer->events[i % eventsPerThread];
+				jsonFile << ",\n{\"name\":\"" << event.name << "\",\"ph\":\"X\",\"pid\":1,\"tid\":" << buffer->tid
+					<< ",\"ts\":" << event.start << ",\"dur\":" << event.duration;
+				if (event.argName) {
+					jsonFile << ",\"args\":{\"" << event.argName << "\":" << event.arg << "}";
+				}
+				jsonFile << "}";
+			}
+		}
+		jsonFile << "\n]}\n";
+		jsonFile.close();
+		std::cout << "Wrote to " << path << std::endl;
+	}
+};
+
+
+// records a span from construction until destruction, if tracing is enabled
+class TraceSpan {
+private:
+	const char* name;
+	const char* argName;
+	int arg;
+	int64_t start = 0;
+
+public:
+	TraceSpan(const char* name, const char* argName = NULL, int arg = 0) : name(name), argName(argName), arg(arg) {
+		if (Tracer::instance().isEnabled()) {
+			start = Tracer::instance().now();
+		}
+	}
+
+	~TraceSpan() {
+		if (Tracer::instance().isEnabled()) {
+			Tracer::instance().record(name, start, Tracer::instance().now(), argName, arg);
+		}
+	}
+};
+
+#endif
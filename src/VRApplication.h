@@ -372,6 +372,7 @@ bool VRApplication::HandleUserInput()
 
 bool VRApplication::RenderFrame(bool nextVideoFrame, std::string outputCameraName, int frameNr)
 {
+	TraceSpan span("RenderFrame");
 	bool shouldUpdateUsedInputs = false;
 	if (m_pHMD)
 	{
@@ -431,6 +432,13 @@ void VRApplication::SetupCameras()
 	inversePlayerAreaPosMat = glm::inverse(playerAreaPosMat);
 
 	cameraVisibilityHelper.init(inputCameras, &pcOutputCamera, options.maxNrInputsUsed);
+	if (options.coverageSamples > 0) {
+		cameraVisibilityHelper.useCoverage(options.coverageSamples, options.coverageBudgetMs);
+	}
+	if (options.selectionGridResolution > 0) {
+		cameraVisibilityHelper.useSelectionGrid(options.inputJsonPath, options.selectionGridResolution);
+	}
+	cameraVisibilityHelper.setTemporalCoherence(options.selectionHysteresis, options.maxInputSwitches, options.minInputDwell);
 	current_inputsToUse = cameraVisibilityHelper.updateInputsToUse();
 	for (auto& c : current_inputsToUse) {
 		next_inputsToUse.insert(c); // deep copy
@@ -525,20 +533,22 @@ void VRApplication::SetupCompanionWindow()
 
 void VRApplication::RenderScene(int i, bool isFirstInput)
 {
+	TraceSpan span("RenderScene", "input", i);
+	const TexturePool::Slot* slot = texturePool.find(i);
 	shaders.shader.setMat4("project", pcOutputCamera.projectionLeft);
 	for (vr::EVREye eye : {vr::EVREye::Eye_Left, vr::EVREye::Eye_Right}) {
 		if (eye == vr::EVREye::Eye_Right) {
 			shaders.shader.setMat4("project", pcOutputCamera.projectionRight);
 		}
 		if (isFirstInput) {
-			framebuffers.renderTheFirstInputImage(eye, textures_color[i], textures_depth[i]);
+			framebuffers.renderTheFirstInputImage(eye, slot->color, slot->depth);
 		}
 		else {
 			shaders.copyShader.use();
 			framebuffers.copyFramebuffer(eye);
 
 			shaders.shader.use();
-			framebuffers.renderNonFirstInputImage(eye, textures_color[i], textures_depth[i]);
+			framebuffers.renderNonFirstInputImage(eye, slot->color, slot->depth);
 		}
 	}
 }
@@ -0,0 +1,189 @@
+#ifndef VIDEO_ENCODER_H
+#define VIDEO_ENCODER_H
+
+
+#include <string>
+#include <iostream>
+extern "C" {
+#include <libavformat/avformat.h>
+#include <libavcodec/avcodec.h>
+#include <libavutil/opt.h>
+}
+#include "PixelConversion.h"
+
+
+/*
+* VideoEncoder encodes the frames of one output camera with libavcodec and muxes them with libavformat
+* into a .mp4 or .mkv file (the container follows the extension of the path), instead of writing a raw .yuv file.
+*
+* The frames have to be passed to encode() in order, frameNr is used as the timestamp (at fps frames per second).
+* The caller fills an AVFrame from allocFrame() and can reuse it after encode(): the encoder keeps a reference,
+* so call av_frame_make_writable() before writing to it again. The same frame can be used for several encoders.
+* close() flushes the frames that are still buffered in the encoder and writes the trailer of the file.
+*/
+class VideoEncoder {
+public:
+	struct Settings {
+		std::string codecName = "libx264";
+		int crf = -1;                     // the constant rate factor, -1 to use the default of the codec
+		OutputPixelFormat format = OutputPixelFormat::YUV420P;
+		int fps = 30;                     // the frame rate of the video, from --output_fps
+	};
+
+	static AVPixelFormat toAVPixelFormat(OutputPixelFormat format) {
+		switch (format) {
+		case OutputPixelFormat::YUV420P: return AV_PIX_FMT_YUV420P;
+		case OutputPixelFormat::YUV444P10LE: return AV_PIX_FMT_YUV444P10LE;
+		case OutputPixelFormat::YUV444P16LE: return AV_PIX_FMT_YUV444P16LE;
+		default: return AV_PIX_FMT_YUV444P;
+		}
+	}
+
+	// prints the reason if the encoder does not exist or does not support the pixel format
+	static bool isSupported(const Settings& settings) {
+#if LIBAVFORMAT_VERSION_MAJOR < 58
+		av_register_all();
+#endif
+		const AVCodec* codec = avcodec_find_encoder_by_name(settings.codecName.c_str());
+		if (!codec || codec->type != AVMEDIA_TYPE_VIDEO) {
+			std::cout << "Error: libavcodec has no video encoder called " << settings.codecName << std::endl;
+			return false;
+		}
+		if (codec->pix_fmts) {
+			AVPixelFormat pixelFormat = toAVPixelFormat(settings.format);
+			for (const AVPixelFormat* p = codec->pix_fmts; *p != AV_PIX_FMT_NONE; p++) {
+				if (*p == pixelFormat) {
+					return true;
+				}
+			}
+			std::cout << "Error: encoder " << settings.codecName << " does not support pixel format " << outputPixelFormatName(settings.format)
+				<< ", choose another one with --output_format" << std::endl;
+			return false;
+		}
+		return true;
+	}
+
+	VideoEncoder() {}
+
+	~VideoEncoder() {
+		close();
+	}
+
+	bool open(const std::string& path, int width, int height, const Settings& settings) {
+		this->path = path;
+#if LIBAVFORMAT_VERSION_MAJOR < 58
+		av_register_all();
+#endif
+		const AVCodec* codec = avcodec_find_encoder_by_name(settings.codecName.c_str());
+		if (!codec) {
+			std::cout << "Error: libavcodec has no video encoder called " << settings.codecName << std::endl;
+			return false;
+		}
+		if (avformat_alloc_output_context2(&fmtc, NULL, NULL, path.c_str()) < 0 || !fmtc) {
+			std::cout << "Error: libavformat cannot write a container for " << path << std::endl;
+			return false;
+		}
+
+		codecContext = avcodec_alloc_context3(codec);
+		codecContext->width = width;
+		codecContext->height = height;
+		codecContext->pix_fmt = toAVPixelFormat(settings.format);
+		codecContext->time_base = { 1, settings.fps };
+		codecContext->framerate = { settings.fps, 1 };
+		codecContext->thread_count = 0; // as many as the encoder wants
+		if (fmtc->oformat->flags & AVFMT_GLOBALHEADER) {
+			codecContext->flags |= AV_CODEC_FLAG_GLOBAL_HEADER;
+		}
+		if (settings.crf >= 0 && av_opt_set(codecContext->priv_data, "crf", std::to_string(settings.crf).c_str(), 0) < 0) {
+			std::cout << "Warning: encoder " << settings.codecName << " has no option crf, it is ignored" << std::endl;
+		}
+		if (avcodec_open2(codecContext, codec, NULL) < 0) {
+			std::cout << "Error: could not open libavcodec encoder " << settings.codecName << " for " << path << std::endl;
+			return false;
+		}
+
+		stream = avformat_new_stream(fmtc, NULL);
+		stream->time_base = codecContext->time_base;
+		avcodec_parameters_from_context(stream->codecpar, codecContext);
+		if (!(fmtc->oformat->flags & AVFMT_NOFILE) && avio_open(&fmtc->pb, path.c_str(), AVIO_FLAG_WRITE) < 0) {
+			std::cout << "Error: could not open " << path << std::endl;
+			return false;
+		}
+		if (avformat_write_header(fmtc, NULL) < 0) {
+			std::cout << "Error: could not write the header of " << path << std::endl;
+			return false;
+		}
+		packet = av_packet_alloc();
+		isOpen = true;
+		return true;
+	}
+
+	// a frame to fill with convertRGBAToPlanes(), NULL if it could not be allocated
+	static AVFrame* allocFrame(int width, int height, OutputPixelFormat format) {
+		AVFrame* frame = av_frame_alloc();
+		frame->width = width;
+		frame->height = height;
+		frame->format = toAVPixelFormat(format);
+		if (av_frame_get_buffer(frame, 0) < 0) {
+			av_frame_free(&frame);
+		}
+		return frame;
+	}
+
+	bool encode(AVFrame* frame, int frameNr) {
+		if (!isOpen) {
+			return false;
+		}
+		frame->pts = frameNr;
+		return send(frame);
+	}
+
+	void close() {
+		if (isOpen) {
+			send(NULL); // flush
+			av_write_trailer(fmtc);
+			isOpen = false;
+		}
+		if (fmtc && !(fmtc->oformat->flags & AVFMT_NOFILE)) {
+			avio_closep(&fmtc->pb);
+		}
+		avformat_free_context(fmtc);
+		fmtc = NULL;
+		avcodec_free_context(&codecContext);
+		av_packet_free(&packet);
+	}
+
+private:
+	std::string path;
+	AVFormatContext* fmtc = NULL;
+	AVCodecContext* codecContext = NULL;
+	AVStream* stream = NULL;
+	AVPacket* packet = NULL;
+	bool isOpen = false;
+
+	// sends the frame (NULL to flush) and writes the packets that come out
+	bool send(AVFrame* frame) {
+		if (avcodec_send_frame(codecContext, frame) < 0) {
+			std::cout << "Error: could not encode a frame for " << path << std::endl;
+			return false;
+		}
+		while (true) {
+			int ret = avcodec_receive_packet(codecContext, packet);
+			if (ret == AVERROR(EAGAIN) || ret == AVERROR_EOF) {
+				return true;
+			}
+			if (ret < 0) {
+				std::cout << "Error: could not encode a frame for " << path << std::endl;
+				return false;
+			}
+			av_packet_rescale_ts(packet, codecContext->time_base, stream->time_base);
+			packet->stream_index = stream->index;
+			if (av_interleaved_write_frame(fmtc, packet) < 0) {
+				std::cout << "Error: could not write to " << path << std::endl;
+				return false;
+			}
+		}
+	}
+};
+
+#endif
@@ -482,50 +482,5 @@ bool readOutputJson(std::string inputJsonPath, /*out*/ std::vector<OutputCamera>
 	return true;
 }
 
-void saveImage(unsigned char* image, int width, int height, bool saveAsPNG, int frameNr, std::string outputPath) {
-
-	if (saveAsPNG) {
-		try {
-			stbi_flip_vertically_on_write(1);
-			stbi_write_png(outputPath.c_str(), width, height, 4, image, width * 4);
-			std::cout << "wrote PNG to " << outputPath << std::endl;
-		}
-		catch (const std::exception & e) {
-			std::cout << "could not write to " << outputPath << std::endl;
-			throw e;
-		}
-	}
-	else {
-		unsigned char* y = new unsigned char[width * height];
-		unsigned char* cb = new unsigned char[width * height];
-		unsigned char* cr = new unsigned char[width * height];
-		for (int row = 0; row < height; row++) {
-			for (int col = 0; col < width; col++) {
-				y[row * width + col] = image[(height - row - 1) * width * 4 + col * 4];
-				cb[row * width + col] = image[(height - row - 1) * width * 4 + col * 4 + 1];
-				cr[row * width + col] = image[(height - row - 1) * width * 4 + col * 4 + 2];
-			}
-		}
-
-		std::cout << "writing YUV444p frame " << frameNr << " to " << outputPath << std::endl;
-		std::fstream stream(outputPath, frameNr == 0 ? std::ios::out | std::ios::binary : std::ios::in | std::ios::out | std::ios::binary);
-		if (stream.good()) {
-			stream.seekp(frameNr * 3 * width * height);
-			stream.write(reinterpret_cast<char*>(y), width* height);
-			stream.write(reinterpret_cast<char*>(cb), width* height);
-			stream.write(reinterpret_cast<char*>(cr), width* height);
-		}
-		else {
-			std::cout << "could not write to " << outputPath << std::endl;
-		}
-
-		delete[] y;
-		delete[] cb;
-		delete[] cr;
-	}
-	return;
-}
-
-
 #endif
 
@@ -7,9 +7,16 @@
 #include <glm.hpp>
 #include <map>
 #include <string>
+#include <thread>
+#include <algorithm>
 #include "cxxopts.hpp"
 #include "ioHelper.h"
+#ifdef HAVE_NVDEC
 #include "AppDecUtils.h"
+#endif
+#include "PixelConversion.h"
+#include "VideoEncoder.h"
+#include "SelectionGrid.h"
 
 
 // From CMAKE preprocessor
@@ -25,6 +32,7 @@ public:
 	std::string outputPath = "";       // path to folder to write the .yuv files with the output videos
 	std::string outputJsonPath = "";   // path to the .json with the output light field camera parameters  
 	std::string fpsCsvPath = "";       // .csv file to where the milliseconds each frame takes to render are written
+	std::string tracePath = "";        // .json file to write a Chrome Trace Event timeline of the render and decoding threads to
 
 	std::vector<InputCamera> inputCameras;
 	OutputCamera viewport;
@@ -37,17 +45,37 @@ public:
 	float cameraSpeed = 0.01f;
 
 	bool saveOutputImages = false;  // if true, the output cameras from the "inputJsonPath" file are rendered one by one and the results are saved to disk as .yuv files
+	OutputPixelFormat outputPixelFormat = OutputPixelFormat::YUV444P; // the layout of the .yuv files, or the pixel format of the encoded videos
+	std::string outputCodec = "";        // if not empty, the output is encoded with this libavcodec encoder instead of written to .yuv files
+	int outputCrf = -1;                  // the constant rate factor of the encoder, -1 for the default of the encoder
+	int outputFps = 30;                  // the frame rate of the encoded videos
+	std::string outputContainer = "mp4"; // the container of the encoded videos, mp4 or mkv
 	int outputNrFrames = 1;
 	int StartingFrameNr = 0;        // the number of the video frame that will be shown first
 	
 	bool useVR = false;
+	bool headless = false;          // if true, render through an offscreen OpenGL context without a window (only when saveOutputImages)
 
 	bool usePNGs = false;           // if true, use png files as input for color and depth instead of mp4 videos
+	bool useRawYUV = false;         // if true, use raw planar YUV 4:2:0 files (.yuv) as input for color and depth, which are memory-mapped instead of decoded
 	bool isStatic = false;          // if true, stops decoding after frame StartingFrameNr
 	
 	int nrThreads = 2;              // the number of threads in the thread pool. Only useful if isStatic == false.
+	int nrStartupThreads = 1;       // the number of threads that load the PNGs or decode up to StartingFrameNr: nrThreads if -t is given, otherwise the number of CPU cores
+	int decodeAhead = 1;            // the number of video frames each input can be decoded ahead of rendering. Only useful if isStatic == false.
+	bool useSidecarIndex = false;   // if true, the mp4 files are indexed into sidecar files (<video>.idx) so later runs can skip probing them
+	int warmInputs = -1;            // if >= 0, only this many of the inputs that are not used for rendering keep being decoded (the most recently used ones), the others are only demuxed
+	int prefetchFrames = 0;         // if > 0, the inputs needed for the pose of the viewer extrapolated this many video frames ahead are kept warm
+	int frameCacheMB = 0;           // if > 0, the decoded frames of the shortest input videos are kept in (GPU) memory, up to this many MB, instead of decoding them again every loop
+	int cpuDecodeThreads = 0;       // if > 0, the videos are decoded on the CPU by libavcodec (with this many threads per video) instead of by NVDEC
 	int triangleSizeInPixels = 1;   // the resolution of the triangle mesh (1 is best, 2 is 4 times less triangles, etc. 
 	int maxNrInputsUsed = -1;       // determine the upper limit of inputs that can be used at the same time
+	float selectionHysteresis = 0.0f; // if > 0, an input in use only gets replaced by one that ranks this much better (see CameraVisibilityHelper::setTemporalCoherence)
+	int maxInputSwitches = -1;      // if >= 0, at most this many inputs in use are replaced per video frame
+	int minInputDwell = 0;          // an input stays in use for at least this many video frames
+	int selectionGridResolution = 0; // if > 0, the inputs to use are looked up in a precomputed SelectionGrid with this many positions along the longest side of the rig
+	int coverageSamples = 0;        // if > 0, the inputs to use are the ones that together see most of a grid of this many x this many points over the output image, at 3 depths
+	float coverageBudgetMs = 2.0f;  // the time the choice of inputs with coverageSamples may take, per video frame
 	int blendingFactor = 0;         // the higher, the more blending there is between input color images
 	bool showCameraVisibilityWindow = false;
 	
@@ -85,9 +113,21 @@ public:
 			("frame_nr", "The frame that needs to be shown if the input light field consists of videos and option \'--static\' is set", cxxopts::value<int>()->default_value("0"))
 			;
 		options.add_options("Settings to improve performance")
-			("t", "Number of threads for the thread pool that decodes the videos. Should be >= 2. Recommended: #CPUcores - 1", cxxopts::value<int>()->default_value("2"))
+			("t", "Number of threads for the thread pool that decodes the videos. Should be >= 2. Recommended: #CPUcores - 1. Also the number of threads that load the png inputs or decode up to --frame_nr, which is #CPUcores if -t is not given", cxxopts::value<int>()->default_value("2"))
+			("decode_ahead", "Number of video frames each input can be decoded ahead of rendering, to absorb decoding hiccups. Uses more (GPU) memory, and the choice of inputs lags this many frames behind the camera. In [1,16]", cxxopts::value<int>()->default_value("1"))
+			("sidecar_index", "Write a binary index file next to each input mp4 video on the first run (<video>.idx), so later runs skip probing the videos and read the packets directly")
+			("warm_inputs", "Number of inputs that are not used for rendering but are still decoded, so they can be used again right away. These are the most recently used ones; the others are only demuxed and catch up from their last keyframe when needed again. Default: all inputs", cxxopts::value<int>())
+			("prefetch_frames", "Extrapolate the motion of the viewer this many video frames ahead and keep decoding the inputs needed for the predicted poses, so they are ready when they get used. Only useful with --warm_inputs", cxxopts::value<int>())
+			("frame_cache", "Keep all decoded frames of the shortest input videos in (GPU) memory after their first loop, so they are not decoded again. The argument is the memory budget in MB", cxxopts::value<int>())
+			("cpu_decode", "Decode the videos on the CPU with libavcodec instead of on the GPU with NVDEC, using the given number of threads per video (default: 2)", cxxopts::value<int>()->implicit_value("2"))
 			("asap", "Decode and play the image/video frames as soon as possible (basically disabling the Vsync@90Hz)")
 			("max_nr_inputs", "The maximum number of input images/videos that will be processed per frame (-1 if all need to be processed)", cxxopts::value<int>()->default_value("-1"))
+			("selection_hysteresis", "Keep using an input until another one ranks this much better, to avoid inputs flipping in and out while the viewer moves a little. In radians of the angle to the viewing direction (distance to the viewer for 360 degree inputs). Only useful with --max_nr_inputs", cxxopts::value<float>())
+			("max_input_switches", "The maximum number of inputs that may be replaced per video frame, 0 keeps the first selection. Only useful with --max_nr_inputs", cxxopts::value<int>())
+			("min_input_dwell", "The minimum number of video frames an input stays in use once it is chosen. Only useful with --max_nr_inputs", cxxopts::value<int>())
+			("coverage_selection", "Choose the inputs that together see most of the output view, sampled by a grid of N x N points over the output image at 3 depths (default: 5), instead of the inputs that see its center and corners. Covers more of wide views with the same number of inputs, but takes more time (see --coverage_budget). Only useful with --max_nr_inputs", cxxopts::value<int>()->implicit_value("5"))
+			("coverage_budget", "The time in ms the choice of inputs with --coverage_selection may take per video frame, the remaining inputs are chosen as without --coverage_selection. Scoring all inputs for the samples comes first and cannot be cut short: with 5 x 5 samples, it takes about 1 ms per 1000 inputs, and more samples take proportionally longer. If it takes more than half of the budget, fewer samples are used from then on (down to 2 x 2, below that none), so a choice can still take up to about twice the budget", cxxopts::value<float>()->default_value("2"))
+			("selection_grid", "Precompute which inputs to use for a grid of viewpoints around the input cameras, with this many positions along the longest side of the rig (default: 16), and store it next to the input json (<json>.grid) for later runs. The grid may take at most 32 MB, which can take minutes to build the first time. The inputs are then only chosen among those of the surrounding viewpoints, which is faster but approximate. Only useful with --max_nr_inputs, for large rigs of perspective cameras", cxxopts::value<int>()->implicit_value("16"))
 			("show_inputs", "This setting will display the positions and rotations of the input and output cameras on screen, as well as which inputs are used to render the current frame.")
 			("mesh_subdivisions", "The detail level of the triangle meshes, full resolution if 0, 1/2 resolution if 1, 1/3 resolution if 2, etc. Must lie in [0,5]", cxxopts::value<int>()->default_value("0"))
 			("target_fps", "The target application fps in case of video inputs. Needs to be a multiple of 30, which is the assumed framerate of the videos.", cxxopts::value<int>()->default_value("90"))
@@ -96,7 +136,14 @@ public:
 			// save to disk
 			("p,output_json", "Path to the .json file with the camera parameters for which the output image needs to be saved to disk", cxxopts::value<std::string>())
 			("o,output_dir", "Path to the folder where the output will be saved", cxxopts::value<std::string>())
-			("fps_csv", "Path to the .csv file to write the time needed to render each frame to", cxxopts::value<std::string>())
+			("output_format", "Pixel format of the .yuv output files: yuv444p (default), yuv420p (the chroma of every 2x2 pixels is averaged), yuv444p10le or yuv444p16le", cxxopts::value<std::string>())
+			("output_codec", "Encode the output of each output camera to a video with this libavcodec encoder (e.g. libx264, libx265, libsvtav1) instead of writing raw .yuv files", cxxopts::value<std::string>())
+			("output_crf", "The constant rate factor of --output_codec, lower is better quality (default: the default of the encoder)", cxxopts::value<int>())
+			("output_fps", "The frame rate of the videos encoded with --output_codec, set it to that of the input videos (default: 30)", cxxopts::value<int>())
+			("output_container", "The container of the videos of --output_codec: mp4 (default) or mkv", cxxopts::value<std::string>())
+			("fps_csv", "Path to the .csv file to write the time needed to render each frame to. Percentiles and missed vsyncs are written to <name>_summary.json next to it (updated every 10 s), and for videos, latency percentiles of the decoding stages to <name>_pool.csv", cxxopts::value<std::string>())
+			("headless", "Render without a window, through an offscreen EGL context, e.g. on a server without a display. Only when the output is saved to disk (-o/--output_dir and -p/--output_json)")
+			("trace", "Path to the .json file to write a timeline of the rendering and decoding work to at exit (Chrome Trace Event format, open it in ui.perfetto.dev)", cxxopts::value<std::string>())
 			;
 		options.add_options("Settings to improve quality")
 			("blending_factor", "The higher this factor, the more blending between inputs there is, as an int in [0,10]", cxxopts::value<int>()->default_value("1"))
@@ -151,6 +198,66 @@ public:
 			}
 			useVR = true;
 		}
+		if (result.count("headless")) {
+			if (!saveOutputImages) {
+				std::cout << "Error: option --headless is only supported if the output is saved to disk (-o/--output_dir and -p/--output_json)" << std::endl;
+				exit(-1);
+			}
+			headless = true;
+		}
+		if (result.count("output_format")) {
+			std::string format = result["output_format"].as<std::string>();
+			if (!parseOutputPixelFormat(format, outputPixelFormat)) {
+				std::cout << "Error: option --output_format should be yuv444p, yuv420p, yuv444p10le or yuv444p16le, not " << format << std::endl;
+				exit(-1);
+			}
+			if (!saveOutputImages || usePNGs) {
+				std::cout << "Option --output_format is ignored when the output is not saved to .yuv files (-o/--output_dir and -p/--output_json with video inputs)" << std::endl;
+			}
+		}
+		// for both the .yuv files and the encoded videos
+		if (saveOutputImages && !usePNGs && !isOutputSizeSupported(outputPixelFormat, SCR_WIDTH, SCR_HEIGHT)) {
+			std::cout << "Error: output pixel format " << outputPixelFormatName(outputPixelFormat) << " needs an even width (=" << SCR_WIDTH << ") and height (=" << SCR_HEIGHT << ") of the output cameras" << std::endl;
+			exit(-1);
+		}
+		if (result.count("output_codec")) {
+			if (!saveOutputImages || usePNGs) {
+				std::cout << "Option --output_codec is ignored when the output is not saved to .yuv files (-o/--output_dir and -p/--output_json with video inputs)" << std::endl;
+			}
+			else {
+				outputCodec = result["output_codec"].as<std::string>();
+				if (result.count("output_crf")) {
+					outputCrf = result["output_crf"].as<int>();
+					if (outputCrf < 0) {
+						std::cout << "Error: option --output_crf should be at least 0" << std::endl;
+						exit(-1);
+					}
+				}
+				if (result.count("output_fps")) {
+					outputFps = result["output_fps"].as<int>();
+					if (outputFps < 1) {
+						std::cout << "Error: option --output_fps should be at least 1" << std::endl;
+						exit(-1);
+					}
+				}
+				if (result.count("output_container")) {
+					outputContainer = result["output_container"].as<std::string>();
+					if (outputContainer != "mp4" && outputContainer != "mkv") {
+						std::cout << "Error: option --output_container should be mp4 or mkv" << std::endl;
+						exit(-1);
+					}
+				}
+				VideoEncoder::Settings settings;
+				settings.codecName = outputCodec;
+				settings.format = outputPixelFormat;
+				if (!VideoEncoder::isSupported(settings)) {
+					exit(-1);
+				}
+			}
+		}
+		else if (result.count("output_crf") || result.count("output_fps") || result.count("output_container")) {
+			std::cout << "Options --output_crf, --output_fps and --output_container are ignored without --output_codec" << std::endl;
+		}
 		if (usePNGs || result.count("static")) {
 			isStatic = true;
 			outputNrFrames = 1;
@@ -211,15 +318,164 @@ public:
 			}
 		}
 
+		nrStartupThreads = (std::max)(1, (int)std::thread::hardware_concurrency());
 		if (result.count("t")) {
-			if (isStatic) {
-				std::cout << "Option --t is ignored when the input dataset contains PNGs or --static is provided" << std::endl;
-			}
 			nrThreads = result["t"].as<int>();
 			if (nrThreads < 2) {
 				std::cout << "Error: option -t should be equal to or greater than 2" << std::endl;
 				exit(-1);
 			}
+			nrStartupThreads = nrThreads;
+		}
+		if (result.count("decode_ahead")) {
+			if (isStatic) {
+				std::cout << "Option --decode_ahead is ignored when the input dataset contains PNGs or --static is provided" << std::endl;
+			}
+			decodeAhead = result["decode_ahead"].as<int>();
+			if (decodeAhead < 1 || decodeAhead > 16) {
+				std::cout << "Error: option --decode_ahead should be an int in [1,16]" << std::endl;
+				exit(-1);
+			}
+		}
+		if (result.count("sidecar_index")) {
+			if (usePNGs || useRawYUV) {
+				std::cout << "Option --sidecar_index is ignored when the input dataset contains PNGs or raw YUV files" << std::endl;
+			}
+			useSidecarIndex = !usePNGs && !useRawYUV;
+		}
+		if (result.count("warm_inputs")) {
+			if (isStatic) {
+				std::cout << "Option --warm_inputs is ignored when the input dataset contains PNGs or --static is provided" << std::endl;
+			}
+			else {
+				warmInputs = result["warm_inputs"].as<int>();
+				if (warmInputs < 0) {
+					std::cout << "Error: option --warm_inputs should be at least 0" << std::endl;
+					exit(-1);
+				}
+			}
+		}
+		if (result.count("prefetch_frames")) {
+			if (isStatic) {
+				std::cout << "Option --prefetch_frames is ignored when the input dataset contains PNGs or --static is provided" << std::endl;
+			}
+			else {
+				prefetchFrames = result["prefetch_frames"].as<int>();
+				if (prefetchFrames < 1) {
+					std::cout << "Error: option --prefetch_frames should be at least 1" << std::endl;
+					exit(-1);
+				}
+			}
+		}
+		if (result.count("frame_cache")) {
+			if (isStatic) {
+				std::cout << "Option --frame_cache is ignored when the input dataset contains PNGs or --static is provided" << std::endl;
+			}
+			else {
+				frameCacheMB = result["frame_cache"].as<int>();
+				if (frameCacheMB < 1) {
+					std::cout << "Error: option --frame_cache should be at least 1 (MB)" << std::endl;
+					exit(-1);
+				}
+			}
+		}
+		if (result.count("cpu_decode")) {
+			if (usePNGs || useRawYUV) {
+				std::cout << "Option --cpu_decode is ignored when the input dataset contains PNGs or raw YUV files, which need no decoding" << std::endl;
+			}
+			else {
+				cpuDecodeThreads = result["cpu_decode"].as<int>();
+				if (cpuDecodeThreads < 1) {
+					std::cout << "Error: option --cpu_decode should be at least 1" << std::endl;
+					exit(-1);
+				}
+			}
+		}
+#ifndef HAVE_NVDEC
+		else if (!usePNGs && !useRawYUV) {
+			// built without NVDEC (ENABLE_NVDEC=OFF), so the videos are always decoded on the CPU
+			cpuDecodeThreads = 2;
+		}
+#endif
+		if (result.count("selection_hysteresis")) {
+			if (saveOutputImages) {
+				std::cout << "Option --selection_hysteresis is ignored when the output is saved to disk (-o/--output_dir and -p/--output_json)" << std::endl;
+			}
+			else {
+				selectionHysteresis = result["selection_hysteresis"].as<float>();
+				if (selectionHysteresis < 0) {
+					std::cout << "Error: option --selection_hysteresis should be at least 0" << std::endl;
+					exit(-1);
+				}
+			}
+		}
+		if (result.count("max_input_switches")) {
+			if (saveOutputImages) {
+				std::cout << "Option --max_input_switches is ignored when the output is saved to disk (-o/--output_dir and -p/--output_json)" << std::endl;
+			}
+			else {
+				maxInputSwitches = result["max_input_switches"].as<int>();
+				if (maxInputSwitches < 0) {
+					std::cout << "Error: option --max_input_switches should be at least 0" << std::endl;
+					exit(-1);
+				}
+			}
+		}
+		if (result.count("min_input_dwell")) {
+			if (saveOutputImages) {
+				std::cout << "Option --min_input_dwell is ignored when the output is saved to disk (-o/--output_dir and -p/--output_json)" << std::endl;
+			}
+			else {
+				minInputDwell = result["min_input_dwell"].as<int>();
+				if (minInputDwell < 1) {
+					std::cout << "Error: option --min_input_dwell should be at least 1" << std::endl;
+					exit(-1);
+				}
+			}
+		}
+		if (result.count("selection_grid")) {
+			if (saveOutputImages) {
+				std::cout << "Option --selection_grid is ignored when the output is saved to disk (-o/--output_dir and -p/--output_json)" << std::endl;
+			}
+			else {
+				selectionGridResolution = result["selection_grid"].as<int>();
+				if (selectionGridResolution < 2 || selectionGridResolution > 64) {
+					std::cout << "Error: option --selection_grid should be an int in [2,64]" << std::endl;
+					exit(-1);
+				}
+				if (maxNrInputsUsed > 0 && maxNrInputsUsed < inputCameras.size()) {
+					int largest = SelectionGrid::largestResolution(inputCameras, maxNrInputsUsed, selectionGridResolution);
+					if (largest < selectionGridResolution) {
+						std::cout << "Error: with --selection_grid " << selectionGridResolution << ", the selection grid of this rig would be larger than "
+							<< (SelectionGrid::maxTableBytes >> 20) << " MB and take too long to build, ";
+						if (largest >= 2) {
+							std::cout << "use --selection_grid " << largest << " or lower" << std::endl;
+						}
+						else {
+							std::cout << "leave out --selection_grid or use a lower --max_nr_inputs" << std::endl;
+						}
+						exit(-1);
+					}
+				}
+			}
+		}
+		if (result.count("coverage_selection")) {
+			coverageSamples = result["coverage_selection"].as<int>();
+			if (coverageSamples < 2 || coverageSamples > 8) {
+				std::cout << "Error: option --coverage_selection should be an int in [2,8]" << std::endl;
+				exit(-1);
+			}
+			if (selectionGridResolution > 0) {
+				std::cout << "Option --selection_grid is ignored when --coverage_selection is provided" << std::endl;
+				selectionGridResolution = 0;
+			}
+		}
+		if (result.count("coverage_budget")) {
+			coverageBudgetMs = result["coverage_budget"].as<float>();
+			if (coverageBudgetMs <= 0) {
+				std::cout << "Error: option --coverage_budget should be > 0" << std::endl;
+				exit(-1);
+			}
 		}
 		if (result.count("asap")) {
 			if (useVR) {
@@ -294,6 +550,10 @@ private:
 		{
 			fpsCsvPath = result["fps_csv"].as<std::string>();
 		}
+		if (result.count("trace"))
+		{
+			tracePath = result["trace"].as<std::string>();
+		}
 		// check if inputJsonPath and outputJsonPath are existing files
 		if (!fileExists(inputJsonPath)) {
 			std::cout << "Error: could not open file " << inputJsonPath << std::endl;
@@ -320,6 +580,13 @@ private:
 			}
 			useFpsMonitor = true;
 		}
+		if (tracePath != "") {
+			std::string s = getFolderFromFile(tracePath);
+			if (s == "" || !dirExists(s)) {
+				std::cout << "Error: could not find folder that would contain " << tracePath << std::endl;
+				return false;
+			}
+		}
 		// check if outputPath is provided if outputJsonPath is
 		if (outputJsonPath != "" && outputPath == "") {
 			std::cout << "Error: -o or --output_dir is required if -p or --output_json is defined" << outputPath << std::endl;
@@ -374,13 +641,13 @@ private:
 			return false;
 		}
 
-		// check if .mp4 or .png files are provided, and if all inputs have the same type
+		// check if .mp4, .yuv or .png files are provided, and if all inputs have the same type
 		std::string inputFileType = inputCameras[0].pathColor.substr(inputCameras[0].pathColor.size() - 3, 3);
 		for (InputCamera input : inputCameras) {
 			std::string fileTypes[2] = { input.pathColor.substr(input.pathColor.size() - 3, 3), input.pathDepth.substr(input.pathDepth.size() - 3, 3) };
 			for (std::string fileType : fileTypes) {
 				if (fileType != inputFileType) {
-					std::cout << "Error: all input cameras in the JSON need to have the same file type, i.e. the names need to end with .mp4 or .png" << std::endl;
+					std::cout << "Error: all input cameras in the JSON need to have the same file type, i.e. the names need to end with .mp4, .yuv or .png" << std::endl;
 					return false;
 				}
 			}
@@ -390,10 +657,22 @@ private:
 		}
 		else if (inputFileType == "mp4" || inputFileType == "MP4") {
 			usePNGs = false;
-			ShowDecoderCapability();
+#ifdef HAVE_NVDEC
+			if (!result.count("cpu_decode")) {
+				ShowDecoderCapability();
+			}
+#endif
+		}
+		else if (inputFileType == "yuv" || inputFileType == "YUV") {
+			usePNGs = false;
+			useRawYUV = true;
+			if (inputCameras[0].res_x % 2 != 0 || inputCameras[0].res_y % 2 != 0) {
+				std::cout << "Error: the resolution of raw YUV 4:2:0 inputs needs to be even" << std::endl;
+				return false;
+			}
 		}
 		else {
-			std::cout << "Error: all input cameras in the JSON need to be either png or mp4 files, i.e. the names need to end with .mp4 or .png" << std::endl;
+			std::cout << "Error: all input cameras in the JSON need to be either png, mp4 or yuv files, i.e. the names need to end with .mp4, .yuv or .png" << std::endl;
 			return false;
 		}
 		// check if all inputs and outputs have the same resolution and projection (and hor_range, ver_range, fov if relevant)
@@ -457,6 +736,14 @@ int main(int argc, char* argv[]){
 	Options options = Options(argc, argv);
 
 	FpsMonitor fpsMonitor(options.useVR);
+	if (options.useFpsMonitor && !fpsMonitor.Open(options.fpsCsvPath, options.isStatic, options.targetFps)) {
+		return 1;
+	}
+
+	if (options.tracePath != "") {
+		Tracer::instance().enable();
+		Tracer::instance().setThreadName("Render thread");
+	}
 
 	if (options.useVR) {
 		VRApplication pMainApplication(options, &fpsMonitor, options.inputCameras);
@@ -480,7 +767,10 @@ int main(int argc, char* argv[]){
 	}
 
 	if (options.useFpsMonitor) {
-		fpsMonitor.WriteToCSVFile(options.fpsCsvPath, options.isStatic);
+		fpsMonitor.Close();
+	}
+	if (options.tracePath != "") {
+		Tracer::instance().writeToJSONFile(options.tracePath);
 	}
 	return 0;
 }